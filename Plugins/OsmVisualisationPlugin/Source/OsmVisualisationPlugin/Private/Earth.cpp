@@ -5,6 +5,75 @@
 #include "DrawDebugHelpers.h"
 #include "NiagaraComponent.h"
 #include "NiagaraDataInterfaceArrayFunctionLibrary.h"
+#include "ProceduralMeshComponent.h"
+#include "Async/Async.h"
+#include "Async/ParallelFor.h"
+#include "HAL/FileManager.h"
+#include "Misc/Paths.h"
+#include "Algo/Count.h"
+#include "Algo/Reverse.h"
+#include "Algo/Sort.h"
+#include "OsmJsonStreamReader.h"
+#include "OsmPbfReader.h"
+#include "OsmSnapshot.h"
+#include "GreatCircle.h"
+#include "ConvexVolume.h"
+#include "SceneView.h"
+#include "Engine/LocalPlayer.h"
+#include "Engine/GameViewportClient.h"
+#include "GameFramework/PlayerController.h"
+
+class FEarthOsmElementSink : public IOsmElementSink
+{
+private:
+	AEarth* earth;
+	const FOsmIngestFilter& filter;
+
+public:
+	// Readers ask Wants* from workers, so the load is opened and its filter fixed before they start
+	FEarthOsmElementSink(AEarth* earth) : earth(earth), filter(earth->BeginLoad())
+	{
+	}
+
+	virtual ~FEarthOsmElementSink()
+	{
+		earth->EndLoad();
+	}
+
+	// Returning false would stop the reader, dropped elements are not an error
+	virtual bool AddNode(FOsmNode&& node) override
+	{
+		earth->AddNode(MoveTemp(node));
+		return true;
+	}
+
+	virtual bool AddWay(FOsmWay&& way) override
+	{
+		earth->AddWay(MoveTemp(way));
+		return true;
+	}
+
+	virtual bool AddRelation(FOsmRelation&& relation) override
+	{
+		earth->AddRelation(MoveTemp(relation));
+		return true;
+	}
+
+	virtual bool WantsNodeTags(const FOsmTagList& tags) const override
+	{
+		return filter.AcceptsNodeTags(tags);
+	}
+
+	virtual bool WantsWay(const FOsmTagList& tags) const override
+	{
+		return filter.AcceptsWay(tags);
+	}
+
+	virtual bool WantsRelation(const FOsmTagList& tags) const override
+	{
+		return filter.AcceptsRelation(tags);
+	}
+};
 
 // Sets default values
 AEarth::AEarth()
@@ -18,6 +87,8 @@ AEarth::AEarth()
 void AEarth::BeginPlay()
 {
 	Super::BeginPlay();
+
+	ingestFilter.Compile();
 	
 	auto components = GetComponents();
 	for (auto& component : components)
@@ -30,7 +101,21 @@ void AEarth::BeginPlay()
 
 	ensure(buildingVisualizer);
 
-	RenderBuildings();
+	if (useFootprintMeshes)
+	{
+		BuildFootprintMeshes();
+	}
+	else if (!streamVisibleBuildings && !useBuildingLod)
+	{
+		RenderBuildings();
+	}
+}
+
+void AEarth::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	ClearFootprintMeshes();
+
+	Super::EndPlay(EndPlayReason);
 }
 
 // Called every frame
@@ -38,6 +123,19 @@ void AEarth::Tick(float DeltaTime)
 {
 	Super::Tick(DeltaTime);
 
+	if (tileMeshQueue)
+	{
+		CommitReadyTileMeshes();
+	}
+
+	if (useBuildingLod)
+	{
+		RenderBuildingLod(GetWorld()->GetFirstPlayerController());
+	}
+	else if (streamVisibleBuildings)
+	{
+		StreamVisibleBuildings(GetWorld()->GetFirstPlayerController());
+	}
 }
 
 FVector AEarth::ConvertSphericalCoordinatesDeg(const FVector2D& latLon, double radius) const
@@ -49,12 +147,13 @@ FVector AEarth::ConvertSphericalCoordinatesDeg(const FVector2D& latLon, double r
 	// Theta - Longtiture
 	// Phi - Latitude
 
-	double theta = FMath::DegreesToRadians(latLon.X);
-	double phi = FMath::DegreesToRadians(latLon.Y);
+	double sinTheta, cosTheta, sinPhi, cosPhi;
+	FMath::SinCos(&sinTheta, &cosTheta, FMath::DegreesToRadians(latLon.X));
+	FMath::SinCos(&sinPhi, &cosPhi, FMath::DegreesToRadians(latLon.Y));
 
-	double x = radius * FMath::Sin(theta) * FMath::Cos(phi);
-	double y = radius * FMath::Sin(theta) * FMath::Sin(phi);
-	double z = radius * FMath::Cos(theta);
+	double x = radius * sinTheta * cosPhi;
+	double y = radius * sinTheta * sinPhi;
+	double z = radius * cosTheta;
 	return FVector(x, y, z);
 }
 
@@ -74,16 +173,90 @@ FVector AEarth::LatLonToWorldSpace(const FVector2D& latLon) const
 	return relative + GetActorLocation();
 }
 
+static constexpr int32 SpatialIndexNodeCapacity = 128;
+
+static FLatLonBoundingBox GetGlobalBoundingBox()
+{
+	FVector2D coordinateCenter(0, 0);
+	FVector2D halfAngleSize(90, 180);
+	return FLatLonBoundingBox(coordinateCenter, halfAngleSize);
+}
+
 void AEarth::ClearOsmData()
 {
+	// A built index stays built, just empty, so later loads keep maintaining it
+	pendingIndexNodes.Empty();
+	linearIndexStale = false;
+	if (nodeSpatialIndex)
+	{
+		nodeSpatialIndex.Reset(new FQuadTree<int64>(GetGlobalBoundingBox(), SpatialIndexNodeCapacity));
+	}
+	if (linearNodeSpatialIndex)
+	{
+		linearNodeSpatialIndex.Reset(new FLinearQuadTree<int64>(GetGlobalBoundingBox(), TArray<TPair<FVector2D, int64>>(), SpatialIndexNodeCapacity));
+	}
+
 	osmNodes.Empty();
+	compactNodes.Empty();
+	nodeSources.Empty();
+	nodePrunedAfter.Empty();
+	nodeSourcesKnown = true;
+	multipolygons.Empty();
+	multipolygonIndexByRelation.Empty();
+	multipolygonRelationsByWay.Empty();
+	multipolygonIndexParts.Empty();
+	unresolvedWayIds.Empty();
+	pendingRelationIds.Empty();
+	incompleteWayIds.Empty();
+	nodesAddedSinceFinalize = false;
+	nodesMovedSinceFinalize = false;
+	derivedDataStale = true;
+	touchedWayIds.Empty();
+	touchedRelationIds.Empty();
+	finalizeStage = EOsmFinalizeStage::Idle;
+	resolvingWayIds.Empty();
+	wayIndexParts.Empty();
+	cellBucketIds.Empty();
+	cellBuckets.Empty();
+	cellBucketFrames.Empty();
+	builtCellBucketLevel = INDEX_NONE;
+	pendingCellNodeIds.Empty();
+	pendingCellWayIds.Empty();
+	cellBucketsStale = false;
+	incompleteWayMissingNodes.Empty();
+	buildingLodLevels.Empty();
+	buildingLodCells.Empty();
+	buildingLodCellBuildings.Empty();
+	builtBuildingLodFinestLevel = INDEX_NONE;
+	builtBuildingLodCoarsestLevel = INDEX_NONE;
+	renderedLodLevel = INDEX_NONE;
+	renderedLodCells.Empty();
+	ClearFootprintMeshes();
 	osmWays.Empty();
 	osmRelations.Empty();
 }
 
 bool AEarth::LoadRelationMemberFromJsonObject(const TSharedPtr<FJsonObject>& jsonObjectPtr, FOsmRelationMember& member)
 {
-	return false;
+	FString typeStr;
+	if (!jsonObjectPtr->TryGetStringField("type", typeStr))
+	{
+		UE_LOG(LogTemp, Error, TEXT("Relation member type field not found in JSON!"));
+		return false;
+	}
+	if (!FOsmJsonStreamReader::ParseRelationMemberType(typeStr, member.type))
+	{
+		UE_LOG(LogTemp, Error, TEXT("Unknown relation member type %s!"), *typeStr);
+		return false;
+	}
+	if (!jsonObjectPtr->TryGetNumberField("ref", member.ref))
+	{
+		UE_LOG(LogTemp, Error, TEXT("Relation member ref field not found in JSON!"));
+		return false;
+	}
+	jsonObjectPtr->TryGetStringField("role", member.role);
+
+	return true;
 }
 
 bool AEarth::LoadNodeFromJsonObject(const TSharedPtr<FJsonObject>&jsonObjectPtr)
@@ -108,7 +281,7 @@ bool AEarth::LoadNodeFromJsonObject(const TSharedPtr<FJsonObject>&jsonObjectPtr)
 
 	LoadTagsFromJsonArray(node, jsonObjectPtr);
 
-	osmNodes.Add(node.id, node);
+	AddNode(MoveTemp(node));
 
 	return true;
 }
@@ -143,7 +316,7 @@ bool AEarth::LoadWayFromJsonObject(const TSharedPtr<FJsonObject>& jsonObjectPtr)
 
 	LoadTagsFromJsonArray(way, jsonObjectPtr);
 
-	osmWays.Add(way.id, way);
+	AddWay(MoveTemp(way));
 
 	return true;
 }
@@ -168,6 +341,14 @@ bool AEarth::LoadRelationFromJsonObject(const TSharedPtr<FJsonObject>& jsonObjec
 				UE_LOG(LogTemp, Error, TEXT("Relation members field is not a JSON object!"));
 				return false;
 			}
+			FString memberType;
+			OsmRelationMemberType parsedType;
+			if ((*memberJsonObject)->TryGetStringField("type", memberType) && !FOsmJsonStreamReader::ParseRelationMemberType(memberType, parsedType))
+			{
+				UE_LOG(LogTemp, Warning, TEXT("Unknown relation member type %s ignored!"), *memberType);
+				continue;
+			}
+
 			FOsmRelationMember member;
 			if (!LoadRelationMemberFromJsonObject(*memberJsonObject, member))
 			{
@@ -183,7 +364,7 @@ bool AEarth::LoadRelationFromJsonObject(const TSharedPtr<FJsonObject>& jsonObjec
 
 	LoadTagsFromJsonArray(relation, jsonObjectPtr);
 
-	osmRelations.Add(relation.id, relation);
+	AddRelation(MoveTemp(relation));
 
 	return true;
 }
@@ -194,8 +375,19 @@ bool AEarth::LoadFromJsonObject(const FJsonObjectWrapper& jsonObjectWrapper)
 	int wayNum = 0;
 	int relationNum = 0;
 
-	FJsonObject jsonObject = *jsonObjectWrapper.JsonObject.Get();
-	auto elementsArray = jsonObject.GetArrayField("elements");
+	if (!jsonObjectWrapper.JsonObject.IsValid())
+	{
+		UE_LOG(LogTemp, Error, TEXT("OSM JSON object is not valid!"));
+		return false;
+	}
+
+	// An in-memory object has no source file to key the spatial index cache on
+	nodeSourcesKnown = false;
+
+	const TArray<TSharedPtr<FJsonValue>>& elementsArray = jsonObjectWrapper.JsonObject->GetArrayField("elements");
+
+	// Elements are added directly, the sink only keeps the load open while they are
+	FEarthOsmElementSink loadScope(this);
 
 	for (auto& value : elementsArray)
 	{
@@ -222,7 +414,7 @@ bool AEarth::LoadFromJsonObject(const FJsonObjectWrapper& jsonObjectWrapper)
 			}
 			wayNum++;
 		}
-		else if (type == "rel")
+		else if (type == "relation" || type == "rel")
 		{
 			if (!LoadRelationFromJsonObject(osmElementJsonObj))
 			{
@@ -238,202 +430,2417 @@ bool AEarth::LoadFromJsonObject(const FJsonObjectWrapper& jsonObjectWrapper)
 
 	UE_LOG(LogTemp, Display, TEXT("Loaded OSM elements: %d nodes, %d ways, %d relations."), nodeNum, wayNum, relationNum);
 
+	FinalizeLoadedData();
 	return true;
 }
 
-const TMap<int64, FOsmNode>& AEarth::GetNodes()
+bool AEarth::LoadFromJsonFile(const FString& jsonFilePath)
 {
-	return osmNodes;
+	FEarthOsmElementSink sink(this);
+	TOptional<FOsmSnapshotKey> sourceKey;
+	bool success = ReadOsmFile(jsonFilePath, sink, useSnapshotCache, sourceKey);
+	AddNodeSource(jsonFilePath, sourceKey, success);
+	FinalizeLoadedData();
+	return success;
 }
 
-const TMap<int64, FOsmWay>& AEarth::GetWays()
+bool AEarth::LoadFromJsonFiles(const TArray<FString>& jsonFilePaths)
 {
-	return osmWays;
+	// Files are parsed in waves of one per worker, so at most a wave of staging batches is alive at once
+	int32 waveSize = FMath::Max(1, FTaskGraphInterface::Get().GetNumWorkerThreads() + 1);
+	bool allLoaded = true;
+
+	FEarthOsmElementSink sink(this);
+	TArray<FOsmDataBatch> batches;
+	TArray<bool> results;
+	TArray<TOptional<FOsmSnapshotKey>> sourceKeys;
+	for (int32 waveStart = 0; waveStart < jsonFilePaths.Num(); waveStart += waveSize)
+	{
+		int32 waveNum = FMath::Min(waveSize, jsonFilePaths.Num() - waveStart);
+		batches.Reset();
+		batches.SetNum(waveNum);
+		for (FOsmDataBatch& batch : batches)
+		{
+			batch.consumer = &sink;
+		}
+		results.Init(false, waveNum);
+		sourceKeys.Reset();
+		sourceKeys.SetNum(waveNum);
+
+		ParallelFor(waveNum, [&jsonFilePaths, &batches, &results, &sourceKeys, waveStart, this](int32 index)
+			{
+				results[index] = ReadOsmFile(jsonFilePaths[waveStart + index], batches[index], useSnapshotCache, sourceKeys[index]);
+			});
+
+		for (int32 index = 0; index < waveNum; index++)
+		{
+			if (!results[index])
+			{
+				UE_LOG(LogTemp, Error, TEXT("Failed to build earth from JSON file %s"), *jsonFilePaths[waveStart + index]);
+				allLoaded = false;
+				continue;
+			}
+			MergeBatch(MoveTemp(batches[index]));
+			AddNodeSource(jsonFilePaths[waveStart + index], sourceKeys[index], true);
+		}
+	}
+
+	FinalizeLoadedData();
+	return allLoaded;
 }
 
-const TMap<int64, FOsmRelation>& AEarth::GetRelations()
+bool AEarth::LoadFromPbfFile(const FString& pbfFilePath)
 {
-	return osmRelations;
+	FEarthOsmElementSink sink(this);
+	TOptional<FOsmSnapshotKey> sourceKey;
+	bool success = ReadOsmFile(pbfFilePath, sink, useSnapshotCache, sourceKey);
+	AddNodeSource(pbfFilePath, sourceKey, success);
+	FinalizeLoadedData();
+	return success;
 }
 
-void AEarth::BuildSpatialIndex()
+bool AEarth::ReadOsmFile(const FString& filePath, IOsmElementSink& sink, bool useSnapshotCache, TOptional<FOsmSnapshotKey>& outSourceKey)
 {
-	FVector2D coordinateCenter(0, 0);
-	FVector2D halfAngleSize(90, 180);
-	FLatLonBoundingBox globalBox(coordinateCenter, halfAngleSize);
-
-	nodeSpatialIndex.Reset(new FQuadTree<int64>(globalBox));
+	auto parseSource = [&filePath](IOsmElementSink& parseSink)
+	{
+		if (filePath.EndsWith(TEXT(".pbf")))
+		{
+			return FOsmPbfReader::ReadFile(filePath, parseSink);
+		}
+		return FOsmJsonStreamReader::ReadFile(filePath, parseSink);
+	};
 
-	for (const auto& nodePair : osmNodes)
+	FOsmSnapshotKey sourceKey;
+	outSourceKey.Reset();
+	if (FOsmSnapshot::ComputeKey(filePath, sourceKey))
 	{
-		int64 nodeId = nodePair.Key;
-		const FOsmNode& node = nodePair.Value;
-		nodeSpatialIndex->Insert(node.GetLatLon(), nodeId);
+		outSourceKey = sourceKey;
+		if (useSnapshotCache)
+		{
+			return FOsmSnapshot::LoadCached(filePath, sourceKey, sink, parseSource);
+		}
 	}
-
-	DebugDrawSpatialIndex(5.0f);
+	return parseSource(sink);
 }
 
-void AEarth::DebugDrawGeoLine(const FVector2D& latLonFrom, const FVector2D& latLonTo, double angleStep, const FColor& color, float time) const
+void AEarth::AddNodeSource(const FString& filePath, const TOptional<FOsmSnapshotKey>& sourceKey, bool complete)
 {
-	double dLat = latLonTo.X - latLonFrom.X;
-	double dLon = latLonTo.Y - latLonFrom.Y;
-	double stepLat;
-	double stepLon;
-	int steps;
-	if (FMath::IsNearlyZero(dLat) && FMath::IsNearlyZero(dLon))
+	if (!complete || !sourceKey.IsSet())
 	{
+		nodeSourcesKnown = false;
 		return;
 	}
-	else if (FMath::Abs(dLat) > FMath::Abs(dLon))
+	nodeSources.Add({ FPaths::ConvertRelativePathToFull(filePath), sourceKey.GetValue(), loadFilter.GetRuleHash() });
+}
+
+void AEarth::MergeBatch(FOsmDataBatch&& batch)
+{
+	if (useCompactNodeStore)
 	{
-		stepLat = FMath::Sign(dLat) * angleStep;
-		stepLon = FMath::Abs(dLon / dLat) * FMath::Sign(dLon) * angleStep;
-		steps = FMath::Abs(dLat / stepLat);
+		compactNodes.Reserve(compactNodes.Num() + batch.nodes.Num());
 	}
 	else
 	{
-		stepLon = FMath::Sign(dLon) * angleStep;
-		stepLat = FMath::Abs(dLat / dLon) * FMath::Sign(dLat) * angleStep;
-		steps = FMath::Abs(dLon / stepLon);
-	}	 
-	
-	for (int i = 0; i < steps - 1; i++)
-	{
-		double lat0 = latLonFrom.X + i * stepLat;
-		double lon0 = latLonFrom.Y + i * stepLon;
-		double lat1 = latLonFrom.X + (i + 1) * stepLat;
-		double lon1 = latLonFrom.Y + (i + 1) * stepLon;
-		FVector start = LatLonToWorldSpace(FVector2D(lat0, lon0));
-		FVector end = LatLonToWorldSpace(FVector2D(lat1, lon1));
-		DrawDebugLine(GetWorld(), start, end, color, false, time);
+		osmNodes.Reserve(osmNodes.Num() + batch.nodes.Num());
 	}
+	osmWays.Reserve(osmWays.Num() + batch.ways.Num());
+	osmRelations.Reserve(osmRelations.Num() + batch.relations.Num());
+
+	FEarthOsmElementSink sink(this);
+	batch.Drain(sink);
 }
 
-void AEarth::DebugDrawQuadTreeNode(FQuadTree<int64>* quadTreeNode, double time) const
+bool AEarth::AddNode(FOsmNode&& node)
 {
-	check(quadTreeNode);
+	if (!loadFilter.AcceptsNodeTags(node.tags))
+	{
+		node.tags.Reset();
+	}
 
-	double angleStep = 0.1f;
-	FLatLonBoundingBox box = quadTreeNode->GetLatLonBoundingBox();
+	// Ways keep the indices of their nodes, new nodes may complete some and moved ones change their shapes
+	FVector2D oldLatLon;
+	bool existed = GetNodeLatLon(node.id, oldLatLon);
+	bool moved = existed && !oldLatLon.Equals(node.GetLatLon(), 1.0 / FOsmNodeStore::CoordinateScale);
+	nodesAddedSinceFinalize |= !existed;
+	nodesMovedSinceFinalize |= moved;
 
-	FVector2D nw = box.GetNorthWestPoint();
-	FVector2D ne = box.GetNorthEastPoint();
-	FVector2D se = box.GetSouthEastPoint();
-	FVector2D sw = box.GetSouthWestPoint();
+	if (nodeSpatialIndex || linearNodeSpatialIndex)
+	{
+		RemoveNodeFromSpatialIndex(node.id);
+		pendingIndexNodes.Emplace(node.GetLatLon(), node.id);
+	}
 
-	DebugDrawGeoLine(ne, nw, angleStep, FColor::Green, time);
-	DebugDrawGeoLine(nw, sw, angleStep, FColor::Green, time);
-	DebugDrawGeoLine(sw, se, angleStep, FColor::Green, time);
-	DebugDrawGeoLine(se, ne, angleStep, FColor::Green, time);
+	// New nodes are bucketed on their own, a bucketed one that moves needs the buckets rebuilt
+	if (builtCellBucketLevel != INDEX_NONE && !cellBucketsStale && !pendingCellNodeIds.Contains(node.id))
+	{
+		if (!existed)
+		{
+			pendingCellNodeIds.Add(node.id);
+		}
+		else if (moved)
+		{
+			cellBucketsStale = true;
+		}
+	}
 
-	for (auto tree : quadTreeNode->GetSubtrees())
+	// Nodes the filter drops only lose their tags, ways may still need them
+	if (useCompactNodeStore)
 	{
-		DebugDrawQuadTreeNode(tree, time);
+		compactNodes.Add(MoveTemp(node));
+		return true;
 	}
-}
 
-void AEarth::DebugDrawSpatialIndex(double time) const
-{
-	DebugDrawQuadTreeNode(nodeSpatialIndex.Get(), time);
+	int64 id = node.id;
+	osmNodes.Add(id, MoveTemp(node));
+	return true;
 }
 
-void AEarth::GetBuildingRenderParameters(const FOsmWay& building, FVector& location, FQuat& rotation, FVector& scale)
+bool AEarth::AddWay(FOsmWay&& way)
 {
-	int64 nodeId0 = building.nodeIds[0];
-	const FOsmNode& node0 = osmNodes[nodeId0];
-	double latSum = node0.lat;
-	double lonSum = node0.lon;
+	if (!loadFilter.AcceptsWay(way.tags))
+	{
+		return false;
+	}
 
-	double 
-		latMin = node0.lat,
-		lonMin = node0.lon,
-		latMax = node0.lat,
-		lonMax = node0.lon;
+	int64 id = way.id;
+	if (builtCellBucketLevel != INDEX_NONE && !cellBucketsStale && !pendingCellWayIds.Contains(id))
+	{
+		const FOsmWay* oldWay = osmWays.Find(id);
+		if (!oldWay)
+		{
+			pendingCellWayIds.Add(id);
+		}
+		else if (oldWay->nodeIds != way.nodeIds)
+		{
+			cellBucketsStale = true;
+		}
+	}
+	unresolvedWayIds.Add(id);
+	osmWays.Add(id, MoveTemp(way));
+	return true;
+}
 
-	for (int i = 1; i < building.nodeIds.Num(); i++)
+bool AEarth::AddRelation(FOsmRelation&& relation)
+{
+	if (!loadFilter.AcceptsRelation(relation.tags))
 	{
-		int64 nodeId = building.nodeIds[i];
-		const FOsmNode& node = osmNodes[nodeId];
-		latSum += node.lat;
-		lonSum += node.lon;
+		return false;
+	}
 
-		if (node.lat < latMin)
+	int64 id = relation.id;
+	auto forEachMemberWay = [](const FOsmRelation& multipolygonRelation, TFunctionRef<void(int64)> func)
+	{
+		if (FOsmMultipolygonAssembler::IsMultipolygon(multipolygonRelation))
 		{
-			latMin = node.lat;
+			for (const FOsmRelationMember& member : multipolygonRelation.members)
+			{
+				if (member.type == OsmRelationMemberType::RMT_Way)
+				{
+					func(member.ref);
+				}
+			}
 		}
-		else if (node.lat > latMax)
+	};
+	if (const FOsmRelation* oldRelation = osmRelations.Find(id))
+	{
+		forEachMemberWay(*oldRelation, [this, id](int64 wayId)
+			{
+				multipolygonRelationsByWay.RemoveSingle(wayId, id);
+			});
+	}
+	forEachMemberWay(relation, [this, id](int64 wayId)
 		{
-			latMax = node.lat;
-		}
+			multipolygonRelationsByWay.Add(wayId, id);
+		});
+
+	pendingRelationIds.Add(id);
+	osmRelations.Add(id, MoveTemp(relation));
+	return true;
+}
+
+void AEarth::FinalizeLoadedData()
+{
+	BeginFinalize();
+	CompleteFinalize();
+}
 
-		if (node.lon < lonMin)
+void AEarth::BeginFinalize()
+{
+	CompleteFinalize();
+
+	// Elements added while this one runs are left to the next finalize
+	finalizeFromScratch = derivedDataStale;
+	finalizeNodesAdded = nodesAddedSinceFinalize;
+	finalizeNodesMoved = nodesMovedSinceFinalize;
+	derivedDataStale = false;
+	nodesAddedSinceFinalize = false;
+	nodesMovedSinceFinalize = false;
+	finalizeStage = EOsmFinalizeStage::FinalizeNodes;
+}
+
+// Ways resolved per finalize step, a slice takes a few milliseconds on all workers
+static constexpr int32 FinalizeSliceWayNum = 65536;
+
+bool AEarth::StepFinalize(double deadline)
+{
+	// Stages run whole except resolving, which runs in slices
+	while (finalizeStage != EOsmFinalizeStage::Idle)
+	{
+		switch (finalizeStage)
 		{
-			lonMin = node.lon;
+		case EOsmFinalizeStage::FinalizeNodes:
+			compactNodes.Finalize();
+			BeginResolveWayNodes();
+			finalizeStage = EOsmFinalizeStage::ResolveWays;
+			break;
+		case EOsmFinalizeStage::ResolveWays:
+			if (ResolveWayNodeSlice(FinalizeSliceWayNum))
+			{
+				finalizeStage = EOsmFinalizeStage::AssembleMultipolygons;
+			}
+			break;
+		case EOsmFinalizeStage::AssembleMultipolygons:
+			AssembleMultipolygons();
+			finalizeStage = EOsmFinalizeStage::UpdateWayIndex;
+			break;
+		case EOsmFinalizeStage::UpdateWayIndex:
+			UpdateWayIndexAndCellBuckets();
+			finalizeStage = EOsmFinalizeStage::UpdateBuildingLod;
+			break;
+		case EOsmFinalizeStage::UpdateBuildingLod:
+			if (useBuildingLod)
+			{
+				UpdateBuildingLod();
+			}
+			else
+			{
+				builtBuildingLodFinestLevel = INDEX_NONE;
+			}
+			finalizeStage = EOsmFinalizeStage::UpdateSpatialIndex;
+			break;
+		case EOsmFinalizeStage::UpdateSpatialIndex:
+			UpdateSpatialIndex();
+			touchedWayIds.Reset();
+			touchedRelationIds.Reset();
+			finalizeStage = EOsmFinalizeStage::Idle;
+			break;
+		default:
+			break;
 		}
-		else if (node.lon > lonMax)
+
+		if (FPlatformTime::Seconds() > deadline)
 		{
-			lonMax = node.lon;
+			break;
 		}
 	}
+	return finalizeStage == EOsmFinalizeStage::Idle;
+}
 
-	double latCenter = latSum / building.nodeIds.Num();
-	double lonCenter = lonSum / building.nodeIds.Num();
+void AEarth::CompleteFinalize()
+{
+	StepFinalize(MAX_dbl);
+}
 
-	location = LatLonToWorldSpace(FVector2D(latCenter, lonCenter));
+void AEarth::SetIngestFilter(const FOsmIngestFilter& filter)
+{
+	ingestFilter = filter;
+	ingestFilter.Compile();
+}
 
-	if (FMath::RandRange(0.0, 1.0) > 0.9)
+const FOsmIngestFilter& AEarth::BeginLoad()
+{
+	if (activeLoadNum++ == 0)
 	{
-		DrawDebugLine(GetWorld(), GetActorLocation(), location, FColor::Blue, false, 20.0f);
+		ingestFilter.CompileIfNeeded();
+		loadFilter = ingestFilter;
 	}
-	
-	FRotator rotator(latCenter, lonCenter, 0);
-	rotation = FQuat::MakeFromRotator(rotator);
-
-	FVector minPoint = LatLonToWorldSpace(FVector2D(latMin, lonMin));
-	FVector maxPoint = LatLonToWorldSpace(FVector2D(latMax, lonMax));
-	double height = FMath::Abs(maxPoint.Y - minPoint.Y);
-	double width = FMath::Abs(maxPoint.X - minPoint.X);
-	scale.X = width * 0.01f;
-	scale.Y = height * 0.01f;
+	return loadFilter;
+}
 
-	// TODO Scale by building height
-	scale.Z = (width + height) / 2.0 * 0.01f;
+void AEarth::EndLoad()
+{
+	activeLoadNum = FMath::Max(0, activeLoadNum - 1);
 }
 
+#if WITH_EDITOR
+void AEarth::PostEditChangeProperty(FPropertyChangedEvent& PropertyChangedEvent)
+{
+	Super::PostEditChangeProperty(PropertyChangedEvent);
 
-void AEarth::RenderBuildings()
+	if (PropertyChangedEvent.GetMemberPropertyName() == GET_MEMBER_NAME_CHECKED(AEarth, ingestFilter))
+	{
+		ingestFilter.Compile();
+	}
+}
+#endif
+
+void AEarth::PruneUnreferencedElements()
 {
-	if (!buildingVisualizer)
+	// Elements still on their way could reference anything pruned now
+	if (activeLoadNum > 0)
 	{
+		UE_LOG(LogTemp, Warning, TEXT("Not pruning OSM elements while %d loads are running."), activeLoadNum);
 		return;
 	}
 
-	// TODO Draw only visible buildings
+	compactNodes.Finalize();
+	TSet<int64> memberWayIds;
+	TSet<int64> referencedNodeIds;
+	for (const auto& relationPair : osmRelations)
+	{
+		for (const FOsmRelationMember& member : relationPair.Value.members)
+		{
+			if (member.type == OsmRelationMemberType::RMT_Way)
+			{
+				memberWayIds.Add(member.ref);
+			}
+			else if (member.type == OsmRelationMemberType::RMT_Node)
+			{
+				referencedNodeIds.Add(member.ref);
+			}
+		}
+	}
+
+	// Untagged ways were only kept in case a relation needs them
+	int32 wayNumBefore = osmWays.Num();
+	for (auto it = osmWays.CreateIterator(); it; ++it)
+	{
+		if (it.Value().tags.IsEmpty() && !memberWayIds.Contains(it.Key()))
+		{
+			cellBucketsStale |= builtCellBucketLevel != INDEX_NONE && pendingCellWayIds.Remove(it.Key()) == 0;
+			it.RemoveCurrent();
+		}
+	}
+	osmWays.Compact();
+
+	for (const auto& wayPair : osmWays)
+	{
+		referencedNodeIds.Append(wayPair.Value.nodeIds);
+	}
 
-	TArray<FVector> locations;
-	TArray<FVector> scales;
-	TArray<FQuat> rotations;
-	for (const auto& wayTuple : osmWays)
+	// Tagged nodes that are still tagged passed the filter on their own
+	int32 nodeNumBefore = GetNodeNum();
+	if (useCompactNodeStore)
+	{
+		compactNodes.RemoveAll([&referencedNodeIds, this](int32 index)
+			{
+				int64 nodeId = compactNodes.GetId(index);
+				if (referencedNodeIds.Contains(nodeId) || compactNodes.GetTags(nodeId))
+				{
+					return false;
+				}
+				if (nodeSpatialIndex)
+				{
+					nodeSpatialIndex->Remove(compactNodes.GetLatLon(index), nodeId);
+				}
+				cellBucketsStale |= builtCellBucketLevel != INDEX_NONE && pendingCellNodeIds.Remove(nodeId) == 0;
+				return true;
+			});
+	}
+	else
 	{
-		const FOsmWay& way = wayTuple.Value;
-		if (!way.tags.Contains("building"))
+		for (auto it = osmNodes.CreateIterator(); it; ++it)
 		{
-			continue;
+			if (it.Value().tags.IsEmpty() && !referencedNodeIds.Contains(it.Key()))
+			{
+				if (nodeSpatialIndex)
+				{
+					nodeSpatialIndex->Remove(it.Value().GetLatLon(), it.Key());
+				}
+				cellBucketsStale |= builtCellBucketLevel != INDEX_NONE && pendingCellNodeIds.Remove(it.Key()) == 0;
+				it.RemoveCurrent();
+			}
 		}
-		FVector location;
-		FQuat rotation;
-		FVector scale;
-		GetBuildingRenderParameters(way, location, rotation, scale);
-		locations.Add(location);
-		rotations.Add(rotation);
-		scales.Add(scale);
-		//scales.Add(FVector(0.1f, 0.1f, 0.1f));
 	}
-	UNiagaraDataInterfaceArrayFunctionLibrary::SetNiagaraArrayVector(buildingVisualizer, "TransformLocations", locations); UNiagaraDataInterfaceArrayFunctionLibrary::SetNiagaraArrayVector(buildingVisualizer, "TransformLocations", locations);
-	UNiagaraDataInterfaceArrayFunctionLibrary::SetNiagaraArrayQuat(buildingVisualizer, "TransformRotations", rotations);
-	UNiagaraDataInterfaceArrayFunctionLibrary::SetNiagaraArrayVector(buildingVisualizer, "TransformScales", scales);
-}
 
+	// Removing nodes moves the indices of the rest, every way is resolved again
+	if (GetNodeNum() != nodeNumBefore)
+	{
+		nodePrunedAfter.Add(nodeSources.Num());
+		osmNodes.Compact();
+		derivedDataStale = true;
+		linearIndexStale |= linearNodeSpatialIndex.IsValid();
+	}
+
+	UE_LOG(LogTemp, Display, TEXT("Pruned %d unreferenced nodes and %d unused ways."), nodeNumBefore - GetNodeNum(), wayNumBefore - osmWays.Num());
 
+	// Node indices of the resolved ways moved with the removals
+	FinalizeLoadedData();
+}
+
+void AEarth::ResolveWayNodes()
+{
+	BeginResolveWayNodes();
+	ResolveWayNodeSlice(MAX_int32);
+}
 
+void AEarth::BeginResolveWayNodes()
+{
+	// Nodes keep their indices while others are added, so resolved ways only change with new nodes filling their gaps
+	resolvingWayIds.Reset();
+	resolvedWayNum = 0;
+	resolvingMissingNodeNum = 0;
+	if (finalizeFromScratch)
+	{
+		osmWays.GetKeys(resolvingWayIds);
+		incompleteWayIds.Reset();
+	}
+	else
+	{
+		resolvingWayIds = unresolvedWayIds.Array();
+		if (finalizeNodesAdded)
+		{
+			for (int64 wayId : incompleteWayIds)
+			{
+				if (!unresolvedWayIds.Contains(wayId))
+				{
+					resolvingWayIds.Add(wayId);
+				}
+			}
+		}
+	}
+	unresolvedWayIds.Reset();
+}
+
+bool AEarth::ResolveWayNodeSlice(int32 maxWayNum)
+{
+	int32 sliceNum = FMath::Min(maxWayNum, resolvingWayIds.Num() - resolvedWayNum);
+	TArray<FOsmWay*> ways;
+	ways.Reserve(sliceNum);
+	for (int32 i = 0; i < sliceNum; i++)
+	{
+		if (FOsmWay* way = osmWays.Find(resolvingWayIds[resolvedWayNum + i]))
+		{
+			ways.Add(way);
+		}
+	}
+	resolvedWayNum += sliceNum;
+
+	TArray<int32> missingNums;
+	missingNums.SetNumZeroed(ways.Num());
+	TArray<bool> changed;
+	changed.SetNumZeroed(ways.Num());
+	ParallelFor(ways.Num(), [this, &ways, &missingNums, &changed](int32 wayIndex)
+		{
+			FOsmWay& way = *ways[wayIndex];
+			bool wayChanged = way.nodeIndices.Num() != way.nodeIds.Num();
+			way.nodeIndices.SetNumUninitialized(way.nodeIds.Num());
+
+			int32 missing = 0;
+			for (int32 i = 0; i < way.nodeIds.Num(); i++)
+			{
+				int32 nodeIndex;
+				if (useCompactNodeStore)
+				{
+					nodeIndex = compactNodes.Find(way.nodeIds[i]);
+				}
+				else
+				{
+					FSetElementId elementId = osmNodes.FindId(way.nodeIds[i]);
+					nodeIndex = elementId.IsValidId() ? elementId.AsInteger() : INDEX_NONE;
+				}
+
+				wayChanged = wayChanged || way.nodeIndices[i] != nodeIndex;
+				way.nodeIndices[i] = nodeIndex;
+				missing += nodeIndex == INDEX_NONE;
+			}
+
+			missingNums[wayIndex] = missing;
+			changed[wayIndex] = wayChanged;
+		});
+
+	for (int32 wayIndex = 0; wayIndex < ways.Num(); wayIndex++)
+	{
+		int64 wayId = ways[wayIndex]->id;
+		if (missingNums[wayIndex] > 0)
+		{
+			incompleteWayIds.Add(wayId);
+			resolvingMissingNodeNum += missingNums[wayIndex];
+		}
+		else
+		{
+			incompleteWayIds.Remove(wayId);
+		}
+		if (changed[wayIndex])
+		{
+			touchedWayIds.Add(wayId);
+		}
+	}
+
+	if (resolvedWayNum < resolvingWayIds.Num())
+	{
+		return false;
+	}
+
+	if (resolvingMissingNodeNum > 0)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("%d node references in the %d resolved ways point to nodes that were not loaded, %d ways are incomplete."), resolvingMissingNodeNum, resolvingWayIds.Num(), incompleteWayIds.Num());
+	}
+	resolvingWayIds.Empty();
+	return true;
+}
+
+bool AEarth::GetNodeLatLon(int64 nodeId, FVector2D& latLon) const
+{
+	if (useCompactNodeStore)
+	{
+		int32 index = compactNodes.Find(nodeId);
+		if (index == INDEX_NONE)
+		{
+			return false;
+		}
+		latLon = compactNodes.GetLatLon(index);
+		return true;
+	}
+
+	const FOsmNode* node = osmNodes.Find(nodeId);
+	if (!node)
+	{
+		return false;
+	}
+	latLon = node->GetLatLon();
+	return true;
+}
+
+int32 AEarth::GetNodeNum() const
+{
+	return useCompactNodeStore ? compactNodes.Num() : osmNodes.Num();
+}
+
+void AEarth::AssembleMultipolygons()
+{
+	// Relations added by the load and the ones over ways that were added or gained nodes
+	bool rebuildIndex = finalizeFromScratch || finalizeNodesMoved;
+	TSet<int64> relationIds;
+	if (finalizeFromScratch)
+	{
+		multipolygons.Reset();
+		multipolygonIndexByRelation.Reset();
+		osmRelations.GetKeys(relationIds);
+	}
+	else
+	{
+		relationIds = pendingRelationIds;
+		for (int64 wayId : touchedWayIds)
+		{
+			for (auto it = multipolygonRelationsByWay.CreateConstKeyIterator(wayId); it; ++it)
+			{
+				relationIds.Add(it.Value());
+			}
+		}
+	}
+	pendingRelationIds.Reset();
+
+	TArray<const FOsmRelation*> relations;
+	for (int64 relationId : relationIds)
+	{
+		const FOsmRelation* relation = osmRelations.Find(relationId);
+		if (relation && FOsmMultipolygonAssembler::IsMultipolygon(*relation))
+		{
+			relations.Add(relation);
+		}
+		else if (multipolygonIndexByRelation.Contains(relationId))
+		{
+			RemoveMultipolygon(relationId);
+			touchedRelationIds.Add(relationId);
+			rebuildIndex = true;
+		}
+	}
+
+	TArray<FOsmMultipolygon> assembled;
+	assembled.SetNum(relations.Num());
+	std::atomic<int32> unclosedNum = 0;
+	ParallelFor(relations.Num(), [&](int32 index)
+		{
+			int32 relationUnclosedNum = 0;
+			FOsmMultipolygonAssembler::Assemble(*relations[index], osmWays, assembled[index], relationUnclosedNum);
+			unclosedNum += relationUnclosedNum;
+		});
+
+	// Replaced multipolygons keep their index, new ones are appended
+	TArray<int32> addedIndices;
+	int32 validNum = 0;
+	for (int32 index = 0; index < relations.Num(); index++)
+	{
+		int64 relationId = relations[index]->id;
+		touchedRelationIds.Add(relationId);
+		const int32* existingIndex = multipolygonIndexByRelation.Find(relationId);
+		if (!assembled[index].IsValid())
+		{
+			if (existingIndex)
+			{
+				RemoveMultipolygon(relationId);
+				rebuildIndex = true;
+			}
+			continue;
+		}
+
+		validNum++;
+		if (existingIndex)
+		{
+			multipolygons[*existingIndex] = MoveTemp(assembled[index]);
+			rebuildIndex = true;
+		}
+		else
+		{
+			multipolygonIndexByRelation.Add(relationId, multipolygons.Num());
+			addedIndices.Add(multipolygons.Num());
+			multipolygons.Add(MoveTemp(assembled[index]));
+		}
+	}
+
+	if (relations.Num() > 0)
+	{
+		UE_LOG(LogTemp, Display, TEXT("Assembled %d of %d multipolygon relations, %d rings could not be closed."), validNum, relations.Num(), unclosedNum.load());
+	}
+
+	if (rebuildIndex)
+	{
+		multipolygonIndexParts.Reset();
+		addedIndices.SetNumUninitialized(multipolygons.Num());
+		for (int32 index = 0; index < multipolygons.Num(); index++)
+		{
+			addedIndices[index] = index;
+		}
+	}
+	AddToMultipolygonIndex(addedIndices);
+}
+
+void AEarth::RemoveMultipolygon(int64 relationId)
+{
+	// The last multipolygon takes the place of the removed one
+	int32 index = multipolygonIndexByRelation.FindAndRemoveChecked(relationId);
+	int32 lastIndex = multipolygons.Num() - 1;
+	if (index != lastIndex)
+	{
+		multipolygonIndexByRelation[multipolygons[lastIndex].relationId] = index;
+	}
+	multipolygons.RemoveAtSwap(index, 1, false);
+}
+
+void AEarth::AddToMultipolygonIndex(const TArray<int32>& indices)
+{
+	if (indices.IsEmpty())
+	{
+		return;
+	}
+
+	TArray<TPair<FBox2D, int32>> multipolygonBoxes;
+	multipolygonBoxes.SetNum(indices.Num());
+	ParallelFor(indices.Num(), [this, &indices, &multipolygonBoxes](int32 index)
+		{
+			FBox2D box(ForceInit);
+			for (const FOsmRing& ring : multipolygons[indices[index]].outerRings)
+			{
+				for (int32 nodeIndex : ring.nodeIndices)
+				{
+					box += GetResolvedNodeLatLon(nodeIndex);
+				}
+			}
+			multipolygonBoxes[index] = TPair<FBox2D, int32>(box, indices[index]);
+		});
+
+	while (multipolygonIndexParts.Num() > 0 && multipolygonIndexParts.Last().Num() <= 2 * multipolygonBoxes.Num())
+	{
+		multipolygonIndexParts.Last().GetItems(multipolygonBoxes);
+		multipolygonIndexParts.Pop(false);
+	}
+	multipolygonIndexParts.Emplace(MoveTemp(multipolygonBoxes));
+}
+
+const TMap<int64, FOsmNode>& AEarth::GetNodes()
+{
+	return osmNodes;
+}
+
+const TMap<int64, FOsmWay>& AEarth::GetWays()
+{
+	return osmWays;
+}
+
+const TMap<int64, FOsmRelation>& AEarth::GetRelations()
+{
+	return osmRelations;
+}
+
+bool AEarth::ComputeSpatialIndexCacheKey(FOsmIndexCacheKey& outKey) const
+{
+	if (!nodeSourcesKnown || nodeSources.IsEmpty())
+	{
+		return false;
+	}
+
+	outKey.sources = nodeSources;
+	outKey.prunedAfter = nodePrunedAfter;
+	outKey.nodeNum = GetNodeNum();
+	outKey.layout = useLinearSpatialIndex ? 1 : 0;
+	outKey.nodeCapacity = SpatialIndexNodeCapacity;
+	return true;
+}
+
+void AEarth::BuildSpatialIndex()
+{
+	BuildNodeSpatialIndex(useSpatialIndexCache);
+}
+
+void AEarth::BuildNodeSpatialIndex(bool useCache)
+{
+	double startTime = FPlatformTime::Seconds();
+	FLatLonBoundingBox globalBox = GetGlobalBoundingBox();
+	pendingIndexNodes.Empty();
+	linearIndexStale = false;
+
+	FOsmIndexCacheKey cacheKey;
+	FString cachePath;
+	if (useCache && ComputeSpatialIndexCacheKey(cacheKey))
+	{
+		cachePath = FOsmIndexCache::GetCachePath(cacheKey);
+
+		TUniquePtr<FQuadTree<int64>> cachedIndex;
+		TUniquePtr<FLinearQuadTree<int64>> cachedLinearIndex;
+		bool loaded = FOsmIndexCache::Read(cachePath, cacheKey, [this, &cachedIndex, &cachedLinearIndex](FArchive& reader)
+			{
+				if (useLinearSpatialIndex)
+				{
+					cachedLinearIndex.Reset(new FLinearQuadTree<int64>());
+					return cachedLinearIndex->Serialize(reader);
+				}
+				cachedIndex.Reset(new FQuadTree<int64>());
+				return cachedIndex->Serialize(reader);
+			});
+
+		if (loaded)
+		{
+			spatialIndexCachePath = cachePath;
+			nodeSpatialIndex = MoveTemp(cachedIndex);
+			linearNodeSpatialIndex = MoveTemp(cachedLinearIndex);
+			UE_LOG(LogTemp, Log, TEXT("Loaded spatial index over %d nodes from %s in %.3f s"), GetNodeNum(), *cachePath, FPlatformTime::Seconds() - startTime);
+			if (debugDrawing)
+			{
+				DebugDrawSpatialIndex(5.0f);
+			}
+			return;
+		}
+	}
+
+	TArray<TPair<FVector2D, int64>> points;
+	points.Reserve(GetNodeNum());
+	ForEachNode([&points](int64 nodeId, const FVector2D& latLon)
+		{
+			points.Emplace(latLon, nodeId);
+		});
+
+	if (useLinearSpatialIndex)
+	{
+		nodeSpatialIndex.Reset();
+		linearNodeSpatialIndex.Reset(new FLinearQuadTree<int64>(globalBox, MoveTemp(points), SpatialIndexNodeCapacity));
+	}
+	else
+	{
+		linearNodeSpatialIndex.Reset();
+		nodeSpatialIndex.Reset(new FQuadTree<int64>(globalBox, MoveTemp(points), SpatialIndexNodeCapacity));
+	}
+	UE_LOG(LogTemp, Log, TEXT("Built spatial index over %d nodes in %.3f s"), GetNodeNum(), FPlatformTime::Seconds() - startTime);
+
+	if (!cachePath.IsEmpty())
+	{
+		bool written = FOsmIndexCache::Write(cachePath, cacheKey, [this](FArchive& writer)
+			{
+				return linearNodeSpatialIndex ? linearNodeSpatialIndex->Serialize(writer) : nodeSpatialIndex->Serialize(writer);
+			});
+
+		// The nodes changed since the last cached index, nothing will ask for that one again
+		if (written && !spatialIndexCachePath.IsEmpty() && spatialIndexCachePath != cachePath)
+		{
+			IFileManager::Get().Delete(*spatialIndexCachePath, false, true, true);
+		}
+		if (written)
+		{
+			spatialIndexCachePath = cachePath;
+		}
+	}
+
+	if (debugDrawing)
+	{
+		DebugDrawSpatialIndex(5.0f);
+	}
+}
+
+void AEarth::UpdateSpatialIndex()
+{
+	// Rebuilds after a load skip the cache, hashing every node and writing a full index per load would cost more than they save
+	if (linearNodeSpatialIndex && (linearIndexStale || pendingIndexNodes.Num() > 0))
+	{
+		BuildNodeSpatialIndex(false);
+		return;
+	}
+
+	if (nodeSpatialIndex)
+	{
+		// A node added more than once is indexed once, at its final position. Pruned nodes are gone.
+		TSet<int64> insertedIds;
+		insertedIds.Reserve(pendingIndexNodes.Num());
+		for (int32 index = pendingIndexNodes.Num() - 1; index >= 0; index--)
+		{
+			int64 nodeId = pendingIndexNodes[index].Value;
+			bool alreadyInserted = false;
+			insertedIds.Add(nodeId, &alreadyInserted);
+
+			FVector2D latLon;
+			if (!alreadyInserted && GetNodeLatLon(nodeId, latLon))
+			{
+				nodeSpatialIndex->Insert(latLon, nodeId);
+			}
+		}
+	}
+
+	pendingIndexNodes.Empty();
+}
+
+void AEarth::RemoveNodeFromSpatialIndex(int64 nodeId)
+{
+	if (linearNodeSpatialIndex)
+	{
+		linearIndexStale = true;
+		return;
+	}
+
+	FVector2D latLon;
+	if (useCompactNodeStore)
+	{
+		// Nodes added since the last finalize are still pending, not indexed
+		int32 index = compactNodes.FindFinalized(nodeId);
+		if (index == INDEX_NONE)
+		{
+			return;
+		}
+		latLon = compactNodes.GetLatLon(index);
+	}
+	else
+	{
+		const FOsmNode* node = osmNodes.Find(nodeId);
+		if (!node)
+		{
+			return;
+		}
+		latLon = node->GetLatLon();
+	}
+
+	nodeSpatialIndex->Remove(latLon, nodeId);
+}
+
+// Bounds of the ways with at least one loaded node
+static TArray<TPair<FBox2D, int64>> ComputeWayBoxes(const AEarth& earth, const TArray<const FOsmWay*>& ways)
+{
+	TArray<TPair<FBox2D, int64>> wayBoxes;
+	wayBoxes.SetNum(ways.Num());
+	ParallelFor(ways.Num(), [&earth, &ways, &wayBoxes](int32 index)
+		{
+			FBox2D box(ForceInit);
+			earth.ForEachWayNodeLatLon(*ways[index], [&box](const FVector2D& latLon)
+				{
+					box += latLon;
+				});
+			wayBoxes[index] = TPair<FBox2D, int64>(box, ways[index]->id);
+		});
+
+	wayBoxes.RemoveAll([](const TPair<FBox2D, int64>& wayBox)
+		{
+			return !wayBox.Key.bIsValid;
+		});
+	return wayBoxes;
+}
+
+void AEarth::BuildWayIndex()
+{
+	TArray<const FOsmWay*> ways;
+	ways.Reserve(osmWays.Num());
+	for (const auto& wayPair : osmWays)
+	{
+		ways.Add(&wayPair.Value);
+	}
+
+	wayIndexParts.Reset();
+	wayIndexParts.Emplace(ComputeWayBoxes(*this, ways));
+}
+
+void AEarth::AddToWayIndex(const TArray<const FOsmWay*>& ways)
+{
+	TArray<TPair<FBox2D, int64>> wayBoxes = ComputeWayBoxes(*this, ways);
+	if (wayBoxes.IsEmpty())
+	{
+		return;
+	}
+
+	// Parts shrink by more than half from the first to the last, every way is rebuilt into a bigger part at most log(n) times
+	while (wayIndexParts.Num() > 0 && wayIndexParts.Last().Num() <= 2 * wayBoxes.Num())
+	{
+		wayIndexParts.Last().GetItems(wayBoxes);
+		wayIndexParts.Pop(false);
+	}
+	wayIndexParts.Emplace(MoveTemp(wayBoxes));
+}
+
+void AEarth::QueryWaysInBox(const FVector2D& latLonMin, const FVector2D& latLonMax, TArray<int64>& wayIds) const
+{
+	wayIds.Reset();
+	for (const FPackedRTree<int64>& wayIndexPart : wayIndexParts)
+	{
+		wayIndexPart.Query(FBox2D(latLonMin, latLonMax), wayIds);
+	}
+}
+
+// Sorted cells of the nodes and of the ways, a way goes to the cell of the center of its nodes and to MAX_uint64 without any
+static void ComputeCells(const AEarth& earth, const TArray<TPair<int64, FVector2D>>& nodes, const TArray<const FOsmWay*>& ways, int32 level, TArray<FMortonEntry>& nodeCells, TArray<FMortonEntry>& wayCells)
+{
+	nodeCells.SetNumUninitialized(nodes.Num());
+	ParallelFor(nodes.Num(), [&nodes, &nodeCells, level](int32 index)
+		{
+			nodeCells[index].key = FGeoCellId::FromLatLon(nodes[index].Value, level).id;
+			nodeCells[index].index = index;
+		});
+
+	// Averaged as points on the sphere, so ways across the antimeridian get a sensible center
+	wayCells.SetNumUninitialized(ways.Num());
+	ParallelFor(ways.Num(), [&earth, &ways, &wayCells, level](int32 index)
+		{
+			FVector sum = FVector::ZeroVector;
+			earth.ForEachWayNodeLatLon(*ways[index], [&sum](const FVector2D& latLon)
+				{
+					sum += FGeoCellId::LatLonToPoint(latLon);
+				});
+			wayCells[index].key = sum.IsNearlyZero() ? MAX_uint64 : FGeoCellId::FromPoint(sum, level).id;
+			wayCells[index].index = index;
+		});
+
+	FMortonCode::ParallelSort(nodeCells);
+	FMortonCode::ParallelSort(wayCells);
+}
+
+void AEarth::BuildCellBuckets()
+{
+	TArray<TPair<int64, FVector2D>> nodes;
+	nodes.Reserve(GetNodeNum());
+	ForEachNode([&nodes](int64 nodeId, const FVector2D& latLon)
+		{
+			nodes.Emplace(nodeId, latLon);
+		});
+
+	TArray<const FOsmWay*> ways;
+	ways.Reserve(osmWays.Num());
+	for (const auto& wayPair : osmWays)
+	{
+		ways.Add(&wayPair.Value);
+	}
+
+	cellBucketIds.Reset();
+	cellBuckets.Reset();
+	cellBucketFrames.Reset();
+	AddToCellBuckets(nodes, ways);
+}
+
+void AEarth::AddToCellBuckets(const TArray<TPair<int64, FVector2D>>& nodes, const TArray<const FOsmWay*>& ways)
+{
+	int32 level = FMath::Clamp(cellBucketLevel, 0, FGeoCellId::MaxLevel);
+	builtCellBucketLevel = level;
+
+	TArray<FMortonEntry> nodeCells;
+	TArray<FMortonEntry> wayCells;
+	ComputeCells(*this, nodes, ways, level, nodeCells, wayCells);
+
+	// One pass over the existing buckets, moved over as they are, and the new sorted cells
+	TArray<uint64> mergedIds;
+	TArray<FOsmCellBucket> mergedBuckets;
+	TArray<FLocalTangentFrame> mergedFrames;
+	TArray<int32> newBucketIndices;
+	mergedIds.Reserve(cellBucketIds.Num() + nodeCells.Num() + wayCells.Num());
+	mergedBuckets.Reserve(mergedIds.Max());
+	mergedFrames.Reserve(mergedIds.Max());
+
+	int32 bucketCursor = 0;
+	int32 nodeCursor = 0;
+	int32 wayCursor = 0;
+	while (bucketCursor < cellBucketIds.Num() || nodeCursor < nodeCells.Num() || (wayCursor < wayCells.Num() && wayCells[wayCursor].key != MAX_uint64))
+	{
+		uint64 bucketCell = bucketCursor < cellBucketIds.Num() ? cellBucketIds[bucketCursor] : MAX_uint64;
+		uint64 nodeCell = nodeCursor < nodeCells.Num() ? nodeCells[nodeCursor].key : MAX_uint64;
+		uint64 wayCell = wayCursor < wayCells.Num() ? wayCells[wayCursor].key : MAX_uint64;
+		uint64 cell = FMath::Min3(bucketCell, nodeCell, wayCell);
+
+		mergedIds.Add(cell);
+		if (cell == bucketCell)
+		{
+			mergedBuckets.Add(MoveTemp(cellBuckets[bucketCursor]));
+			mergedFrames.Add(cellBucketFrames[bucketCursor]);
+			bucketCursor++;
+		}
+		else
+		{
+			newBucketIndices.Add(mergedBuckets.Num());
+			mergedBuckets.AddDefaulted();
+			mergedFrames.AddDefaulted();
+		}
+
+		FOsmCellBucket& bucket = mergedBuckets.Last();
+		for (; nodeCursor < nodeCells.Num() && nodeCells[nodeCursor].key == cell; nodeCursor++)
+		{
+			bucket.nodeIds.Add(nodes[nodeCells[nodeCursor].index].Key);
+		}
+		for (; wayCursor < wayCells.Num() && wayCells[wayCursor].key == cell; wayCursor++)
+		{
+			bucket.wayIds.Add(ways[wayCells[wayCursor].index]->id);
+		}
+	}
+
+	ParallelFor(newBucketIndices.Num(), [this, &newBucketIndices, &mergedIds, &mergedFrames](int32 index)
+		{
+			int32 bucketIndex = newBucketIndices[index];
+			mergedFrames[bucketIndex] = FLocalTangentFrame(FGeoCellId(mergedIds[bucketIndex]).GetCenterLatLon(), planetVisualRadius);
+		});
+
+	cellBucketIds = MoveTemp(mergedIds);
+	cellBuckets = MoveTemp(mergedBuckets);
+	cellBucketFrames = MoveTemp(mergedFrames);
+}
+
+void AEarth::UpdateWayIndexAndCellBuckets()
+{
+	int32 level = FMath::Clamp(cellBucketLevel, 0, FGeoCellId::MaxLevel);
+	bool rebuild = builtCellBucketLevel != level || cellBucketsStale;
+
+	// A way bucketed while some of its nodes were missing moves when a load brings them
+	if (!rebuild && pendingCellNodeIds.Num() > 0)
+	{
+		for (const auto& incompletePair : incompleteWayMissingNodes)
+		{
+			const FOsmWay* way = osmWays.Find(incompletePair.Key);
+			if (!way || (int32)Algo::Count(way->nodeIndices, INDEX_NONE) != incompletePair.Value)
+			{
+				rebuild = true;
+				break;
+			}
+		}
+	}
+
+	TArray<const FOsmWay*> addedWays;
+	if (rebuild)
+	{
+		BuildWayIndex();
+		BuildCellBuckets();
+		incompleteWayMissingNodes.Reset();
+		for (const auto& wayPair : osmWays)
+		{
+			addedWays.Add(&wayPair.Value);
+		}
+	}
+	else
+	{
+		TArray<TPair<int64, FVector2D>> addedNodes;
+		addedNodes.Reserve(pendingCellNodeIds.Num());
+		for (int64 nodeId : pendingCellNodeIds)
+		{
+			FVector2D latLon;
+			if (GetNodeLatLon(nodeId, latLon))
+			{
+				addedNodes.Emplace(nodeId, latLon);
+			}
+		}
+
+		addedWays.Reserve(pendingCellWayIds.Num());
+		for (int64 wayId : pendingCellWayIds)
+		{
+			if (const FOsmWay* way = osmWays.Find(wayId))
+			{
+				addedWays.Add(way);
+			}
+		}
+
+		AddToWayIndex(addedWays);
+		AddToCellBuckets(addedNodes, addedWays);
+	}
+
+	for (const FOsmWay* way : addedWays)
+	{
+		int32 missingNodeNum = (int32)Algo::Count(way->nodeIndices, INDEX_NONE);
+		if (missingNodeNum > 0)
+		{
+			incompleteWayMissingNodes.Add(way->id, missingNodeNum);
+		}
+	}
+
+	pendingCellNodeIds.Reset();
+	pendingCellWayIds.Reset();
+	cellBucketsStale = false;
+}
+
+const FOsmCellBucket* AEarth::FindCellBucket(FGeoCellId cell) const
+{
+	int32 index = Algo::BinarySearch(cellBucketIds, cell.id);
+	return index != INDEX_NONE ? &cellBuckets[index] : nullptr;
+}
+
+FLocalTangentFrame AEarth::GetTileFrame(FGeoCellId tile) const
+{
+	int32 index = Algo::BinarySearch(cellBucketIds, tile.id);
+	if (index != INDEX_NONE && cellBucketFrames.IsValidIndex(index))
+	{
+		return cellBucketFrames[index];
+	}
+	return FLocalTangentFrame(tile.GetCenterLatLon(), planetVisualRadius);
+}
+
+int64 AEarth::GetCellId(const FVector2D& latLon, int32 level) const
+{
+	return (int64)FGeoCellId::FromLatLon(latLon, FMath::Clamp(level, 0, FGeoCellId::MaxLevel)).id;
+}
+
+void AEarth::GetCellsCoveringBox(const FVector2D& latLonMin, const FVector2D& latLonMax, int32 level, int32 maxCells, TArray<int64>& cellIds) const
+{
+	cellIds.Reset();
+
+	FLatLonBoundingBox box((latLonMin + latLonMax) * 0.5, (latLonMax - latLonMin).GetAbs() * 0.5);
+	TArray<FGeoCellId> cells;
+	FGeoCellId::CoverBox(box, level, maxCells, cells);
+	for (const FGeoCellId& cell : cells)
+	{
+		cellIds.Add((int64)cell.id);
+	}
+}
+
+void AEarth::GetCellParent(int64 cellId, int64& parentCellId) const
+{
+	FGeoCellId cell((uint64)cellId);
+	parentCellId = cell.IsValid() && cell.GetLevel() > 0 ? (int64)cell.GetParent().id : 0;
+}
+
+void AEarth::GetCellChildren(int64 cellId, TArray<int64>& childCellIds) const
+{
+	childCellIds.Reset();
+	FGeoCellId cell((uint64)cellId);
+	if (!cell.IsValid() || cell.IsLeaf())
+	{
+		return;
+	}
+	for (int32 child = 0; child < 4; child++)
+	{
+		childCellIds.Add((int64)cell.GetChild(child).id);
+	}
+}
+
+void AEarth::GetCellNeighbors(int64 cellId, TArray<int64>& neighborCellIds) const
+{
+	neighborCellIds.Reset();
+	FGeoCellId cell((uint64)cellId);
+	if (!cell.IsValid())
+	{
+		return;
+	}
+	FGeoCellId neighbors[4];
+	cell.GetEdgeNeighbors(neighbors);
+	for (const FGeoCellId& neighbor : neighbors)
+	{
+		neighborCellIds.Add((int64)neighbor.id);
+	}
+}
+
+void AEarth::GetCellContents(int64 cellId, TArray<int64>& nodeIds, TArray<int64>& wayIds) const
+{
+	nodeIds.Reset();
+	wayIds.Reset();
+	FGeoCellId cell((uint64)cellId);
+	if (!cell.IsValid())
+	{
+		return;
+	}
+	ForEachCellBucket(cell, [&nodeIds, &wayIds](FGeoCellId bucketCell, const FOsmCellBucket& bucket)
+		{
+			nodeIds.Append(bucket.nodeIds);
+			wayIds.Append(bucket.wayIds);
+		});
+}
+
+void AEarth::QueryWaysInCap(const FVector2D& centerLatLon, double radiusMeters, TArray<int64>& wayIds) const
+{
+	wayIds.Reset();
+
+	// planetRealRadius is in centimeters
+	double angle = radiusMeters / (planetRealRadius / 100.0);
+
+	auto capTest = [&centerLatLon, angle](const FBox2D& box)
+		{
+			FLatLonBoundingBox latLonBox(box.GetCenter(), box.GetExtent());
+			if (FGreatCircle::MinAngularDistance(centerLatLon, latLonBox) > angle)
+			{
+				return ECullResult::Outside;
+			}
+
+			// Seen from its own center the farthest points of a box at most half a globe wide are its corners
+			if (latLonBox.angleHalfSize.Y > 90.0)
+			{
+				return ECullResult::Intersects;
+			}
+			double boxAngle = 0.0;
+			const FVector2D corners[4] = { box.Min, box.Max, FVector2D(box.Min.X, box.Max.Y), FVector2D(box.Max.X, box.Min.Y) };
+			for (const FVector2D& corner : corners)
+			{
+				boxAngle = FMath::Max(boxAngle, FGreatCircle::AngularDistance(latLonBox.centerLatLon, corner));
+			}
+			bool inside = FGreatCircle::AngularDistance(centerLatLon, latLonBox.centerLatLon) + boxAngle <= angle;
+			return inside ? ECullResult::Inside : ECullResult::Intersects;
+		};
+
+	for (const FPackedRTree<int64>& wayIndexPart : wayIndexParts)
+	{
+		wayIndexPart.Cull(capTest, [&wayIds](const FBox2D& box, int64 wayId)
+			{
+				wayIds.Add(wayId);
+			});
+	}
+}
+
+/// <summary>
+/// Classifies lat/lon boxes against a camera looking at the planet.
+/// </summary>
+struct FEarthViewCullTest
+{
+	const FConvexVolume& frustum;
+	FVector planetCenter;
+	double planetRadius;
+	FVector viewDirection;
+	// Central angle between the point under the camera and its horizon
+	double horizonAngle;
+
+	FEarthViewCullTest(const FConvexVolume& frustum, const FVector& viewOrigin, const FVector& planetCenter, double planetRadius)
+		: frustum(frustum)
+		, planetCenter(planetCenter)
+		, planetRadius(planetRadius)
+	{
+		FVector toView = viewOrigin - planetCenter;
+		double viewDistance = toView.Size();
+		viewDirection = viewDistance > 0 ? toView / viewDistance : FVector::ZAxisVector;
+		horizonAngle = viewDistance > planetRadius ? FMath::Acos(planetRadius / viewDistance) : PI;
+	}
+
+	ECullResult operator()(const FBox2D& box) const
+	{
+		FSphericalCap cap = FSphericalCap::FromLatLonBox(box);
+
+		// Buildings are drawn about as tall as they are wide, so the chord bounds their height as well
+		double chord = cap.GetChordLength(planetRadius);
+		double viewAngle = cap.AngleTo(viewDirection);
+		double raisedHorizonAngle = horizonAngle + FMath::Acos(planetRadius / (planetRadius + chord));
+		if (viewAngle - cap.angle > raisedHorizonAngle)
+		{
+			return ECullResult::Outside;
+		}
+
+		bool fullyContained = false;
+		if (!frustum.IntersectSphere(planetCenter + cap.direction * planetRadius, 2.0 * chord, fullyContained))
+		{
+			return ECullResult::Outside;
+		}
+		return fullyContained && viewAngle + cap.angle <= horizonAngle ? ECullResult::Inside : ECullResult::Intersects;
+	}
+};
+
+bool AEarth::GetPlayerView(APlayerController* playerController, FConvexVolume& outFrustum, FVector& outViewOrigin)
+{
+	ULocalPlayer* localPlayer = playerController ? playerController->GetLocalPlayer() : nullptr;
+	if (!localPlayer || !localPlayer->ViewportClient || !localPlayer->ViewportClient->Viewport)
+	{
+		return false;
+	}
+
+	FSceneViewProjectionData projectionData;
+	if (!localPlayer->GetProjectionData(localPlayer->ViewportClient->Viewport, projectionData))
+	{
+		return false;
+	}
+
+	GetViewFrustumBounds(outFrustum, projectionData.ComputeViewProjectionMatrix(), false);
+	outViewOrigin = projectionData.ViewOrigin;
+	return true;
+}
+
+void AEarth::QueryVisibleWays(const FConvexVolume& frustum, const FVector& viewOrigin, TArray<int64>& wayIds) const
+{
+	wayIds.Reset();
+	FEarthViewCullTest viewTest(frustum, viewOrigin, GetActorLocation(), planetVisualRadius);
+	for (const FPackedRTree<int64>& wayIndexPart : wayIndexParts)
+	{
+		wayIndexPart.Cull(viewTest, [&wayIds](const FBox2D& box, int64 wayId)
+			{
+				wayIds.Add(wayId);
+			});
+	}
+}
+
+void AEarth::QueryVisibleMultipolygons(const FConvexVolume& frustum, const FVector& viewOrigin, TArray<int32>& multipolygonIndices) const
+{
+	multipolygonIndices.Reset();
+	FEarthViewCullTest viewTest(frustum, viewOrigin, GetActorLocation(), planetVisualRadius);
+	for (const FPackedRTree<int32>& multipolygonIndexPart : multipolygonIndexParts)
+	{
+		multipolygonIndexPart.Cull(viewTest, [&multipolygonIndices](const FBox2D& box, int32 index)
+			{
+				multipolygonIndices.Add(index);
+			});
+	}
+}
+
+void AEarth::QueryBuildingsVisibleToPlayer(APlayerController* playerController, TArray<int64>& wayIds) const
+{
+	wayIds.Reset();
+
+	FConvexVolume frustum;
+	FVector viewOrigin;
+	if (!GetPlayerView(playerController, frustum, viewOrigin))
+	{
+		return;
+	}
+
+	QueryVisibleWays(frustum, viewOrigin, wayIds);
+	const int32 buildingKey = FOsmTagDictionary::Get().Intern(TEXT("building"));
+	wayIds.RemoveAll([this, buildingKey](int64 wayId)
+		{
+			const FOsmWay* way = osmWays.Find(wayId);
+			return !way || !way->tags.Contains(buildingKey);
+		});
+}
+
+void AEarth::FindNearestNodes(const FVector2D& latLon, int32 count, TArray<int64>& nodeIds) const
+{
+	nodeIds.Reset();
+
+	TArray<TPair<FVector2D, int64>> points;
+	if (linearNodeSpatialIndex)
+	{
+		linearNodeSpatialIndex->FindNearest(latLon, count, points);
+	}
+	else if (nodeSpatialIndex)
+	{
+		nodeSpatialIndex->FindNearest(latLon, count, points);
+	}
+	else
+	{
+		UE_LOG(LogTemp, Warning, TEXT("FindNearestNodes called before the spatial index was built!"));
+		return;
+	}
+
+	for (const auto& point : points)
+	{
+		nodeIds.Add(point.Value);
+	}
+}
+
+void AEarth::FindNodesInRadius(const FVector2D& latLon, double radiusMeters, TArray<int64>& nodeIds) const
+{
+	nodeIds.Reset();
+
+	// planetRealRadius is in centimeters
+	double angle = radiusMeters / (planetRealRadius / 100.0);
+
+	TArray<TPair<FVector2D, int64>> points;
+	if (linearNodeSpatialIndex)
+	{
+		linearNodeSpatialIndex->QueryRadius(latLon, angle, points);
+	}
+	else if (nodeSpatialIndex)
+	{
+		nodeSpatialIndex->QueryRadius(latLon, angle, points);
+	}
+	else
+	{
+		UE_LOG(LogTemp, Warning, TEXT("FindNodesInRadius called before the spatial index was built!"));
+		return;
+	}
+
+	for (const auto& point : points)
+	{
+		nodeIds.Add(point.Value);
+	}
+}
+
+void AEarth::DebugDrawGeoLine(const FVector2D& latLonFrom, const FVector2D& latLonTo, double angleStep, const FColor& color, float time) const
+{
+	double dLat = latLonTo.X - latLonFrom.X;
+	double dLon = latLonTo.Y - latLonFrom.Y;
+	double stepLat;
+	double stepLon;
+	int steps;
+	if (FMath::IsNearlyZero(dLat) && FMath::IsNearlyZero(dLon))
+	{
+		return;
+	}
+	else if (FMath::Abs(dLat) > FMath::Abs(dLon))
+	{
+		stepLat = FMath::Sign(dLat) * angleStep;
+		stepLon = FMath::Abs(dLon / dLat) * FMath::Sign(dLon) * angleStep;
+		steps = FMath::Abs(dLat / stepLat);
+	}
+	else
+	{
+		stepLon = FMath::Sign(dLon) * angleStep;
+		stepLat = FMath::Abs(dLat / dLon) * FMath::Sign(dLat) * angleStep;
+		steps = FMath::Abs(dLon / stepLon);
+	}	 
+	
+	for (int i = 0; i < steps - 1; i++)
+	{
+		double lat0 = latLonFrom.X + i * stepLat;
+		double lon0 = latLonFrom.Y + i * stepLon;
+		double lat1 = latLonFrom.X + (i + 1) * stepLat;
+		double lon1 = latLonFrom.Y + (i + 1) * stepLon;
+		FVector start = LatLonToWorldSpace(FVector2D(lat0, lon0));
+		FVector end = LatLonToWorldSpace(FVector2D(lat1, lon1));
+		DrawDebugLine(GetWorld(), start, end, color, false, time);
+	}
+}
+
+void AEarth::DebugDrawLatLonBox(const FLatLonBoundingBox& box, double time) const
+{
+	double angleStep = 0.1f;
+
+	FVector2D nw = box.GetNorthWestPoint();
+	FVector2D ne = box.GetNorthEastPoint();
+	FVector2D se = box.GetSouthEastPoint();
+	FVector2D sw = box.GetSouthWestPoint();
+
+	DebugDrawGeoLine(ne, nw, angleStep, FColor::Green, time);
+	DebugDrawGeoLine(nw, sw, angleStep, FColor::Green, time);
+	DebugDrawGeoLine(sw, se, angleStep, FColor::Green, time);
+	DebugDrawGeoLine(se, ne, angleStep, FColor::Green, time);
+}
+
+void AEarth::DebugDrawQuadTreeNode(FQuadTree<int64>* quadTreeNode, double time) const
+{
+	check(quadTreeNode);
+
+	DebugDrawLatLonBox(quadTreeNode->GetLatLonBoundingBox(), time);
+
+	for (auto tree : quadTreeNode->GetSubtrees())
+	{
+		DebugDrawQuadTreeNode(tree, time);
+	}
+}
+
+void AEarth::DebugDrawQuadTreeNode(const FLinearQuadTree<int64>::FNodeRef& quadTreeNode, double time) const
+{
+	DebugDrawLatLonBox(quadTreeNode.GetLatLonBoundingBox(), time);
+
+	for (const auto& tree : quadTreeNode.GetSubtrees())
+	{
+		DebugDrawQuadTreeNode(tree, time);
+	}
+}
+
+void AEarth::DebugDrawSpatialIndex(double time) const
+{
+	if (linearNodeSpatialIndex)
+	{
+		DebugDrawQuadTreeNode(linearNodeSpatialIndex->GetRoot(), time);
+	}
+	else if (nodeSpatialIndex)
+	{
+		DebugDrawQuadTreeNode(nodeSpatialIndex.Get(), time);
+	}
+}
+
+void AEarth::GetBuildingRenderParameters(const FOsmWay& building, FVector& location, FQuat& rotation, FVector& scale) const
+{
+	GetRenderParameters([this, &building](TFunctionRef<void(const FVector2D&)> func)
+		{
+			ForEachWayNodeLatLon(building, func);
+		}, location, rotation, scale);
+	scale.Z = GetBuildingHeight(building.tags) * 0.01;
+}
+
+void AEarth::GetMultipolygonRenderParameters(const FOsmMultipolygon& multipolygon, FVector& location, FQuat& rotation, FVector& scale) const
+{
+	GetRenderParameters([this, &multipolygon](TFunctionRef<void(const FVector2D&)> func)
+		{
+			for (const FOsmRing& ring : multipolygon.outerRings)
+			{
+				for (int32 nodeIndex : ring.nodeIndices)
+				{
+					func(GetResolvedNodeLatLon(nodeIndex));
+				}
+			}
+		}, location, rotation, scale);
+
+	const FOsmRelation* relation = osmRelations.Find(multipolygon.relationId);
+	if (relation)
+	{
+		scale.Z = GetBuildingHeight(relation->tags) * 0.01;
+	}
+}
+
+void AEarth::GetRenderParameters(TFunctionRef<void(TFunctionRef<void(const FVector2D&)>)> forEachLatLon, FVector& location, FQuat& rotation, FVector& scale) const
+{
+	int32 nodeNum = 0;
+	double latSum = 0.0;
+	double lonSum = 0.0;
+
+	double 
+		latMin = TNumericLimits<double>::Max(),
+		lonMin = TNumericLimits<double>::Max(),
+		latMax = TNumericLimits<double>::Lowest(),
+		lonMax = TNumericLimits<double>::Lowest();
+
+	forEachLatLon([&](const FVector2D& node)
+		{
+			nodeNum++;
+			latSum += node.X;
+			lonSum += node.Y;
+			latMin = FMath::Min(latMin, node.X);
+			latMax = FMath::Max(latMax, node.X);
+			lonMin = FMath::Min(lonMin, node.Y);
+			lonMax = FMath::Max(lonMax, node.Y);
+		});
+
+	if (nodeNum == 0)
+	{
+		location = GetActorLocation();
+		rotation = FQuat::Identity;
+		scale = FVector::ZeroVector;
+		return;
+	}
+
+	double latCenter = latSum / nodeNum;
+	double lonCenter = lonSum / nodeNum;
+
+	// Same mapping as ConvertSphericalCoordinatesDeg, evaluated once. The extent between the bounding corners
+	// comes from the derivatives at the center, the error is of second order in the building's angular size.
+	double sinTheta, cosTheta, sinPhi, cosPhi;
+	FMath::SinCos(&sinTheta, &cosTheta, FMath::DegreesToRadians(latCenter));
+	FMath::SinCos(&sinPhi, &cosPhi, FMath::DegreesToRadians(lonCenter));
+	location = GetActorLocation() + planetVisualRadius * FVector(sinTheta * cosPhi, sinTheta * sinPhi, cosTheta);
+
+	FVector dTheta = planetVisualRadius * FVector(cosTheta * cosPhi, cosTheta * sinPhi, -sinTheta);
+	FVector dPhi = planetVisualRadius * FVector(-sinTheta * sinPhi, sinTheta * cosPhi, 0.0);
+	FVector extent = dTheta * FMath::DegreesToRadians(latMax - latMin) + dPhi * FMath::DegreesToRadians(lonMax - lonMin);
+	
+	FRotator rotator(latCenter, lonCenter, 0);
+	rotation = FQuat::MakeFromRotator(rotator);
+
+	double height = FMath::Abs(extent.Y);
+	double width = FMath::Abs(extent.X);
+	scale.X = width * 0.01f;
+	scale.Y = height * 0.01f;
+
+	// Callers that know the building's tags replace this with its tagged height
+	scale.Z = (width + height) / 2.0 * 0.01f;
+}
+
+void AEarth::GetBuildingTransforms(TConstArrayView<FOsmBuildingSource> buildings, TArray<FVector>& locations, TArray<FQuat>& rotations, TArray<FVector>& scales) const
+{
+	locations.SetNumUninitialized(buildings.Num());
+	rotations.SetNumUninitialized(buildings.Num());
+	scales.SetNumUninitialized(buildings.Num());
+
+	ParallelFor(buildings.Num(), [this, &buildings, &locations, &rotations, &scales](int32 index)
+		{
+			const FOsmBuildingSource& building = buildings[index];
+			if (building.way)
+			{
+				GetBuildingRenderParameters(*building.way, locations[index], rotations[index], scales[index]);
+			}
+			else
+			{
+				GetMultipolygonRenderParameters(*building.multipolygon, locations[index], rotations[index], scales[index]);
+			}
+		});
+
+	if (debugDrawing)
+	{
+		// Every tenth building, drawing all of them would swamp the view
+		for (int32 index = 0; index < locations.Num(); index += 10)
+		{
+			DrawDebugLine(GetWorld(), GetActorLocation(), locations[index], FColor::Blue, false, 20.0f);
+		}
+	}
+}
+
+void AEarth::GetAllBuildings(TArray<FOsmBuildingSource>& buildings) const
+{
+	const int32 buildingKey = FOsmTagDictionary::Get().Intern(TEXT("building"));
+	for (const auto& wayTuple : osmWays)
+	{
+		if (wayTuple.Value.tags.Contains(buildingKey))
+		{
+			buildings.Add({ &wayTuple.Value, nullptr });
+		}
+	}
+	for (const FOsmMultipolygon& multipolygon : multipolygons)
+	{
+		const FOsmRelation* relation = osmRelations.Find(multipolygon.relationId);
+		if (relation && relation->tags.Contains(buildingKey))
+		{
+			buildings.Add({ nullptr, &multipolygon });
+		}
+	}
+}
+
+void AEarth::RenderBuildings()
+{
+	if (!buildingVisualizer)
+	{
+		return;
+	}
+
+	// Draws every building, RenderVisibleBuildings() limits this to the player's view
+
+	TArray<FOsmBuildingSource> buildings;
+	GetAllBuildings(buildings);
+
+	TArray<FVector> locations;
+	TArray<FVector> scales;
+	TArray<FQuat> rotations;
+	GetBuildingTransforms(buildings, locations, rotations, scales);
+	UploadBuildingTransforms(locations, rotations, scales);
+}
+
+void AEarth::RenderVisibleBuildings(APlayerController* playerController)
+{
+	if (!buildingVisualizer)
+	{
+		return;
+	}
+
+	FConvexVolume frustum;
+	FVector viewOrigin;
+	if (!GetPlayerView(playerController, frustum, viewOrigin))
+	{
+		return;
+	}
+
+	TArray<int64> wayIds;
+	TArray<int32> multipolygonIndices;
+	QueryVisibleWays(frustum, viewOrigin, wayIds);
+	QueryVisibleMultipolygons(frustum, viewOrigin, multipolygonIndices);
+
+	TArray<FOsmBuildingSource> buildings;
+	const int32 buildingKey = FOsmTagDictionary::Get().Intern(TEXT("building"));
+	for (int64 wayId : wayIds)
+	{
+		const FOsmWay* way = osmWays.Find(wayId);
+		if (way && way->tags.Contains(buildingKey))
+		{
+			buildings.Add({ way, nullptr });
+		}
+	}
+	for (int32 index : multipolygonIndices)
+	{
+		const FOsmRelation* relation = osmRelations.Find(multipolygons[index].relationId);
+		if (relation && relation->tags.Contains(buildingKey))
+		{
+			buildings.Add({ nullptr, &multipolygons[index] });
+		}
+	}
+
+	TArray<FVector> locations;
+	TArray<FVector> scales;
+	TArray<FQuat> rotations;
+	GetBuildingTransforms(buildings, locations, rotations, scales);
+	UploadBuildingTransforms(locations, rotations, scales);
+}
+
+void AEarth::UploadBuildingTransforms(const TArray<FVector>& locations, const TArray<FQuat>& rotations, const TArray<FVector>& scales)
+{
+	// Whole arrays replace whatever was streamed into the slots
+	ResetBuildingStreaming();
+
+	UNiagaraDataInterfaceArrayFunctionLibrary::SetNiagaraArrayVector(buildingVisualizer, "TransformLocations", locations);
+	UNiagaraDataInterfaceArrayFunctionLibrary::SetNiagaraArrayQuat(buildingVisualizer, "TransformRotations", rotations);
+	UNiagaraDataInterfaceArrayFunctionLibrary::SetNiagaraArrayVector(buildingVisualizer, "TransformScales", scales);
+}
+
+void AEarth::SetBuildingSlot(int32 slot, const FVector& location, const FQuat& rotation, const FVector& scale)
+{
+	UNiagaraDataInterfaceArrayFunctionLibrary::SetNiagaraArrayVectorValue(buildingVisualizer, "TransformLocations", slot, location, true);
+	UNiagaraDataInterfaceArrayFunctionLibrary::SetNiagaraArrayQuatValue(buildingVisualizer, "TransformRotations", slot, rotation, true);
+	UNiagaraDataInterfaceArrayFunctionLibrary::SetNiagaraArrayVectorValue(buildingVisualizer, "TransformScales", slot, scale, true);
+}
+
+void AEarth::ResetBuildingStreaming()
+{
+	residentBuildingSlots.Empty();
+	freeBuildingSlots.Empty();
+	buildingSlotNum = 0;
+}
+
+void AEarth::StreamVisibleBuildings(APlayerController* playerController)
+{
+	if (!buildingVisualizer)
+	{
+		return;
+	}
+
+	FConvexVolume frustum;
+	FVector viewOrigin;
+	if (!GetPlayerView(playerController, frustum, viewOrigin))
+	{
+		return;
+	}
+
+	TArray<int64> wayIds;
+	TArray<int32> multipolygonIndices;
+	QueryVisibleWays(frustum, viewOrigin, wayIds);
+	QueryVisibleMultipolygons(frustum, viewOrigin, multipolygonIndices);
+
+	// Visible buildings, and the ones among them not resident yet with their multipolygon index or INDEX_NONE for ways
+	TSet<int64> visibleKeys;
+	visibleKeys.Reserve(wayIds.Num() + multipolygonIndices.Num());
+	TArray<TPair<int64, int32>> entering;
+	const int32 buildingKey = FOsmTagDictionary::Get().Intern(TEXT("building"));
+	for (int64 wayId : wayIds)
+	{
+		const FOsmWay* way = osmWays.Find(wayId);
+		if (way && way->tags.Contains(buildingKey))
+		{
+			visibleKeys.Add(wayId);
+			if (!residentBuildingSlots.Contains(wayId))
+			{
+				entering.Emplace(wayId, INDEX_NONE);
+			}
+		}
+	}
+	for (int32 index : multipolygonIndices)
+	{
+		const FOsmRelation* relation = osmRelations.Find(multipolygons[index].relationId);
+		if (relation && relation->tags.Contains(buildingKey))
+		{
+			int64 key = GetMultipolygonBuildingKey(multipolygons[index].relationId);
+			visibleKeys.Add(key);
+			if (!residentBuildingSlots.Contains(key))
+			{
+				entering.Emplace(key, index);
+			}
+		}
+	}
+
+	TArray<int64> leaving;
+	for (const auto& residentPair : residentBuildingSlots)
+	{
+		if (!visibleKeys.Contains(residentPair.Key))
+		{
+			leaving.Add(residentPair.Key);
+		}
+	}
+
+	// Each side gets at least half the budget and the other's unused share, so neither starves while panning
+	int32 budget = maxBuildingChurnPerFrame > 0 ? maxBuildingChurnPerFrame : MAX_int32;
+	int32 leavingNum = FMath::Min(leaving.Num(), FMath::Max(budget - budget / 2, budget - entering.Num()));
+	int32 enteringNum = FMath::Min(entering.Num(), budget - leavingNum);
+
+	// Left slots keep an instance, shrunk to nothing until the slot is reused
+	for (int32 i = 0; i < leavingNum; i++)
+	{
+		int32 slot = residentBuildingSlots.FindAndRemoveChecked(leaving[i]);
+		SetBuildingSlot(slot, GetActorLocation(), FQuat::Identity, FVector::ZeroVector);
+		freeBuildingSlots.Add(slot);
+	}
+
+	TArray<FOsmBuildingSource> buildings;
+	buildings.Reserve(enteringNum);
+	for (int32 i = 0; i < enteringNum; i++)
+	{
+		int32 multipolygonIndex = entering[i].Value;
+		if (multipolygonIndex == INDEX_NONE)
+		{
+			buildings.Add({ &osmWays[entering[i].Key], nullptr });
+		}
+		else
+		{
+			buildings.Add({ nullptr, &multipolygons[multipolygonIndex] });
+		}
+	}
+
+	TArray<FVector> locations;
+	TArray<FVector> scales;
+	TArray<FQuat> rotations;
+	GetBuildingTransforms(buildings, locations, rotations, scales);
+	for (int32 i = 0; i < enteringNum; i++)
+	{
+		int32 slot = freeBuildingSlots.Num() > 0 ? freeBuildingSlots.Pop(false) : buildingSlotNum++;
+		residentBuildingSlots.Add(entering[i].Key, slot);
+		SetBuildingSlot(slot, locations[i], rotations[i], scales[i]);
+	}
+}
+
+// Key of the building in buildingLodCells
+static int64 GetBuildingKey(const FOsmBuildingSource& building)
+{
+	return building.way ? building.way->id : AEarth::GetMultipolygonBuildingKey(building.multipolygon->relationId);
+}
+
+// Merges the aggregates of fine from cursor on that lie in the same cell of level into one of coarse, leaving cursor past them
+static void MergeLodRun(const FOsmBuildingLodLevel& fine, int32 level, int32& cursor, FOsmBuildingLodLevel& coarse)
+{
+	uint64 cell = FGeoCellId(fine.cellIds[cursor]).GetParent(level).id;
+	FBox2D footprint(ForceInit);
+	double heightSum = 0.0;
+	int32 buildingNum = 0;
+	for (; cursor < fine.Num() && FGeoCellId(fine.cellIds[cursor]).GetParent(level).id == cell; cursor++)
+	{
+		footprint += fine.footprints[cursor];
+		heightSum += fine.heightSums[cursor];
+		buildingNum += fine.buildingNums[cursor];
+	}
+	coarse.Add(cell, footprint, heightSum, buildingNum);
+}
+
+// Replaces the aggregates of the sorted dirty cells by the sorted replacements, dirty cells without one are dropped
+static void ReplaceLodCells(FOsmBuildingLodLevel& lod, const TArray<uint64>& dirtyCells, const FOsmBuildingLodLevel& replacements)
+{
+	FOsmBuildingLodLevel merged;
+	merged.level = lod.level;
+	int32 oldCursor = 0;
+	int32 dirtyCursor = 0;
+	int32 newCursor = 0;
+	while (oldCursor < lod.Num() || newCursor < replacements.Num())
+	{
+		uint64 oldCell = oldCursor < lod.Num() ? lod.cellIds[oldCursor] : MAX_uint64;
+		uint64 newCell = newCursor < replacements.Num() ? replacements.cellIds[newCursor] : MAX_uint64;
+		if (newCell <= oldCell)
+		{
+			merged.Append(replacements, newCursor++);
+			oldCursor += newCell == oldCell;
+			continue;
+		}
+
+		while (dirtyCursor < dirtyCells.Num() && dirtyCells[dirtyCursor] < oldCell)
+		{
+			dirtyCursor++;
+		}
+		if (dirtyCursor == dirtyCells.Num() || dirtyCells[dirtyCursor] != oldCell)
+		{
+			merged.Append(lod, oldCursor);
+		}
+		oldCursor++;
+	}
+	lod = MoveTemp(merged);
+}
+
+void AEarth::GetBuildingFootprint(const FOsmBuildingSource& building, FBox2D& footprint, FVector& pointSum) const
+{
+	footprint = FBox2D(ForceInit);
+	pointSum = FVector::ZeroVector;
+	auto addLatLon = [&footprint, &pointSum](const FVector2D& latLon)
+	{
+		footprint += latLon;
+		pointSum += FGeoCellId::LatLonToPoint(latLon);
+	};
+
+	if (building.way)
+	{
+		ForEachWayNodeLatLon(*building.way, addLatLon);
+		return;
+	}
+	for (const FOsmRing& ring : building.multipolygon->outerRings)
+	{
+		for (int32 nodeIndex : ring.nodeIndices)
+		{
+			addLatLon(GetResolvedNodeLatLon(nodeIndex));
+		}
+	}
+}
+
+bool AEarth::FindBuildingSource(int64 buildingKey, int32 buildingTag, FOsmBuildingSource& building) const
+{
+	if (buildingKey >= 0)
+	{
+		const FOsmWay* way = osmWays.Find(buildingKey);
+		building = { way, nullptr };
+		return way && way->tags.Contains(buildingTag);
+	}
+
+	int64 relationId = GetMultipolygonBuildingKey(buildingKey);
+	const int32* index = multipolygonIndexByRelation.Find(relationId);
+	const FOsmRelation* relation = osmRelations.Find(relationId);
+	if (!index || !relation || !relation->tags.Contains(buildingTag))
+	{
+		return false;
+	}
+	building = { nullptr, &multipolygons[*index] };
+	return true;
+}
+
+void AEarth::ComputeBuildingLodRenderParameters(FOsmBuildingLodLevel& lod) const
+{
+	lod.locations.SetNumUninitialized(lod.Num());
+	lod.rotations.SetNumUninitialized(lod.Num());
+	lod.scales.SetNumUninitialized(lod.Num());
+	ParallelFor(lod.Num(), [this, &lod](int32 index)
+		{
+			const FBox2D& footprint = lod.footprints[index];
+			GetRenderParameters([&footprint](TFunctionRef<void(const FVector2D&)> func)
+				{
+					func(footprint.Min);
+					func(footprint.Max);
+					func(FVector2D(footprint.Min.X, footprint.Max.Y));
+					func(FVector2D(footprint.Max.X, footprint.Min.Y));
+				}, lod.locations[index], lod.rotations[index], lod.scales[index]);
+			lod.scales[index].Z = lod.heightSums[index] / lod.buildingNums[index];
+		});
+}
+
+void AEarth::BuildBuildingLod()
+{
+	buildingLodLevels.Reset();
+	buildingLodCells.Reset();
+	buildingLodCellBuildings.Reset();
+	renderedLodLevel = INDEX_NONE;
+	renderedLodCells.Reset();
+
+	int32 finestLevel = FMath::Clamp(cellBucketLevel, 0, FGeoCellId::MaxLevel);
+	int32 coarsestLevel = FMath::Clamp(minBuildingLodLevel, 0, finestLevel);
+	builtBuildingLodFinestLevel = finestLevel;
+	builtBuildingLodCoarsestLevel = coarsestLevel;
+
+	TArray<FOsmBuildingSource> buildings;
+	GetAllBuildings(buildings);
+
+	// The height of every building as it would be drawn on its own
+	TArray<FVector> locations;
+	TArray<FVector> scales;
+	TArray<FQuat> rotations;
+	GetBuildingTransforms(buildings, locations, rotations, scales);
+
+	TArray<FBox2D> footprints;
+	footprints.SetNumUninitialized(buildings.Num());
+	TArray<FMortonEntry> buildingCells;
+	buildingCells.SetNumUninitialized(buildings.Num());
+	ParallelFor(buildings.Num(), [this, &buildings, &footprints, &buildingCells, finestLevel](int32 index)
+		{
+			FVector pointSum;
+			GetBuildingFootprint(buildings[index], footprints[index], pointSum);
+			buildingCells[index].key = pointSum.IsNearlyZero() ? MAX_uint64 : FGeoCellId::FromPoint(pointSum, finestLevel).id;
+			buildingCells[index].index = index;
+		});
+	FMortonCode::ParallelSort(buildingCells);
+
+	FOsmBuildingLodLevel finest;
+	finest.level = finestLevel;
+	buildingLodCells.Reserve(buildings.Num());
+	for (int32 cursor = 0; cursor < buildingCells.Num() && buildingCells[cursor].key != MAX_uint64;)
+	{
+		uint64 cell = buildingCells[cursor].key;
+		FBox2D footprint(ForceInit);
+		double heightSum = 0.0;
+		int32 buildingNum = 0;
+		for (; cursor < buildingCells.Num() && buildingCells[cursor].key == cell; cursor++)
+		{
+			int32 index = buildingCells[cursor].index;
+			footprint += footprints[index];
+			heightSum += scales[index].Z;
+			buildingNum++;
+
+			int64 buildingKey = GetBuildingKey(buildings[index]);
+			buildingLodCells.Add(buildingKey, cell);
+			buildingLodCellBuildings.Add(cell, buildingKey);
+		}
+		finest.Add(cell, footprint, heightSum, buildingNum);
+	}
+	buildingLodLevels.Add(MoveTemp(finest));
+
+	// Parents of ids in order are in order as well, each level merges runs of the one below
+	for (int32 level = finestLevel - 1; level >= coarsestLevel; level--)
+	{
+		FOsmBuildingLodLevel coarse;
+		coarse.level = level;
+		const FOsmBuildingLodLevel& fine = buildingLodLevels.Last();
+		for (int32 cursor = 0; cursor < fine.Num();)
+		{
+			MergeLodRun(fine, level, cursor, coarse);
+		}
+		buildingLodLevels.Add(MoveTemp(coarse));
+	}
+	Algo::Reverse(buildingLodLevels);
+
+	for (FOsmBuildingLodLevel& lod : buildingLodLevels)
+	{
+		ComputeBuildingLodRenderParameters(lod);
+	}
+}
+
+void AEarth::UpdateBuildingLod()
+{
+	int32 finestLevel = FMath::Clamp(cellBucketLevel, 0, FGeoCellId::MaxLevel);
+	int32 coarsestLevel = FMath::Clamp(minBuildingLodLevel, 0, finestLevel);
+	if (finalizeFromScratch || finalizeNodesMoved || builtBuildingLodFinestLevel != finestLevel || builtBuildingLodCoarsestLevel != coarsestLevel)
+	{
+		BuildBuildingLod();
+		return;
+	}
+
+	// Changed buildings leave their cell, and enter the cell they are in now if they still are buildings
+	const int32 buildingTag = FOsmTagDictionary::Get().Intern(TEXT("building"));
+	TArray<int64> changedKeys;
+	changedKeys.Reserve(touchedWayIds.Num() + touchedRelationIds.Num());
+	for (int64 wayId : touchedWayIds)
+	{
+		changedKeys.Add(wayId);
+	}
+	for (int64 relationId : touchedRelationIds)
+	{
+		changedKeys.Add(GetMultipolygonBuildingKey(relationId));
+	}
+
+	TSet<uint64> dirtyCellSet;
+	TArray<FOsmBuildingSource> entering;
+	TArray<int64> enteringKeys;
+	for (int64 buildingKey : changedKeys)
+	{
+		uint64 oldCell;
+		if (buildingLodCells.RemoveAndCopyValue(buildingKey, oldCell))
+		{
+			buildingLodCellBuildings.RemoveSingle(oldCell, buildingKey);
+			dirtyCellSet.Add(oldCell);
+		}
+
+		FOsmBuildingSource building;
+		if (FindBuildingSource(buildingKey, buildingTag, building))
+		{
+			entering.Add(building);
+			enteringKeys.Add(buildingKey);
+		}
+	}
+
+	TArray<uint64> enteringCells;
+	enteringCells.SetNumUninitialized(entering.Num());
+	ParallelFor(entering.Num(), [this, &entering, &enteringCells, finestLevel](int32 index)
+		{
+			FBox2D footprint;
+			FVector pointSum;
+			GetBuildingFootprint(entering[index], footprint, pointSum);
+			enteringCells[index] = pointSum.IsNearlyZero() ? MAX_uint64 : FGeoCellId::FromPoint(pointSum, finestLevel).id;
+		});
+	for (int32 index = 0; index < entering.Num(); index++)
+	{
+		if (enteringCells[index] != MAX_uint64)
+		{
+			buildingLodCells.Add(enteringKeys[index], enteringCells[index]);
+			buildingLodCellBuildings.Add(enteringCells[index], enteringKeys[index]);
+			dirtyCellSet.Add(enteringCells[index]);
+		}
+	}
+
+	if (dirtyCellSet.IsEmpty())
+	{
+		return;
+	}
+	TArray<uint64> dirtyCells = dirtyCellSet.Array();
+	Algo::Sort(dirtyCells);
+
+	// Dirty finest cells are merged again from all the buildings in them
+	TArray<FOsmBuildingSource> cellBuildings;
+	TArray<int32> cellStarts;
+	cellStarts.Reserve(dirtyCells.Num() + 1);
+	for (uint64 cell : dirtyCells)
+	{
+		cellStarts.Add(cellBuildings.Num());
+		for (auto it = buildingLodCellBuildings.CreateConstKeyIterator(cell); it; ++it)
+		{
+			FOsmBuildingSource building;
+			if (FindBuildingSource(it.Value(), buildingTag, building))
+			{
+				cellBuildings.Add(building);
+			}
+		}
+	}
+	cellStarts.Add(cellBuildings.Num());
+
+	TArray<FVector> locations;
+	TArray<FVector> scales;
+	TArray<FQuat> rotations;
+	GetBuildingTransforms(cellBuildings, locations, rotations, scales);
+
+	TArray<FBox2D> footprints;
+	footprints.SetNumUninitialized(cellBuildings.Num());
+	ParallelFor(cellBuildings.Num(), [this, &cellBuildings, &footprints](int32 index)
+		{
+			FVector pointSum;
+			GetBuildingFootprint(cellBuildings[index], footprints[index], pointSum);
+		});
+
+	FOsmBuildingLodLevel replacements;
+	replacements.level = finestLevel;
+	for (int32 cellIndex = 0; cellIndex < dirtyCells.Num(); cellIndex++)
+	{
+		FBox2D footprint(ForceInit);
+		double heightSum = 0.0;
+		for (int32 index = cellStarts[cellIndex]; index < cellStarts[cellIndex + 1]; index++)
+		{
+			footprint += footprints[index];
+			heightSum += scales[index].Z;
+		}
+		int32 buildingNum = cellStarts[cellIndex + 1] - cellStarts[cellIndex];
+		if (buildingNum > 0)
+		{
+			replacements.Add(dirtyCells[cellIndex], footprint, heightSum, buildingNum);
+		}
+	}
+	ComputeBuildingLodRenderParameters(replacements);
+	ReplaceLodCells(buildingLodLevels.Last(), dirtyCells, replacements);
+
+	// The parents of dirty cells are dirty as well, and in order, each is merged again from its run in the level below
+	for (int32 levelIndex = buildingLodLevels.Num() - 2; levelIndex >= 0; levelIndex--)
+	{
+		const FOsmBuildingLodLevel& fine = buildingLodLevels[levelIndex + 1];
+		FOsmBuildingLodLevel& coarse = buildingLodLevels[levelIndex];
+		int32 level = coarse.level;
+
+		TArray<uint64> parentCells;
+		for (uint64 cell : dirtyCells)
+		{
+			uint64 parentCell = FGeoCellId(cell).GetParent(level).id;
+			if (parentCells.IsEmpty() || parentCells.Last() != parentCell)
+			{
+				parentCells.Add(parentCell);
+			}
+		}
+		dirtyCells = MoveTemp(parentCells);
+
+		FOsmBuildingLodLevel coarseReplacements;
+		coarseReplacements.level = level;
+		for (uint64 cell : dirtyCells)
+		{
+			int32 cursor = Algo::LowerBoundBy(fine.cellIds, cell, [level](uint64 fineCell)
+				{
+					return FGeoCellId(fineCell).GetParent(level).id;
+				});
+			if (cursor < fine.Num() && FGeoCellId(fine.cellIds[cursor]).GetParent(level).id == cell)
+			{
+				MergeLodRun(fine, level, cursor, coarseReplacements);
+			}
+		}
+		ComputeBuildingLodRenderParameters(coarseReplacements);
+		ReplaceLodCells(coarse, dirtyCells, coarseReplacements);
+	}
+
+	renderedLodLevel = INDEX_NONE;
+	renderedLodCells.Reset();
+}
+
+void AEarth::SetViewDistance(double distance)
+{
+	viewDistance = distance;
+}
+
+int32 AEarth::GetBuildingLodLevel() const
+{
+	// Visible ground is about twice the altitude across, a face of the cell cube spans a quarter circle
+	double altitude = FMath::Max(viewDistance - planetVisualRadius, planetVisualRadius * 1e-6);
+	double cellSize = 2.0 * altitude / FMath::Max(buildingLodCellsAcrossView, 1.0);
+	double faceSize = planetVisualRadius * HALF_PI;
+	int32 level = FMath::CeilToInt32(FMath::Log2(faceSize / cellSize));
+	return FMath::Clamp(level, 0, FGeoCellId::MaxLevel);
+}
+
+void AEarth::RenderBuildingLod(APlayerController* playerController)
+{
+	if (!buildingVisualizer)
+	{
+		return;
+	}
+
+	int32 level = GetBuildingLodLevel();
+	if (buildingLodLevels.Num() == 0 || level > buildingLodLevels.Last().level)
+	{
+		// Clears the aggregates before single buildings take over the slots
+		if (renderedLodLevel != INDEX_NONE)
+		{
+			UploadBuildingTransforms(TArray<FVector>(), TArray<FQuat>(), TArray<FVector>());
+			renderedLodLevel = INDEX_NONE;
+			renderedLodCells.Reset();
+		}
+		StreamVisibleBuildings(playerController);
+		return;
+	}
+
+	FConvexVolume frustum;
+	FVector viewOrigin;
+	if (!GetPlayerView(playerController, frustum, viewOrigin))
+	{
+		return;
+	}
+
+	const FOsmBuildingLodLevel& lod = buildingLodLevels[FMath::Max(0, level - buildingLodLevels[0].level)];
+
+	FEarthViewCullTest test(frustum, viewOrigin, GetActorLocation(), planetVisualRadius);
+	TArray<FGeoCellId> cells;
+	int32 maxCells = FMath::CeilToInt32(FMath::Square(buildingLodCellsAcrossView)) * 4;
+	FGeoCellId::Cover([&test](const FGeoCellId& cell)
+		{
+			return test(cell.GetLatLonBounds());
+		}, lod.level, maxCells, cells);
+
+	TArray<int32> visibleCells;
+	for (const FGeoCellId& cell : cells)
+	{
+		int32 index = Algo::LowerBound(lod.cellIds, cell.GetRangeMin());
+		for (; index < lod.Num() && lod.cellIds[index] <= cell.GetRangeMax(); index++)
+		{
+			visibleCells.Add(index);
+		}
+	}
+
+	if (lod.level == renderedLodLevel && visibleCells == renderedLodCells)
+	{
+		return;
+	}
+
+	TArray<FVector> locations;
+	TArray<FVector> scales;
+	TArray<FQuat> rotations;
+	locations.Reserve(visibleCells.Num());
+	rotations.Reserve(visibleCells.Num());
+	scales.Reserve(visibleCells.Num());
+	for (int32 index : visibleCells)
+	{
+		locations.Add(lod.locations[index]);
+		rotations.Add(lod.rotations[index]);
+		scales.Add(lod.scales[index]);
+	}
+	UploadBuildingTransforms(locations, rotations, scales);
+
+	renderedLodLevel = lod.level;
+	renderedLodCells = MoveTemp(visibleCells);
+}
+
+double AEarth::GetBuildingHeight(const FOsmTagList& tags) const
+{
+	double metersToWorld = 100.0 * planetVisualRadius / planetRealRadius;
+	return FOsmBuildingMeshBuilder::GetHeightMeters(tags, defaultBuildingHeight) * metersToWorld;
+}
+
+void AEarth::GatherBuildingFootprints(TMap<uint64, TArray<FOsmBuildingFootprint>>& tileFootprints) const
+{
+	int32 level = FMath::Clamp(cellBucketLevel, 0, FGeoCellId::MaxLevel);
+
+	auto addFootprint = [&tileFootprints, level](FOsmBuildingFootprint&& footprint)
+	{
+		FVector sum = FVector::ZeroVector;
+		for (const FVector2D& latLon : footprint.outline)
+		{
+			sum += FGeoCellId::LatLonToPoint(latLon);
+		}
+		if (footprint.outline.Num() >= 3 && !sum.IsNearlyZero())
+		{
+			tileFootprints.FindOrAdd(FGeoCellId::FromPoint(sum, level).id).Add(MoveTemp(footprint));
+		}
+	};
+
+	TArray<FOsmBuildingSource> buildings;
+	GetAllBuildings(buildings);
+	for (const FOsmBuildingSource& building : buildings)
+	{
+		if (building.way)
+		{
+			FOsmBuildingFootprint footprint;
+			footprint.heightMeters = FOsmBuildingMeshBuilder::GetHeightMeters(building.way->tags, defaultBuildingHeight);
+			ForEachWayNodeLatLon(*building.way, [&footprint](const FVector2D& latLon)
+				{
+					footprint.outline.Add(latLon);
+				});
+			addFootprint(MoveTemp(footprint));
+			continue;
+		}
+
+		const FOsmRelation* relation = osmRelations.Find(building.multipolygon->relationId);
+		double heightMeters = relation ? FOsmBuildingMeshBuilder::GetHeightMeters(relation->tags, defaultBuildingHeight) : defaultBuildingHeight;
+		for (const FOsmRing& ring : building.multipolygon->outerRings)
+		{
+			FOsmBuildingFootprint footprint;
+			footprint.heightMeters = heightMeters;
+			footprint.outline.Reserve(ring.nodeIndices.Num());
+			for (int32 nodeIndex : ring.nodeIndices)
+			{
+				footprint.outline.Add(GetResolvedNodeLatLon(nodeIndex));
+			}
+			addFootprint(MoveTemp(footprint));
+		}
+	}
+}
+
+void AEarth::BuildFootprintMeshes()
+{
+	ClearFootprintMeshes();
+
+	TMap<uint64, TArray<FOsmBuildingFootprint>> tileFootprints;
+	GatherBuildingFootprints(tileFootprints);
+
+	tileMeshQueue = MakeShared<FOsmTileMeshQueue, ESPMode::ThreadSafe>();
+	tileMeshQueue->pendingNum = tileFootprints.Num();
+
+	// Workers only see their own copy of the footprints, the loaded data may change while they run
+	double metersToWorld = 100.0 * planetVisualRadius / planetRealRadius;
+	for (auto& tilePair : tileFootprints)
+	{
+		FLocalTangentFrame frame = GetTileFrame(FGeoCellId(tilePair.Key));
+		Async(EAsyncExecution::ThreadPool, [queue = tileMeshQueue, tileId = tilePair.Key, frame, footprints = MoveTemp(tilePair.Value), metersToWorld]()
+			{
+				if (!queue->cancelled)
+				{
+					TUniquePtr<FOsmTileMeshData> mesh = MakeUnique<FOsmTileMeshData>();
+					mesh->tileId = tileId;
+					mesh->frame = frame;
+					FOsmBuildingMeshBuilder::BuildTileMesh(footprints, metersToWorld, *mesh);
+					queue->readyMeshes.Enqueue(MoveTemp(mesh));
+				}
+				queue->pendingNum--;
+			});
+	}
+}
+
+void AEarth::CommitReadyTileMeshes()
+{
+	int32 budget = maxTileMeshCommitsPerFrame > 0 ? maxTileMeshCommitsPerFrame : MAX_int32;
+	TUniquePtr<FOsmTileMeshData> mesh;
+	while (budget > 0 && tileMeshQueue->readyMeshes.Dequeue(mesh))
+	{
+		budget--;
+		if (mesh->triangles.Num() == 0)
+		{
+			continue;
+		}
+
+		// Vertices stay small in the tile frame, the double precision transform carries the planet scale offset
+		UProceduralMeshComponent* component = NewObject<UProceduralMeshComponent>(this);
+		component->SetupAttachment(GetRootComponent());
+		component->SetRelativeTransform(mesh->frame.GetTransform());
+		component->RegisterComponent();
+		component->CreateMeshSection(0, mesh->vertices, mesh->triangles, mesh->normals, TArray<FVector2D>(), TArray<FColor>(), TArray<FProcMeshTangent>(), false);
+		if (footprintMeshMaterial)
+		{
+			component->SetMaterial(0, footprintMeshMaterial);
+		}
+		tileMeshComponents.Add((int64)mesh->tileId, component);
+	}
+
+	if (tileMeshQueue->pendingNum == 0 && tileMeshQueue->readyMeshes.IsEmpty())
+	{
+		UE_LOG(LogTemp, Display, TEXT("Committed %d footprint tile meshes"), tileMeshComponents.Num());
+		tileMeshQueue.Reset();
+	}
+}
+
+void AEarth::ClearFootprintMeshes()
+{
+	// Workers still running hold their own reference to the queue and drop their result into it
+	if (tileMeshQueue)
+	{
+		tileMeshQueue->cancelled = true;
+		tileMeshQueue.Reset();
+	}
+
+	for (auto& componentPair : tileMeshComponents)
+	{
+		if (componentPair.Value)
+		{
+			componentPair.Value->DestroyComponent();
+		}
+	}
+	tileMeshComponents.Empty();
+}
@@ -0,0 +1,321 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "OsmAsyncLoadAction.h"
+#include "Earth.h"
+#include "Async/Async.h"
+#include "Containers/Queue.h"
+#include <atomic>
+
+/// <summary>
+/// Shared between the parsing worker and the game thread. The worker groups parsed elements
+/// into batches and hands them over through a single-producer single-consumer queue.
+/// </summary>
+struct FOsmAsyncLoadState : public IOsmElementSink
+{
+	static constexpr int32 BatchSize = 16384;
+	static constexpr int32 MaxQueuedBatches = 32;
+
+	TQueue<TUniquePtr<FOsmDataBatch>, EQueueMode::Spsc> readyBatches;
+	std::atomic<int32> queuedBatchNum{ 0 };
+	std::atomic<bool> cancelled{ false };
+	std::atomic<bool> finished{ false };
+	std::atomic<bool> succeeded{ false };
+
+	TUniquePtr<FOsmDataBatch> pendingBatch = MakeUnique<FOsmDataBatch>();
+
+	// Copy of the earth's compiled filter, so the readers skip what the earth would drop
+	FOsmIngestFilter ingestFilter;
+
+	// Snapshot key of the file, written by the worker before finished is set
+	TOptional<FOsmSnapshotKey> sourceKey;
+
+	bool Flush()
+	{
+		if (pendingBatch->Num() == 0)
+		{
+			return !cancelled;
+		}
+
+		// Parsing runs ahead of committing only by a bounded number of batches
+		while (queuedBatchNum >= MaxQueuedBatches && !cancelled)
+		{
+			FPlatformProcess::Sleep(0.001f);
+		}
+		if (cancelled)
+		{
+			return false;
+		}
+
+		readyBatches.Enqueue(MoveTemp(pendingBatch));
+		queuedBatchNum++;
+		pendingBatch = MakeUnique<FOsmDataBatch>();
+		return true;
+	}
+
+	bool FlushIfFull()
+	{
+		if (cancelled)
+		{
+			return false;
+		}
+		return pendingBatch->Num() < BatchSize || Flush();
+	}
+
+	virtual bool WantsNodeTags(const FOsmTagList& tags) const override
+	{
+		return ingestFilter.AcceptsNodeTags(tags);
+	}
+
+	virtual bool WantsWay(const FOsmTagList& tags) const override
+	{
+		return ingestFilter.AcceptsWay(tags);
+	}
+
+	virtual bool WantsRelation(const FOsmTagList& tags) const override
+	{
+		return ingestFilter.AcceptsRelation(tags);
+	}
+
+	virtual bool AddNode(FOsmNode&& node) override
+	{
+		pendingBatch->AddNode(MoveTemp(node));
+		return FlushIfFull();
+	}
+
+	virtual bool AddWay(FOsmWay&& way) override
+	{
+		pendingBatch->AddWay(MoveTemp(way));
+		return FlushIfFull();
+	}
+
+	virtual bool AddRelation(FOsmRelation&& relation) override
+	{
+		pendingBatch->AddRelation(MoveTemp(relation));
+		return FlushIfFull();
+	}
+};
+
+UOsmAsyncLoadAction* UOsmAsyncLoadAction::LoadOsmFileAsync(const UObject* WorldContextObject, AEarth* earth, const FString& filePath, int32 elementsPerFrame, float frameBudgetMs)
+{
+	UOsmAsyncLoadAction* action = NewObject<UOsmAsyncLoadAction>();
+	action->earth = earth;
+	action->filePath = filePath;
+	action->elementsPerFrame = FMath::Max(1, elementsPerFrame);
+	action->frameBudgetSeconds = FMath::Max(0.0001, frameBudgetMs / 1000.0);
+	action->RegisterWithGameInstance(WorldContextObject);
+	return action;
+}
+
+void UOsmAsyncLoadAction::Activate()
+{
+	if (!earth.IsValid())
+	{
+		UE_LOG(LogTemp, Error, TEXT("Async OSM load started without an earth!"));
+		Finish(false);
+		return;
+	}
+
+	state = MakeShared<FOsmAsyncLoadState, ESPMode::ThreadSafe>();
+	state->ingestFilter = earth->BeginLoad();
+	loadOpen = true;
+
+	Async(EAsyncExecution::ThreadPool, [loadState = state, path = filePath, useSnapshotCache = earth->IsSnapshotCacheEnabled()]()
+		{
+			bool success = AEarth::ReadOsmFile(path, *loadState, useSnapshotCache, loadState->sourceKey);
+			success = success && loadState->Flush();
+			loadState->succeeded = success && !loadState->cancelled;
+			loadState->finished = true;
+		});
+
+	tickerHandle = FTSTicker::GetCoreTicker().AddTicker(FTickerDelegate::CreateUObject(this, &UOsmAsyncLoadAction::Tick));
+}
+
+void UOsmAsyncLoadAction::BeginDestroy()
+{
+	// Nothing drains the queue any more, a worker waiting for room would otherwise wait forever
+	if (state)
+	{
+		state->cancelled = true;
+	}
+	if (earth.IsValid())
+	{
+		// A finalize cut short would leave the committed data half prepared
+		if (finalizing)
+		{
+			earth->CompleteFinalize();
+		}
+		if (loadOpen)
+		{
+			// Part of the file may have been committed
+			earth->AddNodeSource(filePath, TOptional<FOsmSnapshotKey>(), false);
+			earth->EndLoad();
+		}
+	}
+	finalizing = false;
+	loadOpen = false;
+	if (tickerHandle.IsValid())
+	{
+		FTSTicker::GetCoreTicker().RemoveTicker(tickerHandle);
+		tickerHandle.Reset();
+	}
+
+	Super::BeginDestroy();
+}
+
+void UOsmAsyncLoadAction::Cancel()
+{
+	if (state)
+	{
+		// The ticker notices the flag on its next tick and finishes the action
+		state->cancelled = true;
+	}
+}
+
+const FOsmLoadProgress& UOsmAsyncLoadAction::GetProgress() const
+{
+	return progress;
+}
+
+bool UOsmAsyncLoadAction::CommitCurrentBatch(int32& budget, double deadline)
+{
+	AEarth* earthPtr = earth.Get();
+
+	// The clock is only checked every few elements, reading it is not free
+	const int32 clockCheckInterval = 256;
+	int32 sinceClockCheck = 0;
+	auto outOfBudget = [&budget, &sinceClockCheck, deadline, clockCheckInterval]()
+	{
+		if (budget <= 0)
+		{
+			return true;
+		}
+		if (++sinceClockCheck >= clockCheckInterval)
+		{
+			sinceClockCheck = 0;
+			return FPlatformTime::Seconds() > deadline;
+		}
+		return false;
+	};
+
+	while (currentNodeIndex < currentBatch->nodes.Num())
+	{
+		if (outOfBudget())
+		{
+			return false;
+		}
+		progress.nodesLoaded += earthPtr->AddNode(MoveTemp(currentBatch->nodes[currentNodeIndex++]));
+		budget--;
+	}
+
+	while (currentWayIndex < currentBatch->ways.Num())
+	{
+		if (outOfBudget())
+		{
+			return false;
+		}
+		progress.waysLoaded += earthPtr->AddWay(MoveTemp(currentBatch->ways[currentWayIndex++]));
+		budget--;
+	}
+
+	while (currentRelationIndex < currentBatch->relations.Num())
+	{
+		if (outOfBudget())
+		{
+			return false;
+		}
+		progress.relationsLoaded += earthPtr->AddRelation(MoveTemp(currentBatch->relations[currentRelationIndex++]));
+		budget--;
+	}
+
+	return true;
+}
+
+bool UOsmAsyncLoadAction::Tick(float deltaTime)
+{
+	if (!earth.IsValid())
+	{
+		state->cancelled = true;
+		Finish(false);
+		return false;
+	}
+
+	double deadline = FPlatformTime::Seconds() + frameBudgetSeconds;
+
+	// finished is read before the queue, anything enqueued before it was set is already visible.
+	// Whatever was committed stays in the earth, so it is finalized in the frame budget even when cancelled.
+	if (finalizing || state->cancelled || (state->finished && !currentBatch && state->readyBatches.IsEmpty()))
+	{
+		if (!finalizing)
+		{
+			earth->BeginFinalize();
+			finalizing = true;
+		}
+		if (!earth->StepFinalize(deadline))
+		{
+			return true;
+		}
+		Finish(state->succeeded && !state->cancelled);
+		return false;
+	}
+
+	int32 budget = elementsPerFrame;
+	int32 committedBefore = progress.nodesLoaded + progress.waysLoaded + progress.relationsLoaded;
+
+	while (budget > 0 && FPlatformTime::Seconds() < deadline)
+	{
+		if (!currentBatch)
+		{
+			if (!state->readyBatches.Dequeue(currentBatch))
+			{
+				break;
+			}
+			state->queuedBatchNum--;
+			currentNodeIndex = 0;
+			currentWayIndex = 0;
+			currentRelationIndex = 0;
+		}
+
+		if (!CommitCurrentBatch(budget, deadline))
+		{
+			break;
+		}
+		currentBatch.Reset();
+	}
+
+	if (progress.nodesLoaded + progress.waysLoaded + progress.relationsLoaded != committedBefore)
+	{
+		OnProgress.Broadcast(progress);
+	}
+
+	return true;
+}
+
+void UOsmAsyncLoadAction::Finish(bool success)
+{
+	// The load stays open until its data is finalized, nothing can prune under the finalize
+	if (loadOpen && earth.IsValid())
+	{
+		// A failed or cancelled load may have committed part of the file
+		earth->AddNodeSource(filePath, state->finished ? state->sourceKey : TOptional<FOsmSnapshotKey>(), success);
+		earth->EndLoad();
+	}
+	loadOpen = false;
+	finalizing = false;
+
+	if (success)
+	{
+		UE_LOG(LogTemp, Display, TEXT("Async OSM load of %s finished: %d nodes, %d ways, %d relations."),
+			*filePath, progress.nodesLoaded, progress.waysLoaded, progress.relationsLoaded);
+		OnCompleted.Broadcast(progress);
+	}
+	else
+	{
+		UE_LOG(LogTemp, Warning, TEXT("Async OSM load of %s failed or was cancelled."), *filePath);
+		OnFailed.Broadcast(progress);
+	}
+
+	currentBatch.Reset();
+	tickerHandle.Reset();
+	SetReadyToDestroy();
+}
@@ -0,0 +1,234 @@
+#include "OsmBuildingMesh.h"
+
+bool FOsmBuildingMeshBuilder::ParseLength(const FString& text, double& outMeters)
+{
+	FString value = text.TrimStartAndEnd();
+	double factor = 1.0;
+	if (value.EndsWith(TEXT("ft")))
+	{
+		factor = 0.3048;
+		value.LeftChopInline(2);
+	}
+	else if (value.EndsWith(TEXT("m")))
+	{
+		value.LeftChopInline(1);
+	}
+	value.TrimEndInline();
+	value.ReplaceInline(TEXT(","), TEXT("."));
+
+	double number;
+	if (!LexTryParseString(number, *value) || number <= 0.0)
+	{
+		return false;
+	}
+	outMeters = number * factor;
+	return true;
+}
+
+double FOsmBuildingMeshBuilder::GetHeightMeters(const FOsmTagList& tags, double defaultHeightMeters)
+{
+	// Keys are interned once, every building then costs two id scans and no dictionary lock
+	FOsmTagDictionary& dictionary = FOsmTagDictionary::Get();
+	static const int32 heightKey = dictionary.Intern(TEXT("height"));
+	static const int32 levelsKey = dictionary.Intern(TEXT("building:levels"));
+
+	double height;
+	int32 heightValue = tags.Find(heightKey);
+	if (heightValue != INDEX_NONE && ParseLength(dictionary.GetString(heightValue), height))
+	{
+		return height;
+	}
+
+	int32 levelsValue = tags.Find(levelsKey);
+	double levels;
+	if (levelsValue != INDEX_NONE && LexTryParseString(levels, *dictionary.GetString(levelsValue)) && levels > 0.0)
+	{
+		return levels * LevelHeightMeters;
+	}
+	return defaultHeightMeters;
+}
+
+bool FOsmBuildingMeshBuilder::Triangulate(TConstArrayView<FVector2D> polygon, TArray<int32>& OutTriangles)
+{
+	int32 pointNum = polygon.Num();
+	if (pointNum > 1 && polygon[0].Equals(polygon[pointNum - 1]))
+	{
+		pointNum--;
+	}
+	if (pointNum < 3)
+	{
+		return false;
+	}
+
+	double doubleArea = 0.0;
+	for (int32 i = 0; i < pointNum; i++)
+	{
+		doubleArea += FVector2D::CrossProduct(polygon[i], polygon[(i + 1) % pointNum]);
+	}
+	if (FMath::IsNearlyZero(doubleArea, UE_DOUBLE_SMALL_NUMBER))
+	{
+		return false;
+	}
+
+	// Counterclockwise, so ears are the vertices turning left
+	TArray<int32, TInlineAllocator<64>> remaining;
+	remaining.SetNumUninitialized(pointNum);
+	for (int32 i = 0; i < pointNum; i++)
+	{
+		remaining[i] = doubleArea > 0.0 ? i : pointNum - 1 - i;
+	}
+
+	auto isEar = [&polygon, &remaining](int32 prev, int32 current, int32 next)
+	{
+		const FVector2D& a = polygon[remaining[prev]];
+		const FVector2D& b = polygon[remaining[current]];
+		const FVector2D& c = polygon[remaining[next]];
+		if (FVector2D::CrossProduct(b - a, c - b) <= 0.0)
+		{
+			return false;
+		}
+
+		for (int32 i = 0; i < remaining.Num(); i++)
+		{
+			if (i == prev || i == current || i == next)
+			{
+				continue;
+			}
+			const FVector2D& p = polygon[remaining[i]];
+			if (p.Equals(a) || p.Equals(b) || p.Equals(c))
+			{
+				continue;
+			}
+			if (FVector2D::CrossProduct(b - a, p - a) >= 0.0 && FVector2D::CrossProduct(c - b, p - b) >= 0.0 && FVector2D::CrossProduct(a - c, p - c) >= 0.0)
+			{
+				return false;
+			}
+		}
+		return true;
+	};
+
+	int32 current = 0;
+	while (remaining.Num() > 3)
+	{
+		int32 num = remaining.Num();
+		int32 attempts = 0;
+		while (attempts < num && !isEar((current + num - 1) % num, current, (current + 1) % num))
+		{
+			current = (current + 1) % num;
+			attempts++;
+		}
+
+		// No ear left means a broken outline, the current vertex is clipped anyway so the loop ends
+		int32 prev = (current + num - 1) % num;
+		int32 next = (current + 1) % num;
+		OutTriangles.Add(remaining[prev]);
+		OutTriangles.Add(remaining[current]);
+		OutTriangles.Add(remaining[next]);
+		remaining.RemoveAt(current, 1, false);
+		if (current >= remaining.Num())
+		{
+			current = 0;
+		}
+	}
+
+	OutTriangles.Add(remaining[0]);
+	OutTriangles.Add(remaining[1]);
+	OutTriangles.Add(remaining[2]);
+	return true;
+}
+
+void FOsmBuildingMeshBuilder::AddOrientedTriangle(FOsmTileMeshData& mesh, int32 a, int32 b, int32 c, const FVector& outward)
+{
+	// Unreal treats clockwise triangles as front facing, their cross product points inward
+	FVector normal = FVector::CrossProduct(mesh.vertices[b] - mesh.vertices[a], mesh.vertices[c] - mesh.vertices[a]);
+	if (FVector::DotProduct(normal, outward) > 0.0)
+	{
+		Swap(b, c);
+	}
+	mesh.triangles.Add(a);
+	mesh.triangles.Add(b);
+	mesh.triangles.Add(c);
+}
+
+void FOsmBuildingMeshBuilder::AppendExtrudedFootprint(const FOsmBuildingFootprint& footprint, double metersToWorld, FOsmTileMeshData& mesh)
+{
+	int32 pointNum = footprint.outline.Num();
+	if (pointNum > 1 && footprint.outline[0].Equals(footprint.outline[pointNum - 1]))
+	{
+		pointNum--;
+	}
+	if (pointNum < 3)
+	{
+		return;
+	}
+
+	// Ground and roof points in the tile frame, whose Z is up
+	double height = footprint.heightMeters * metersToWorld;
+	TArray<FVector, TInlineAllocator<64>> bottoms;
+	TArray<FVector, TInlineAllocator<64>> tops;
+	TArray<FVector2D, TInlineAllocator<64>> planar;
+	bottoms.SetNumUninitialized(pointNum);
+	tops.SetNumUninitialized(pointNum);
+	planar.SetNumUninitialized(pointNum);
+	for (int32 i = 0; i < pointNum; i++)
+	{
+		bottoms[i] = mesh.frame.LatLonToLocal(footprint.outline[i]);
+		tops[i] = mesh.frame.LatLonToLocal(footprint.outline[i], height);
+		planar[i] = FVector2D(bottoms[i].X, bottoms[i].Y);
+	}
+
+	TArray<int32> roofTriangles;
+	if (!Triangulate(planar, roofTriangles))
+	{
+		return;
+	}
+
+	// Winding of the outline around up decides which side of each wall is outside
+	double doubleArea = 0.0;
+	for (int32 i = 0; i < pointNum; i++)
+	{
+		doubleArea += FVector2D::CrossProduct(planar[i], planar[(i + 1) % pointNum]);
+	}
+	double outwardSign = doubleArea >= 0.0 ? 1.0 : -1.0;
+
+	for (int32 i = 0; i < pointNum; i++)
+	{
+		int32 next = (i + 1) % pointNum;
+		FVector outward = (FVector::CrossProduct(bottoms[next] - bottoms[i], FVector::UpVector) * outwardSign).GetSafeNormal();
+		if (outward.IsZero())
+		{
+			continue;
+		}
+
+		int32 first = mesh.vertices.Num();
+		mesh.vertices.Add(bottoms[i]);
+		mesh.vertices.Add(bottoms[next]);
+		mesh.vertices.Add(tops[next]);
+		mesh.vertices.Add(tops[i]);
+		for (int32 corner = 0; corner < 4; corner++)
+		{
+			mesh.normals.Add(outward);
+		}
+		AddOrientedTriangle(mesh, first, first + 1, first + 2, outward);
+		AddOrientedTriangle(mesh, first, first + 2, first + 3, outward);
+	}
+
+	int32 roofFirst = mesh.vertices.Num();
+	for (int32 i = 0; i < pointNum; i++)
+	{
+		mesh.vertices.Add(tops[i]);
+		mesh.normals.Add(FVector::UpVector);
+	}
+	for (int32 i = 0; i + 2 < roofTriangles.Num(); i += 3)
+	{
+		AddOrientedTriangle(mesh, roofFirst + roofTriangles[i], roofFirst + roofTriangles[i + 1], roofFirst + roofTriangles[i + 2], FVector::UpVector);
+	}
+}
+
+void FOsmBuildingMeshBuilder::BuildTileMesh(const TArray<FOsmBuildingFootprint>& footprints, double metersToWorld, FOsmTileMeshData& mesh)
+{
+	for (const FOsmBuildingFootprint& footprint : footprints)
+	{
+		AppendExtrudedFootprint(footprint, metersToWorld, mesh);
+	}
+}
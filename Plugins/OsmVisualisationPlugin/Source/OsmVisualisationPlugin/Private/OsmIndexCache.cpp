@@ -0,0 +1,145 @@
+#include "OsmIndexCache.h"
+#include "OsmSnapshot.h"
+#include "HAL/FileManager.h"
+#include "Hash/CityHash.h"
+#include "Misc/Guid.h"
+#include "Misc/Paths.h"
+#include "Serialization/MemoryWriter.h"
+
+namespace OsmIndexCache
+{
+	/// <summary>
+	/// Writes the current magic and version, or checks them when loading. The key is only read when they match.
+	/// </summary>
+	static bool SerializeHeader(FArchive& ar, FOsmIndexCacheKey& key)
+	{
+		uint32 magic = FOsmIndexCache::Magic;
+		uint32 version = FOsmIndexCache::Version;
+		ar << magic;
+		ar << version;
+		if (ar.IsError() || magic != FOsmIndexCache::Magic || version != FOsmIndexCache::Version)
+		{
+			return false;
+		}
+
+		ar << key.sources;
+		ar << key.prunedAfter;
+		ar << key.nodeNum;
+		ar << key.layout;
+		ar << key.nodeCapacity;
+		return !ar.IsError();
+	}
+
+	/// <summary>
+	/// Whether the cached index is of the current version and all its sources are unchanged.
+	/// </summary>
+	static bool IsCurrent(const FString& cachePath)
+	{
+		TUniquePtr<FArchive> reader(IFileManager::Get().CreateFileReader(*cachePath));
+		if (!reader)
+		{
+			return false;
+		}
+
+		FOsmIndexCacheKey key;
+		if (!SerializeHeader(*reader, key))
+		{
+			return false;
+		}
+
+		for (const FOsmIndexSource& source : key.sources)
+		{
+			FOsmSnapshotKey currentKey;
+			if (!FOsmSnapshot::ComputeKey(source.path, currentKey) || currentKey != source.key)
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+}
+
+uint64 FOsmIndexCacheKey::GetHash() const
+{
+	TArray<uint8> keyBytes;
+	FMemoryWriter writer(keyBytes);
+	FOsmIndexCacheKey keyCopy = *this;
+	OsmIndexCache::SerializeHeader(writer, keyCopy);
+	return CityHash64(reinterpret_cast<const char*>(keyBytes.GetData()), keyBytes.Num());
+}
+
+FString FOsmIndexCache::GetCachePath(const FOsmIndexCacheKey& key)
+{
+	FString fileName = FString::Printf(TEXT("%016llx_%lld_%d_%d.osmindex"), key.GetHash(), key.nodeNum, key.layout, key.nodeCapacity);
+	return FPaths::Combine(FOsmSnapshot::GetSnapshotDir(), fileName);
+}
+
+bool FOsmIndexCache::Write(const FString& cachePath, const FOsmIndexCacheKey& key, TFunctionRef<bool(FArchive&)> writeFunc)
+{
+	// Unique, two earths with the same nodes may write the same cache file at the same time
+	FString tempPath = FString::Printf(TEXT("%s.%s.tmp"), *cachePath, *FGuid::NewGuid().ToString());
+	TUniquePtr<FArchive> writer(IFileManager::Get().CreateFileWriter(*tempPath));
+	if (!writer)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("Failed to create spatial index cache %s"), *tempPath);
+		return false;
+	}
+
+	FOsmIndexCacheKey keyCopy = key;
+	OsmIndexCache::SerializeHeader(*writer, keyCopy);
+	bool success = writeFunc(*writer) && !writer->IsError() && writer->Close();
+	writer.Reset();
+
+	if (!success || !IFileManager::Get().Move(*cachePath, *tempPath, true, true))
+	{
+		UE_LOG(LogTemp, Warning, TEXT("Failed to write spatial index cache %s"), *cachePath);
+		IFileManager::Get().Delete(*tempPath, false, true, true);
+		return false;
+	}
+
+	return true;
+}
+
+bool FOsmIndexCache::Read(const FString& cachePath, const FOsmIndexCacheKey& key, TFunctionRef<bool(FArchive&)> readFunc)
+{
+	return FOsmSnapshot::ReadWholeFile(cachePath, [&cachePath, &key, &readFunc](FArchive& reader)
+		{
+			FOsmIndexCacheKey storedKey;
+			if (!OsmIndexCache::SerializeHeader(reader, storedKey) || storedKey != key)
+			{
+				UE_LOG(LogTemp, Display, TEXT("Spatial index cache %s is stale, ignoring it."), *cachePath);
+				return false;
+			}
+
+			if (!readFunc(reader))
+			{
+				UE_LOG(LogTemp, Warning, TEXT("Spatial index cache %s is corrupted!"), *cachePath);
+				return false;
+			}
+
+			return true;
+		});
+}
+
+void FOsmIndexCache::EvictStale()
+{
+	IFileManager& fileManager = IFileManager::Get();
+	FString cacheDir = FOsmSnapshot::GetSnapshotDir();
+	TArray<FString> fileNames;
+	fileManager.FindFiles(fileNames, *FPaths::Combine(cacheDir, TEXT("*.osmindex")), true, false);
+
+	int32 evictedNum = 0;
+	for (const FString& fileName : fileNames)
+	{
+		FString cachePath = FPaths::Combine(cacheDir, fileName);
+		if (!OsmIndexCache::IsCurrent(cachePath) && fileManager.Delete(*cachePath, false, true, true))
+		{
+			evictedNum++;
+		}
+	}
+
+	if (evictedNum > 0)
+	{
+		UE_LOG(LogTemp, Display, TEXT("Evicted %d stale spatial index caches"), evictedNum);
+	}
+}
@@ -0,0 +1,540 @@
+#include "OsmJsonStreamReader.h"
+#include "HAL/FileManager.h"
+
+FOsmUtf8StreamArchive::FOsmUtf8StreamArchive(FArchive* innerArchive, int32 bufferSize)
+	: innerArchive(innerArchive)
+{
+	check(innerArchive);
+	SetIsLoading(true);
+	SetIsPersistent(false);
+
+	this->bufferSize = bufferSize;
+	innerRemaining = innerArchive->TotalSize() - innerArchive->Tell();
+}
+
+bool FOsmUtf8StreamArchive::FillBuffer()
+{
+	if (innerRemaining <= 0)
+	{
+		return false;
+	}
+
+	int32 chunkSize = (int32)FMath::Min<int64>(bufferSize, innerRemaining);
+	buffer.SetNumUninitialized(chunkSize, false);
+	innerArchive->Serialize(buffer.GetData(), chunkSize);
+	if (innerArchive->IsError())
+	{
+		SetError();
+		return false;
+	}
+
+	innerRemaining -= chunkSize;
+	bufferPos = 0;
+	return true;
+}
+
+bool FOsmUtf8StreamArchive::ReadByte(uint8& outByte)
+{
+	if (bufferPos >= buffer.Num() && !FillBuffer())
+	{
+		return false;
+	}
+
+	outByte = buffer[bufferPos++];
+	return true;
+}
+
+bool FOsmUtf8StreamArchive::DecodeChar(TCHAR& outChar)
+{
+	if (hasPendingChar)
+	{
+		outChar = pendingChar;
+		hasPendingChar = false;
+		return true;
+	}
+
+	uint8 lead;
+	if (!ReadByte(lead))
+	{
+		return false;
+	}
+
+	uint32 codepoint;
+	int extraBytes;
+	if (lead < 0x80)
+	{
+		outChar = (TCHAR)lead;
+		return true;
+	}
+	else if ((lead & 0xE0) == 0xC0)
+	{
+		codepoint = lead & 0x1F;
+		extraBytes = 1;
+	}
+	else if ((lead & 0xF0) == 0xE0)
+	{
+		codepoint = lead & 0x0F;
+		extraBytes = 2;
+	}
+	else if ((lead & 0xF8) == 0xF0)
+	{
+		codepoint = lead & 0x07;
+		extraBytes = 3;
+	}
+	else
+	{
+		// Stray continuation byte, substitute and carry on
+		outChar = (TCHAR)0xFFFD;
+		return true;
+	}
+
+	for (int i = 0; i < extraBytes; i++)
+	{
+		uint8 continuation;
+		if (!ReadByte(continuation))
+		{
+			return false;
+		}
+		codepoint = (codepoint << 6) | (continuation & 0x3F);
+	}
+
+	if (sizeof(TCHAR) == 2 && codepoint > 0xFFFF)
+	{
+		codepoint -= 0x10000;
+		outChar = (TCHAR)(0xD800 + (codepoint >> 10));
+		pendingChar = (TCHAR)(0xDC00 + (codepoint & 0x3FF));
+		hasPendingChar = true;
+		return true;
+	}
+
+	outChar = (TCHAR)codepoint;
+	return true;
+}
+
+void FOsmUtf8StreamArchive::Serialize(void* data, int64 num)
+{
+	check(num % sizeof(TCHAR) == 0);
+
+	TCHAR* outChars = (TCHAR*)data;
+	int64 charNum = num / sizeof(TCHAR);
+	for (int64 i = 0; i < charNum; i++)
+	{
+		if (!DecodeChar(outChars[i]))
+		{
+			FMemory::Memzero(outChars + i, (charNum - i) * sizeof(TCHAR));
+			SetError();
+			return;
+		}
+	}
+}
+
+bool FOsmUtf8StreamArchive::AtEnd()
+{
+	return !hasPendingChar && bufferPos >= buffer.Num() && innerRemaining <= 0;
+}
+
+FString FOsmUtf8StreamArchive::GetArchiveName() const
+{
+	return TEXT("FOsmUtf8StreamArchive");
+}
+
+FOsmJsonStreamReader::FOsmJsonStreamReader(FArchive* archive)
+	: utf8Archive(archive)
+	, jsonReader(TJsonReaderFactory<TCHAR>::Create(&utf8Archive))
+{
+
+}
+
+bool FOsmJsonStreamReader::ReadFile(const FString& jsonFilePath, IOsmElementSink& sink)
+{
+	TUniquePtr<FArchive> fileReader(IFileManager::Get().CreateFileReader(*jsonFilePath));
+	if (!fileReader)
+	{
+		UE_LOG(LogTemp, Error, TEXT("Failed to open JSON file %s"), *jsonFilePath);
+		return false;
+	}
+
+	FOsmJsonStreamReader reader(fileReader.Get());
+	return reader.Read(sink);
+}
+
+bool FOsmJsonStreamReader::ParseRelationMemberType(const FString& typeStr, OsmRelationMemberType& outType)
+{
+	if (typeStr == "node")
+	{
+		outType = OsmRelationMemberType::RMT_Node;
+	}
+	else if (typeStr == "way")
+	{
+		outType = OsmRelationMemberType::RMT_Way;
+	}
+	else if (typeStr == "relation" || typeStr == "rel")
+	{
+		outType = OsmRelationMemberType::RMT_Relation;
+	}
+	else
+	{
+		return false;
+	}
+	return true;
+}
+
+bool FOsmJsonStreamReader::ReportError(const TCHAR* message)
+{
+	UE_LOG(LogTemp, Error, TEXT("%s %s"), message, *jsonReader->GetErrorMessage());
+	return false;
+}
+
+bool FOsmJsonStreamReader::SkipValue(EJsonNotation notation)
+{
+	if (notation == EJsonNotation::ObjectStart)
+	{
+		return jsonReader->SkipObject();
+	}
+	if (notation == EJsonNotation::ArrayStart)
+	{
+		return jsonReader->SkipArray();
+	}
+	return notation != EJsonNotation::Error;
+}
+
+bool FOsmJsonStreamReader::Read(IOsmElementSink& sink)
+{
+	nodeNum = 0;
+	wayNum = 0;
+	relationNum = 0;
+
+	EJsonNotation notation;
+	if (!jsonReader->ReadNext(notation) || notation != EJsonNotation::ObjectStart)
+	{
+		return ReportError(TEXT("OSM JSON root is not an object!"));
+	}
+
+	bool elementsFound = false;
+	while (jsonReader->ReadNext(notation))
+	{
+		if (notation == EJsonNotation::ObjectEnd)
+		{
+			if (!elementsFound)
+			{
+				UE_LOG(LogTemp, Warning, TEXT("OSM JSON has no elements array!"));
+			}
+			UE_LOG(LogTemp, Display, TEXT("Loaded OSM elements: %d nodes, %d ways, %d relations."), nodeNum, wayNum, relationNum);
+			return true;
+		}
+
+		if (notation == EJsonNotation::ArrayStart && jsonReader->GetIdentifier() == "elements")
+		{
+			if (!ReadElementsArray(sink))
+			{
+				return false;
+			}
+			elementsFound = true;
+		}
+		else if (!SkipValue(notation))
+		{
+			return ReportError(TEXT("Malformed OSM JSON!"));
+		}
+	}
+
+	return ReportError(TEXT("Unexpected end of OSM JSON!"));
+}
+
+bool FOsmJsonStreamReader::ReadElementsArray(IOsmElementSink& sink)
+{
+	EJsonNotation notation;
+	while (jsonReader->ReadNext(notation))
+	{
+		if (notation == EJsonNotation::ArrayEnd)
+		{
+			return true;
+		}
+
+		if (notation == EJsonNotation::ObjectStart)
+		{
+			if (!ReadElement(sink))
+			{
+				return false;
+			}
+		}
+		else if (!SkipValue(notation))
+		{
+			return ReportError(TEXT("Malformed OSM elements array!"));
+		}
+	}
+
+	return ReportError(TEXT("Unexpected end of OSM elements array!"));
+}
+
+bool FOsmJsonStreamReader::ReadNodeIds(TArray<int64>& outNodeIds)
+{
+	EJsonNotation notation;
+	while (jsonReader->ReadNext(notation))
+	{
+		if (notation == EJsonNotation::ArrayEnd)
+		{
+			return true;
+		}
+		if (notation != EJsonNotation::Number)
+		{
+			return ReportError(TEXT("Way node id is not a number!"));
+		}
+		outNodeIds.Add(FCString::Atoi64(*jsonReader->GetValueAsNumberString()));
+	}
+
+	return ReportError(TEXT("Unexpected end of way nodes array!"));
+}
+
+bool FOsmJsonStreamReader::ReadTags(FOsmTagListBuilder& outTags)
+{
+	EJsonNotation notation;
+	while (jsonReader->ReadNext(notation))
+	{
+		if (notation == EJsonNotation::ObjectEnd)
+		{
+			return true;
+		}
+		if (notation != EJsonNotation::String)
+		{
+			return ReportError(TEXT("Non-string tag!"));
+		}
+		outTags.Add(jsonReader->GetIdentifier(), jsonReader->GetValueAsString());
+	}
+
+	return ReportError(TEXT("Unexpected end of tags object!"));
+}
+
+bool FOsmJsonStreamReader::ReadMember(FOsmRelationMember& outMember, bool& outKnownType)
+{
+	outKnownType = true;
+	bool hasType = false;
+	bool hasRef = false;
+
+	EJsonNotation notation;
+	while (jsonReader->ReadNext(notation))
+	{
+		if (notation == EJsonNotation::ObjectEnd)
+		{
+			if (!hasType || !hasRef)
+			{
+				return ReportError(TEXT("Relation member is missing type or ref!"));
+			}
+			return true;
+		}
+
+		const FString& identifier = jsonReader->GetIdentifier();
+		if (notation == EJsonNotation::String && identifier == "type")
+		{
+			if (!ParseRelationMemberType(jsonReader->GetValueAsString(), outMember.type))
+			{
+				// The rest of the member is still read, so the stream stays in step
+				UE_LOG(LogTemp, Warning, TEXT("Unknown relation member type %s ignored!"), *jsonReader->GetValueAsString());
+				outKnownType = false;
+			}
+			hasType = true;
+		}
+		else if (notation == EJsonNotation::Number && identifier == "ref")
+		{
+			outMember.ref = FCString::Atoi64(*jsonReader->GetValueAsNumberString());
+			hasRef = true;
+		}
+		else if (notation == EJsonNotation::String && identifier == "role")
+		{
+			outMember.role = jsonReader->GetValueAsString();
+		}
+		else if (!SkipValue(notation))
+		{
+			return ReportError(TEXT("Malformed relation member!"));
+		}
+	}
+
+	return ReportError(TEXT("Unexpected end of relation member!"));
+}
+
+bool FOsmJsonStreamReader::ReadMembers(TArray<FOsmRelationMember>& outMembers)
+{
+	EJsonNotation notation;
+	while (jsonReader->ReadNext(notation))
+	{
+		if (notation == EJsonNotation::ArrayEnd)
+		{
+			return true;
+		}
+		if (notation != EJsonNotation::ObjectStart)
+		{
+			return ReportError(TEXT("Relation members field is not a JSON object!"));
+		}
+
+		FOsmRelationMember member;
+		bool knownType;
+		if (!ReadMember(member, knownType))
+		{
+			return false;
+		}
+		if (knownType)
+		{
+			outMembers.Add(MoveTemp(member));
+		}
+	}
+
+	return ReportError(TEXT("Unexpected end of relation members array!"));
+}
+
+bool FOsmJsonStreamReader::ReadElement(IOsmElementSink& sink)
+{
+	elementType.Reset();
+	scratchNodeIds.Reset();
+	scratchTags.Reset();
+	scratchMembers.Reset();
+
+	bool hasId = false;
+	bool hasLat = false;
+	bool hasLon = false;
+	bool hasNodes = false;
+	bool hasMembers = false;
+	int64 id = 0;
+	double lat = 0;
+	double lon = 0;
+
+	// Fields can come in any order, so everything is collected first
+	// and handed to the sink once the element type is known
+	EJsonNotation notation = EJsonNotation::Error;
+	while (jsonReader->ReadNext(notation))
+	{
+		if (notation == EJsonNotation::ObjectEnd)
+		{
+			break;
+		}
+
+		const FString& identifier = jsonReader->GetIdentifier();
+		if (notation == EJsonNotation::String && identifier == "type")
+		{
+			elementType = jsonReader->GetValueAsString();
+		}
+		else if (notation == EJsonNotation::Number && identifier == "id")
+		{
+			id = FCString::Atoi64(*jsonReader->GetValueAsNumberString());
+			hasId = true;
+		}
+		else if (notation == EJsonNotation::Number && identifier == "lat")
+		{
+			lat = jsonReader->GetValueAsNumber();
+			hasLat = true;
+		}
+		else if (notation == EJsonNotation::Number && identifier == "lon")
+		{
+			lon = jsonReader->GetValueAsNumber();
+			hasLon = true;
+		}
+		else if (notation == EJsonNotation::ArrayStart && identifier == "nodes")
+		{
+			if (!ReadNodeIds(scratchNodeIds))
+			{
+				return false;
+			}
+			hasNodes = true;
+		}
+		else if (notation == EJsonNotation::ObjectStart && identifier == "tags")
+		{
+			if (!ReadTags(scratchTags))
+			{
+				return false;
+			}
+		}
+		else if (notation == EJsonNotation::ArrayStart && identifier == "members")
+		{
+			if (!ReadMembers(scratchMembers))
+			{
+				return false;
+			}
+			hasMembers = true;
+		}
+		else if (!SkipValue(notation))
+		{
+			return ReportError(TEXT("Malformed OSM element!"));
+		}
+	}
+
+	if (notation != EJsonNotation::ObjectEnd)
+	{
+		return ReportError(TEXT("Unexpected end of OSM element!"));
+	}
+
+	if (elementType.IsEmpty())
+	{
+		return true;
+	}
+
+	if (elementType == "node")
+	{
+		if (!hasId || !hasLat || !hasLon)
+		{
+			UE_LOG(LogTemp, Error, TEXT("Node is missing id, lat or lon field in JSON!"));
+			return false;
+		}
+
+		FOsmNode node;
+		node.id = id;
+		node.lat = lat;
+		node.lon = lon;
+		if (!scratchTags.IsEmpty() && sink.WantsNodeTags(scratchTags.View()))
+		{
+			node.tags = scratchTags.Build();
+		}
+		nodeNum++;
+		return sink.AddNode(MoveTemp(node));
+	}
+	else if (elementType == "way")
+	{
+		if (!hasId)
+		{
+			UE_LOG(LogTemp, Error, TEXT("Way ID field not found in JSON!"));
+			return false;
+		}
+		if (!hasNodes)
+		{
+			UE_LOG(LogTemp, Warning, TEXT("Way with no nodes ignored!"));
+		}
+
+		if (!sink.WantsWay(scratchTags.View()))
+		{
+			return true;
+		}
+		wayNum++;
+
+		FOsmWay way;
+		way.id = id;
+		way.nodeIds = MoveTemp(scratchNodeIds);
+		way.tags = scratchTags.Build();
+		scratchNodeIds.Reset();
+		return sink.AddWay(MoveTemp(way));
+	}
+	else if (elementType == "relation" || elementType == "rel")
+	{
+		if (!hasId)
+		{
+			UE_LOG(LogTemp, Error, TEXT("Relation ID field not found in JSON!"));
+			return false;
+		}
+		if (!hasMembers)
+		{
+			UE_LOG(LogTemp, Warning, TEXT("Relation with no members ignored!"));
+		}
+
+		if (!sink.WantsRelation(scratchTags.View()))
+		{
+			return true;
+		}
+		relationNum++;
+
+		FOsmRelation relation;
+		relation.id = id;
+		relation.members = MoveTemp(scratchMembers);
+		relation.tags = scratchTags.Build();
+		scratchMembers.Reset();
+		return sink.AddRelation(MoveTemp(relation));
+	}
+
+	UE_LOG(LogTemp, Warning, TEXT("Unknown OSM element type %s!"), *elementType);
+	return true;
+}
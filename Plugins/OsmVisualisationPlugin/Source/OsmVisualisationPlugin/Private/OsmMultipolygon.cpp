@@ -0,0 +1,138 @@
+#include "OsmMultipolygon.h"
+
+bool FOsmMultipolygonAssembler::IsMultipolygon(const FOsmRelation& relation)
+{
+	// Ids never change within a process, looked up once instead of for every relation
+	FOsmTagDictionary& dictionary = FOsmTagDictionary::Get();
+	static const int32 typeKey = dictionary.Intern(TEXT("type"));
+	static const int32 multipolygonValue = dictionary.Intern(TEXT("multipolygon"));
+	static const int32 boundaryValue = dictionary.Intern(TEXT("boundary"));
+
+	int32 type = relation.tags.Find(typeKey);
+	return type == multipolygonValue || type == boundaryValue;
+}
+
+bool FOsmMultipolygonAssembler::Assemble(const FOsmRelation& relation, const TMap<int64, FOsmWay>& ways, FOsmMultipolygon& outMultipolygon, int32& outUnclosedNum)
+{
+	TArray<const FOsmWay*> outerWays;
+	TArray<const FOsmWay*> innerWays;
+	for (const FOsmRelationMember& member : relation.members)
+	{
+		if (member.type != OsmRelationMemberType::RMT_Way)
+		{
+			continue;
+		}
+
+		const FOsmWay* way = ways.Find(member.ref);
+		if (!way)
+		{
+			continue;
+		}
+
+		if (member.role.IsEmpty() || member.role == TEXT("outer"))
+		{
+			outerWays.Add(way);
+		}
+		else if (member.role == TEXT("inner"))
+		{
+			innerWays.Add(way);
+		}
+	}
+
+	outMultipolygon.relationId = relation.id;
+	outMultipolygon.outerRings.Reset();
+	outMultipolygon.innerRings.Reset();
+	outUnclosedNum = AssembleRings(outerWays, outMultipolygon.outerRings);
+	outUnclosedNum += AssembleRings(innerWays, outMultipolygon.innerRings);
+
+	return outMultipolygon.IsValid();
+}
+
+int32 FOsmMultipolygonAssembler::AssembleRings(const TArray<const FOsmWay*>& ringWays, TArray<FOsmRing>& outRings)
+{
+	TArray<const FOsmWay*> segments;
+	segments.Reserve(ringWays.Num());
+	for (const FOsmWay* way : ringWays)
+	{
+		if (way->nodeIds.Num() >= 2 && way->IsResolved())
+		{
+			segments.Add(way);
+		}
+	}
+
+	TMap<int64, TArray<int32, TInlineAllocator<2>>> segmentsByEndpoint;
+	segmentsByEndpoint.Reserve(segments.Num() * 2);
+	for (int32 i = 0; i < segments.Num(); i++)
+	{
+		const FOsmWay& segment = *segments[i];
+		if (segment.nodeIds[0] == segment.nodeIds.Last())
+		{
+			continue;
+		}
+		segmentsByEndpoint.FindOrAdd(segment.nodeIds[0]).Add(i);
+		segmentsByEndpoint.FindOrAdd(segment.nodeIds.Last()).Add(i);
+	}
+
+	TBitArray<> used(false, segments.Num());
+	int32 unclosedNum = 0;
+
+	for (int32 first = 0; first < segments.Num(); first++)
+	{
+		if (used[first])
+		{
+			continue;
+		}
+		used[first] = true;
+
+		FOsmRing ring;
+		ring.nodeIndices = segments[first]->nodeIndices;
+		int64 startId = segments[first]->nodeIds[0];
+		int64 endId = segments[first]->nodeIds.Last();
+
+		while (endId != startId)
+		{
+			const auto* candidates = segmentsByEndpoint.Find(endId);
+			int32 next = INDEX_NONE;
+			if (candidates)
+			{
+				for (int32 candidate : *candidates)
+				{
+					if (!used[candidate])
+					{
+						next = candidate;
+						break;
+					}
+				}
+			}
+			if (next == INDEX_NONE)
+			{
+				break;
+			}
+			used[next] = true;
+
+			const FOsmWay& segment = *segments[next];
+			if (segment.nodeIds[0] == endId)
+			{
+				ring.nodeIndices.Append(segment.nodeIndices.GetData() + 1, segment.nodeIndices.Num() - 1);
+				endId = segment.nodeIds.Last();
+			}
+			else
+			{
+				for (int32 i = segment.nodeIndices.Num() - 2; i >= 0; i--)
+				{
+					ring.nodeIndices.Add(segment.nodeIndices[i]);
+				}
+				endId = segment.nodeIds[0];
+			}
+		}
+
+		if (endId != startId || ring.nodeIndices.Num() < 4 || ring.nodeIndices.Contains(INDEX_NONE))
+		{
+			unclosedNum++;
+			continue;
+		}
+		outRings.Add(MoveTemp(ring));
+	}
+
+	return unclosedNum;
+}
@@ -0,0 +1,93 @@
+#include "OsmNodeStore.h"
+#include "Algo/Sort.h"
+
+void FOsmNodeStore::Finalize()
+{
+	if (IsFinalized())
+	{
+		return;
+	}
+
+	// A re-added id keeps its slot, so the tail holds every id once
+	TArray<int32> tail;
+	tail.Reserve(tailSlots.Num());
+	for (const auto& tailPair : tailSlots)
+	{
+		tail.Add(tailPair.Value);
+	}
+	Algo::Sort(tail, [this](int32 a, int32 b)
+		{
+			return ids[a] < ids[b];
+		});
+
+	// Merged in place from the back, the write position never passes the unread part of the sorted slots
+	int32 sortedIndex = sortedSlots.Num() - 1;
+	int32 tailIndex = tail.Num() - 1;
+	sortedSlots.SetNumUninitialized(sortedSlots.Num() + tail.Num(), false);
+	for (int32 write = sortedSlots.Num() - 1; tailIndex >= 0; write--)
+	{
+		if (sortedIndex < 0 || ids[tail[tailIndex]] > ids[sortedSlots[sortedIndex]])
+		{
+			sortedSlots[write] = tail[tailIndex--];
+		}
+		else
+		{
+			sortedSlots[write] = sortedSlots[sortedIndex--];
+		}
+	}
+
+	tailSlots.Empty();
+}
+
+void FOsmNodeStore::SortSlots()
+{
+	sortedSlots.SetNumUninitialized(ids.Num());
+	for (int32 slot = 0; slot < ids.Num(); slot++)
+	{
+		sortedSlots[slot] = slot;
+	}
+	Algo::Sort(sortedSlots, [this](int32 a, int32 b)
+		{
+			return ids[a] < ids[b];
+		});
+	tailSlots.Empty();
+}
+
+bool FOsmNodeStore::Serialize(FArchive& ar)
+{
+	if (ar.IsSaving())
+	{
+		Finalize();
+	}
+
+	// Slots are saved as they are, indices into the store stay valid through a save and load
+	ids.BulkSerialize(ar);
+	lats.BulkSerialize(ar);
+	lons.BulkSerialize(ar);
+
+	int32 taggedNum = tags.Num();
+	ar << taggedNum;
+	if (ar.IsLoading())
+	{
+		tags.Empty(taggedNum);
+		for (int32 i = 0; i < taggedNum && !ar.IsError(); i++)
+		{
+			int64 id;
+			FOsmTagList nodeTags;
+			ar << id;
+			nodeTags.Serialize(ar);
+			tags.Add(id, MoveTemp(nodeTags));
+		}
+		SortSlots();
+	}
+	else
+	{
+		for (auto& tagPair : tags)
+		{
+			ar << tagPair.Key;
+			tagPair.Value.Serialize(ar);
+		}
+	}
+
+	return true;
+}
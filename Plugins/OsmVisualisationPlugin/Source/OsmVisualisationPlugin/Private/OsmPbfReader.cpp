@@ -0,0 +1,836 @@
+#include "OsmPbfReader.h"
+#include "Async/ParallelFor.h"
+#include "Async/TaskGraphInterfaces.h"
+#include "Misc/Compression.h"
+#include "HAL/FileManager.h"
+#include <atomic>
+
+/// <summary>
+/// Minimal protobuf wire format decoder, only what the OSM PBF messages need.
+/// </summary>
+class FOsmProtobufReader
+{
+private:
+	const uint8* cursor;
+	const uint8* end;
+	bool error = false;
+
+public:
+	enum EWireType : uint32
+	{
+		WT_Varint = 0,
+		WT_Fixed64 = 1,
+		WT_LengthDelimited = 2,
+		WT_Fixed32 = 5
+	};
+
+	FOsmProtobufReader(TArrayView<const uint8> data)
+		: cursor(data.GetData())
+		, end(data.GetData() + data.Num())
+	{
+
+	}
+
+	bool HasData() const
+	{
+		return !error && cursor < end;
+	}
+
+	bool IsError() const
+	{
+		return error;
+	}
+
+	uint64 ReadVarint()
+	{
+		uint64 result = 0;
+		for (int shift = 0; shift < 64; shift += 7)
+		{
+			if (cursor >= end)
+			{
+				error = true;
+				return 0;
+			}
+			uint8 byte = *cursor++;
+			result |= (uint64)(byte & 0x7F) << shift;
+			if ((byte & 0x80) == 0)
+			{
+				return result;
+			}
+		}
+		error = true;
+		return 0;
+	}
+
+	int64 ReadSignedVarint()
+	{
+		uint64 value = ReadVarint();
+		return (int64)(value >> 1) ^ -(int64)(value & 1);
+	}
+
+	bool ReadField(uint32& outField, uint32& outWireType)
+	{
+		uint64 key = ReadVarint();
+		outField = (uint32)(key >> 3);
+		outWireType = (uint32)(key & 0x7);
+		return !error;
+	}
+
+	TArrayView<const uint8> ReadBytes()
+	{
+		uint64 length = ReadVarint();
+		if (error || length > (uint64)(end - cursor))
+		{
+			error = true;
+			return TArrayView<const uint8>();
+		}
+		TArrayView<const uint8> view(cursor, (int32)length);
+		cursor += length;
+		return view;
+	}
+
+	void Skip(uint32 wireType)
+	{
+		switch (wireType)
+		{
+		case WT_Varint:
+			ReadVarint();
+			break;
+		case WT_Fixed64:
+			cursor += 8;
+			break;
+		case WT_LengthDelimited:
+			ReadBytes();
+			break;
+		case WT_Fixed32:
+			cursor += 4;
+			break;
+		default:
+			error = true;
+			break;
+		}
+
+		if (cursor > end)
+		{
+			error = true;
+		}
+	}
+
+	/// <summary>
+	/// Reads a repeated varint field that may be either packed or written element by element.
+	/// </summary>
+	template<typename Func>
+	void ReadRepeatedVarint(uint32 wireType, Func&& func)
+	{
+		if (wireType == WT_Varint)
+		{
+			func(ReadVarint());
+			return;
+		}
+		if (wireType != WT_LengthDelimited)
+		{
+			error = true;
+			return;
+		}
+
+		FOsmProtobufReader packed(ReadBytes());
+		while (packed.HasData())
+		{
+			func(packed.ReadVarint());
+		}
+		error |= packed.IsError();
+	}
+};
+
+namespace OsmPbf
+{
+	// Limits from the PBF format specification
+	static constexpr int32 MaxBlobHeaderSize = 64 * 1024;
+	static constexpr int64 MaxBlobSize = 32 * 1024 * 1024;
+
+	static int64 ZigZagDecode(uint64 value)
+	{
+		return (int64)(value >> 1) ^ -(int64)(value & 1);
+	}
+
+	static FString DecodeUtf8(TArrayView<const uint8> bytes)
+	{
+		FUTF8ToTCHAR converted((const ANSICHAR*)bytes.GetData(), bytes.Num());
+		return FString(converted.Length(), converted.Get());
+	}
+
+	struct FBlockContext
+	{
+		TArray<FString> strings;
+		// String table entries interned into FOsmTagDictionary, tags are added by id
+		TArray<int32> stringIds;
+		int64 granularity = 100;
+		int64 latOffset = 0;
+		int64 lonOffset = 0;
+
+		double DecodeLat(int64 value) const
+		{
+			return 1e-9 * (latOffset + granularity * value);
+		}
+
+		double DecodeLon(int64 value) const
+		{
+			return 1e-9 * (lonOffset + granularity * value);
+		}
+
+		// Collects the tags of the element being decoded, reused for every element of the block
+		mutable FOsmTagListBuilder tags;
+
+		void AddTag(uint32 key, uint32 value) const
+		{
+			if (stringIds.IsValidIndex(key) && stringIds.IsValidIndex(value))
+			{
+				tags.Add(stringIds[key], stringIds[value]);
+			}
+		}
+
+		void SetTags(const TArray<uint32>& keys, const TArray<uint32>& values) const
+		{
+			int32 tagNum = FMath::Min(keys.Num(), values.Num());
+			tags.Reset();
+			tags.Reserve(tagNum);
+			for (int32 i = 0; i < tagNum; i++)
+			{
+				AddTag(keys[i], values[i]);
+			}
+		}
+	};
+
+	static bool DecodeNode(TArrayView<const uint8> data, const FBlockContext& context, FOsmDataBatch& outBatch)
+	{
+		FOsmProtobufReader reader(data);
+		FOsmNode node;
+		int64 lat = 0;
+		int64 lon = 0;
+		TArray<uint32> keys;
+		TArray<uint32> values;
+
+		uint32 field, wireType;
+		while (reader.HasData() && reader.ReadField(field, wireType))
+		{
+			switch (field)
+			{
+			case 1:
+				node.id = reader.ReadSignedVarint();
+				break;
+			case 2:
+				reader.ReadRepeatedVarint(wireType, [&keys](uint64 value) { keys.Add((uint32)value); });
+				break;
+			case 3:
+				reader.ReadRepeatedVarint(wireType, [&values](uint64 value) { values.Add((uint32)value); });
+				break;
+			case 8:
+				lat = reader.ReadSignedVarint();
+				break;
+			case 9:
+				lon = reader.ReadSignedVarint();
+				break;
+			default:
+				reader.Skip(wireType);
+				break;
+			}
+		}
+
+		if (reader.IsError())
+		{
+			return false;
+		}
+
+		node.lat = context.DecodeLat(lat);
+		node.lon = context.DecodeLon(lon);
+		context.SetTags(keys, values);
+		if (!context.tags.IsEmpty() && outBatch.WantsNodeTags(context.tags.View()))
+		{
+			node.tags = context.tags.Build();
+		}
+		outBatch.AddNode(MoveTemp(node));
+		return true;
+	}
+
+	static bool DecodeDenseNodes(TArrayView<const uint8> data, const FBlockContext& context, FOsmDataBatch& outBatch)
+	{
+		FOsmProtobufReader reader(data);
+		TArray<int64> ids;
+		TArray<int64> lats;
+		TArray<int64> lons;
+		TArray<uint32> keysVals;
+
+		uint32 field, wireType;
+		while (reader.HasData() && reader.ReadField(field, wireType))
+		{
+			switch (field)
+			{
+			case 1:
+				reader.ReadRepeatedVarint(wireType, [&ids](uint64 value) { ids.Add(ZigZagDecode(value)); });
+				break;
+			case 8:
+				reader.ReadRepeatedVarint(wireType, [&lats](uint64 value) { lats.Add(ZigZagDecode(value)); });
+				break;
+			case 9:
+				reader.ReadRepeatedVarint(wireType, [&lons](uint64 value) { lons.Add(ZigZagDecode(value)); });
+				break;
+			case 10:
+				reader.ReadRepeatedVarint(wireType, [&keysVals](uint64 value) { keysVals.Add((uint32)value); });
+				break;
+			default:
+				reader.Skip(wireType);
+				break;
+			}
+		}
+
+		if (reader.IsError() || ids.Num() != lats.Num() || ids.Num() != lons.Num())
+		{
+			UE_LOG(LogTemp, Error, TEXT("Malformed PBF dense nodes!"));
+			return false;
+		}
+
+		outBatch.nodes.Reserve(outBatch.nodes.Num() + ids.Num());
+
+		int64 id = 0;
+		int64 lat = 0;
+		int64 lon = 0;
+		int32 keysValsPos = 0;
+		for (int32 i = 0; i < ids.Num(); i++)
+		{
+			id += ids[i];
+			lat += lats[i];
+			lon += lons[i];
+
+			FOsmNode node;
+			node.id = id;
+			node.lat = context.DecodeLat(lat);
+			node.lon = context.DecodeLon(lon);
+
+			// keys_vals holds (key, value)* 0 for every node, or is empty when no node has tags
+			context.tags.Reset();
+			while (keysValsPos < keysVals.Num() && keysVals[keysValsPos] != 0)
+			{
+				if (keysValsPos + 1 >= keysVals.Num())
+				{
+					return false;
+				}
+				context.AddTag(keysVals[keysValsPos], keysVals[keysValsPos + 1]);
+				keysValsPos += 2;
+			}
+			keysValsPos++;
+
+			if (!context.tags.IsEmpty() && outBatch.WantsNodeTags(context.tags.View()))
+			{
+				node.tags = context.tags.Build();
+			}
+			outBatch.AddNode(MoveTemp(node));
+		}
+
+		return true;
+	}
+
+	static bool DecodeWay(TArrayView<const uint8> data, const FBlockContext& context, FOsmDataBatch& outBatch)
+	{
+		FOsmProtobufReader reader(data);
+		FOsmWay way;
+		TArray<uint32> keys;
+		TArray<uint32> values;
+
+		uint32 field, wireType;
+		while (reader.HasData() && reader.ReadField(field, wireType))
+		{
+			switch (field)
+			{
+			case 1:
+				way.id = (int64)reader.ReadVarint();
+				break;
+			case 2:
+				reader.ReadRepeatedVarint(wireType, [&keys](uint64 value) { keys.Add((uint32)value); });
+				break;
+			case 3:
+				reader.ReadRepeatedVarint(wireType, [&values](uint64 value) { values.Add((uint32)value); });
+				break;
+			case 8:
+			{
+				int64 ref = 0;
+				reader.ReadRepeatedVarint(wireType, [&way, &ref](uint64 value)
+					{
+						ref += ZigZagDecode(value);
+						way.nodeIds.Add(ref);
+					});
+				break;
+			}
+			default:
+				reader.Skip(wireType);
+				break;
+			}
+		}
+
+		if (reader.IsError())
+		{
+			UE_LOG(LogTemp, Error, TEXT("Malformed PBF way!"));
+			return false;
+		}
+
+		context.SetTags(keys, values);
+		if (outBatch.WantsWay(context.tags.View()))
+		{
+			way.tags = context.tags.Build();
+			outBatch.AddWay(MoveTemp(way));
+		}
+		return true;
+	}
+
+	static bool DecodeRelation(TArrayView<const uint8> data, const FBlockContext& context, FOsmDataBatch& outBatch)
+	{
+		FOsmProtobufReader reader(data);
+		FOsmRelation relation;
+		TArray<uint32> keys;
+		TArray<uint32> values;
+		TArray<uint32> roles;
+		TArray<int64> memberIds;
+		TArray<uint32> memberTypes;
+
+		uint32 field, wireType;
+		while (reader.HasData() && reader.ReadField(field, wireType))
+		{
+			switch (field)
+			{
+			case 1:
+				relation.id = (int64)reader.ReadVarint();
+				break;
+			case 2:
+				reader.ReadRepeatedVarint(wireType, [&keys](uint64 value) { keys.Add((uint32)value); });
+				break;
+			case 3:
+				reader.ReadRepeatedVarint(wireType, [&values](uint64 value) { values.Add((uint32)value); });
+				break;
+			case 8:
+				reader.ReadRepeatedVarint(wireType, [&roles](uint64 value) { roles.Add((uint32)value); });
+				break;
+			case 9:
+			{
+				int64 memberId = 0;
+				reader.ReadRepeatedVarint(wireType, [&memberIds, &memberId](uint64 value)
+					{
+						memberId += ZigZagDecode(value);
+						memberIds.Add(memberId);
+					});
+				break;
+			}
+			case 10:
+				reader.ReadRepeatedVarint(wireType, [&memberTypes](uint64 value) { memberTypes.Add((uint32)value); });
+				break;
+			default:
+				reader.Skip(wireType);
+				break;
+			}
+		}
+
+		if (reader.IsError() || memberIds.Num() != memberTypes.Num() || memberIds.Num() != roles.Num())
+		{
+			UE_LOG(LogTemp, Error, TEXT("Malformed PBF relation!"));
+			return false;
+		}
+
+		relation.members.Reserve(memberIds.Num());
+		for (int32 i = 0; i < memberIds.Num(); i++)
+		{
+			FOsmRelationMember member;
+			member.ref = memberIds[i];
+			switch (memberTypes[i])
+			{
+			case 0:
+				member.type = OsmRelationMemberType::RMT_Node;
+				break;
+			case 1:
+				member.type = OsmRelationMemberType::RMT_Way;
+				break;
+			case 2:
+				member.type = OsmRelationMemberType::RMT_Relation;
+				break;
+			default:
+				UE_LOG(LogTemp, Error, TEXT("Unknown PBF relation member type %u!"), memberTypes[i]);
+				return false;
+			}
+			if (context.strings.IsValidIndex(roles[i]))
+			{
+				member.role = context.strings[roles[i]];
+			}
+			relation.members.Add(MoveTemp(member));
+		}
+
+		context.SetTags(keys, values);
+		if (outBatch.WantsRelation(context.tags.View()))
+		{
+			relation.tags = context.tags.Build();
+			outBatch.AddRelation(MoveTemp(relation));
+		}
+		return true;
+	}
+
+	static bool DecodePrimitiveGroup(TArrayView<const uint8> data, const FBlockContext& context, FOsmDataBatch& outBatch)
+	{
+		FOsmProtobufReader reader(data);
+
+		uint32 field, wireType;
+		while (reader.HasData() && reader.ReadField(field, wireType))
+		{
+			bool success = true;
+			switch (field)
+			{
+			case 1:
+				success = DecodeNode(reader.ReadBytes(), context, outBatch);
+				break;
+			case 2:
+				success = DecodeDenseNodes(reader.ReadBytes(), context, outBatch);
+				break;
+			case 3:
+				success = DecodeWay(reader.ReadBytes(), context, outBatch);
+				break;
+			case 4:
+				success = DecodeRelation(reader.ReadBytes(), context, outBatch);
+				break;
+			default:
+				reader.Skip(wireType);
+				break;
+			}
+
+			if (!success)
+			{
+				return false;
+			}
+		}
+
+		return !reader.IsError();
+	}
+}
+
+FOsmPbfReader::FOsmPbfReader(FArchive* archive, int32 blobsPerWave)
+	: archive(archive)
+	, blobsPerWave(blobsPerWave)
+{
+	check(archive);
+
+	if (this->blobsPerWave <= 0)
+	{
+		this->blobsPerWave = FMath::Max(1, FTaskGraphInterface::Get().GetNumWorkerThreads()) * 4;
+	}
+}
+
+bool FOsmPbfReader::ReadFile(const FString& pbfFilePath, IOsmElementSink& sink)
+{
+	TUniquePtr<FArchive> fileReader(IFileManager::Get().CreateFileReader(*pbfFilePath));
+	if (!fileReader)
+	{
+		UE_LOG(LogTemp, Error, TEXT("Failed to open PBF file %s"), *pbfFilePath);
+		return false;
+	}
+
+	FOsmPbfReader reader(fileReader.Get());
+	return reader.Read(sink);
+}
+
+bool FOsmPbfReader::ReadBlob(FString& outType, TArray<uint8>& outBlob)
+{
+	uint8 headerSizeBytes[4];
+	archive->Serialize(headerSizeBytes, 4);
+	int32 headerSize = (headerSizeBytes[0] << 24) | (headerSizeBytes[1] << 16) | (headerSizeBytes[2] << 8) | headerSizeBytes[3];
+	if (archive->IsError() || headerSize <= 0 || headerSize > OsmPbf::MaxBlobHeaderSize)
+	{
+		UE_LOG(LogTemp, Error, TEXT("Invalid PBF blob header size %d!"), headerSize);
+		return false;
+	}
+
+	TArray<uint8> header;
+	header.SetNumUninitialized(headerSize);
+	archive->Serialize(header.GetData(), headerSize);
+
+	int64 dataSize = -1;
+	FOsmProtobufReader reader(header);
+	uint32 field, wireType;
+	while (reader.HasData() && reader.ReadField(field, wireType))
+	{
+		if (field == 1 && wireType == FOsmProtobufReader::WT_LengthDelimited)
+		{
+			outType = OsmPbf::DecodeUtf8(reader.ReadBytes());
+		}
+		else if (field == 3 && wireType == FOsmProtobufReader::WT_Varint)
+		{
+			uint64 size = reader.ReadVarint();
+			dataSize = size <= (uint64)OsmPbf::MaxBlobSize ? (int64)size : -1;
+		}
+		else
+		{
+			reader.Skip(wireType);
+		}
+	}
+
+	if (archive->IsError() || reader.IsError() || dataSize < 0)
+	{
+		UE_LOG(LogTemp, Error, TEXT("Malformed PBF blob header, or a blob larger than %lld bytes!"), OsmPbf::MaxBlobSize);
+		return false;
+	}
+
+	outBlob.SetNumUninitialized((int32)dataSize);
+	archive->Serialize(outBlob.GetData(), dataSize);
+	return !archive->IsError();
+}
+
+bool FOsmPbfReader::DecompressBlob(const TArray<uint8>& blob, TArray<uint8>& outData)
+{
+	TArrayView<const uint8> raw;
+	TArrayView<const uint8> zlibData;
+	// Unsigned until checked, a hostile varint would turn negative as int64
+	uint64 rawSize = 0;
+	bool hasRawSize = false;
+	bool unsupportedCompression = false;
+
+	FOsmProtobufReader reader(blob);
+	uint32 field, wireType;
+	while (reader.HasData() && reader.ReadField(field, wireType))
+	{
+		switch (field)
+		{
+		case 1:
+			raw = reader.ReadBytes();
+			break;
+		case 2:
+			rawSize = reader.ReadVarint();
+			hasRawSize = true;
+			break;
+		case 3:
+			zlibData = reader.ReadBytes();
+			break;
+		case 4:
+		case 5:
+		case 6:
+		case 7:
+			unsupportedCompression = true;
+			reader.Skip(wireType);
+			break;
+		default:
+			reader.Skip(wireType);
+			break;
+		}
+	}
+
+	if (reader.IsError())
+	{
+		UE_LOG(LogTemp, Error, TEXT("Malformed PBF blob!"));
+		return false;
+	}
+
+	if (raw.Num() > 0)
+	{
+		outData = TArray<uint8>(raw.GetData(), raw.Num());
+		return true;
+	}
+
+	if (zlibData.Num() > 0 && hasRawSize)
+	{
+		if (rawSize > (uint64)OsmPbf::MaxBlobSize)
+		{
+			UE_LOG(LogTemp, Error, TEXT("PBF blob decompresses to %llu bytes, more than the %lld allowed!"), rawSize, OsmPbf::MaxBlobSize);
+			return false;
+		}
+		outData.SetNumUninitialized((int32)rawSize);
+		return FCompression::UncompressMemory(NAME_Zlib, outData.GetData(), (int32)rawSize, zlibData.GetData(), zlibData.Num());
+	}
+
+	if (unsupportedCompression)
+	{
+		UE_LOG(LogTemp, Error, TEXT("PBF blob uses an unsupported compression, only raw and zlib are supported!"));
+	}
+	return false;
+}
+
+bool FOsmPbfReader::CheckHeaderBlock(const TArray<uint8>& blob)
+{
+	TArray<uint8> data;
+	if (!DecompressBlob(blob, data))
+	{
+		return false;
+	}
+
+	FOsmProtobufReader reader(data);
+	uint32 field, wireType;
+	while (reader.HasData() && reader.ReadField(field, wireType))
+	{
+		if (field == 4 && wireType == FOsmProtobufReader::WT_LengthDelimited)
+		{
+			FString feature = OsmPbf::DecodeUtf8(reader.ReadBytes());
+			if (feature != "OsmSchema-V0.6" && feature != "DenseNodes")
+			{
+				UE_LOG(LogTemp, Error, TEXT("Unsupported PBF required feature %s!"), *feature);
+				return false;
+			}
+		}
+		else
+		{
+			reader.Skip(wireType);
+		}
+	}
+
+	return !reader.IsError();
+}
+
+bool FOsmPbfReader::DecodePrimitiveBlock(const TArray<uint8>& blockData, FOsmDataBatch& outBatch)
+{
+	OsmPbf::FBlockContext context;
+	TArray<TArrayView<const uint8>> groups;
+
+	// Granularity and offsets are written after the groups, so the block is scanned once before decoding
+	FOsmProtobufReader reader(blockData);
+	uint32 field, wireType;
+	while (reader.HasData() && reader.ReadField(field, wireType))
+	{
+		switch (field)
+		{
+		case 1:
+		{
+			FOsmProtobufReader stringTableReader(reader.ReadBytes());
+			uint32 stringField, stringWireType;
+			while (stringTableReader.HasData() && stringTableReader.ReadField(stringField, stringWireType))
+			{
+				if (stringField == 1 && stringWireType == FOsmProtobufReader::WT_LengthDelimited)
+				{
+					context.strings.Add(OsmPbf::DecodeUtf8(stringTableReader.ReadBytes()));
+				}
+				else
+				{
+					stringTableReader.Skip(stringWireType);
+				}
+			}
+			if (stringTableReader.IsError())
+			{
+				return false;
+			}
+			break;
+		}
+		case 2:
+			groups.Add(reader.ReadBytes());
+			break;
+		case 17:
+			context.granularity = (int64)reader.ReadVarint();
+			break;
+		case 19:
+			context.latOffset = (int64)reader.ReadVarint();
+			break;
+		case 20:
+			context.lonOffset = (int64)reader.ReadVarint();
+			break;
+		default:
+			reader.Skip(wireType);
+			break;
+		}
+	}
+
+	if (reader.IsError())
+	{
+		UE_LOG(LogTemp, Error, TEXT("Malformed PBF primitive block!"));
+		return false;
+	}
+
+	FOsmTagDictionary& dictionary = FOsmTagDictionary::Get();
+	context.stringIds.Reserve(context.strings.Num());
+	for (const FString& str : context.strings)
+	{
+		context.stringIds.Add(dictionary.Intern(str));
+	}
+
+	for (const TArrayView<const uint8>& group : groups)
+	{
+		if (!OsmPbf::DecodePrimitiveGroup(group, context, outBatch))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool FOsmPbfReader::Read(IOsmElementSink& sink)
+{
+	nodeNum = 0;
+	wayNum = 0;
+	relationNum = 0;
+
+	bool headerFound = false;
+	TArray<TArray<uint8>> blobs;
+	TArray<FOsmDataBatch> batches;
+
+	while (!archive->AtEnd())
+	{
+		blobs.Reset();
+		while (blobs.Num() < blobsPerWave && !archive->AtEnd())
+		{
+			FString type;
+			TArray<uint8> blob;
+			if (!ReadBlob(type, blob))
+			{
+				return false;
+			}
+
+			if (type == "OSMHeader")
+			{
+				if (!CheckHeaderBlock(blob))
+				{
+					return false;
+				}
+				headerFound = true;
+			}
+			else if (type == "OSMData")
+			{
+				if (!headerFound)
+				{
+					UE_LOG(LogTemp, Error, TEXT("PBF data blob found before the header!"));
+					return false;
+				}
+				blobs.Add(MoveTemp(blob));
+			}
+			else
+			{
+				UE_LOG(LogTemp, Warning, TEXT("Unknown PBF blob type %s skipped."), *type);
+			}
+		}
+
+		batches.Reset();
+		batches.SetNum(blobs.Num());
+		for (FOsmDataBatch& batch : batches)
+		{
+			batch.consumer = &sink;
+		}
+		std::atomic<bool> failed(false);
+
+		ParallelFor(blobs.Num(), [&blobs, &batches, &failed](int32 index)
+			{
+				TArray<uint8> blockData;
+				if (!DecompressBlob(blobs[index], blockData) || !DecodePrimitiveBlock(blockData, batches[index]))
+				{
+					failed = true;
+				}
+			});
+
+		if (failed)
+		{
+			UE_LOG(LogTemp, Error, TEXT("Failed to decode PBF primitive block!"));
+			return false;
+		}
+
+		for (FOsmDataBatch& batch : batches)
+		{
+			nodeNum += batch.nodes.Num();
+			wayNum += batch.ways.Num();
+			relationNum += batch.relations.Num();
+			if (!batch.Drain(sink))
+			{
+				return false;
+			}
+		}
+	}
+
+	UE_LOG(LogTemp, Display, TEXT("Loaded OSM elements: %d nodes, %d ways, %d relations."), nodeNum, wayNum, relationNum);
+
+	return true;
+}
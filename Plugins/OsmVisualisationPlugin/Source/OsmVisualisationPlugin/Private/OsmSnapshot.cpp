@@ -0,0 +1,638 @@
+#include "OsmSnapshot.h"
+#include "HAL/FileManager.h"
+#include "HAL/PlatformFileManager.h"
+#include "Async/MappedFileHandle.h"
+#include "Misc/Crc.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "Serialization/BufferReader.h"
+#include "Misc/Guid.h"
+
+namespace OsmSnapshot
+{
+	// Bytes hashed from each end of the source for the key
+	static constexpr int64 SampleSize = 64 * 1024;
+	static constexpr int32 FlushSize = 1024 * 1024;
+
+	/// <summary>
+	/// Writes the current magic and version, or checks them when loading. The key and source path are
+	/// only read when they match, so a file of another format is never decoded any further.
+	/// </summary>
+	static bool SerializeHeader(FArchive& ar, FOsmSnapshotKey& key, FString& sourcePath)
+	{
+		uint32 magic = FOsmSnapshot::Magic;
+		uint32 version = FOsmSnapshot::Version;
+		ar << magic;
+		ar << version;
+		if (ar.IsError() || magic != FOsmSnapshot::Magic || version != FOsmSnapshot::Version)
+		{
+			return false;
+		}
+
+		ar << key;
+		ar << sourcePath;
+		return !ar.IsError();
+	}
+
+	/// <summary>
+	/// Fixed size end of a snapshot, the checksum covers the records and the string table.
+	/// </summary>
+	struct FTrailer
+	{
+		static constexpr int64 Size = 24;
+
+		int64 recordNum = 0;
+		uint32 checksum = 0;
+		int64 stringTableOffset = 0;
+		uint32 magic = FOsmSnapshot::Magic;
+
+		void Serialize(FArchive& ar)
+		{
+			ar << recordNum;
+			ar << checksum;
+			ar << stringTableOffset;
+			ar << magic;
+		}
+	};
+
+	static uint32 Checksum(const uint8* data, int64 size, uint32 crc)
+	{
+		// MemCrc32 takes an int32 length, larger ranges are fed in blocks
+		while (size > 0)
+		{
+			int32 blockSize = (int32)FMath::Min<int64>(size, MAX_int32);
+			crc = FCrc::MemCrc32(data, blockSize, crc);
+			data += blockSize;
+			size -= blockSize;
+		}
+		return crc;
+	}
+
+	/// <summary>
+	/// Decodes the records of a snapshot, mapping string table indices to dictionary ids.
+	/// </summary>
+	struct FRecordReader
+	{
+		FArchive& ar;
+		TArray<FString> strings;
+		TArray<int32> stringIds;
+		TArray<FOsmTag> scratchTags;
+		FOsmTagListBuilder tags;
+
+		FRecordReader(FArchive& ar)
+			: ar(ar)
+		{
+		}
+
+		bool ReadStringTable(int64 tableEnd)
+		{
+			int32 stringNum;
+			ar << stringNum;
+			if (ar.IsError() || stringNum < 0 || stringNum > tableEnd - ar.Tell())
+			{
+				return false;
+			}
+
+			// Every distinct string is interned once per snapshot instead of once per tag
+			FOsmTagDictionary& dictionary = FOsmTagDictionary::Get();
+			strings.SetNum(stringNum);
+			stringIds.SetNumUninitialized(stringNum);
+			for (int32 i = 0; i < stringNum && !ar.IsError(); i++)
+			{
+				ar << strings[i];
+				stringIds[i] = dictionary.Intern(strings[i]);
+			}
+			return !ar.IsError() && ar.Tell() == tableEnd;
+		}
+
+		bool ReadTags()
+		{
+			int32 tagNum;
+			ar << tagNum;
+			if (ar.IsError() || tagNum < 0 || tagNum * (int64)sizeof(FOsmTag) > ar.TotalSize() - ar.Tell())
+			{
+				return false;
+			}
+
+			scratchTags.SetNumUninitialized(tagNum, false);
+			ar.Serialize(scratchTags.GetData(), tagNum * sizeof(FOsmTag));
+			tags.Reset();
+			for (const FOsmTag& tag : scratchTags)
+			{
+				if (!stringIds.IsValidIndex(tag.key) || !stringIds.IsValidIndex(tag.value))
+				{
+					return false;
+				}
+				tags.Add(stringIds[tag.key], stringIds[tag.value]);
+			}
+			return !ar.IsError();
+		}
+
+		bool ReadRecords(int64 recordsEnd, IOsmElementSink& sink, int64& outRecordNum)
+		{
+			while (ar.Tell() < recordsEnd)
+			{
+				uint8 recordType;
+				ar << recordType;
+
+				switch (recordType)
+				{
+				case FOsmSnapshot::RT_Node:
+				{
+					FOsmNode node;
+					ar << node.id;
+					ar << node.lat;
+					ar << node.lon;
+					if (!ReadTags())
+					{
+						return false;
+					}
+					if (!tags.IsEmpty() && sink.WantsNodeTags(tags.View()))
+					{
+						node.tags = tags.Build();
+					}
+					if (!sink.AddNode(MoveTemp(node)))
+					{
+						return false;
+					}
+					break;
+				}
+
+				case FOsmSnapshot::RT_Way:
+				{
+					FOsmWay way;
+					ar << way.id;
+					way.nodeIds.BulkSerialize(ar);
+					if (!ReadTags())
+					{
+						return false;
+					}
+					if (sink.WantsWay(tags.View()))
+					{
+						way.tags = tags.Build();
+						if (!sink.AddWay(MoveTemp(way)))
+						{
+							return false;
+						}
+					}
+					break;
+				}
+
+				case FOsmSnapshot::RT_Relation:
+				{
+					FOsmRelation relation;
+					ar << relation.id;
+					int32 memberNum;
+					ar << memberNum;
+					if (ar.IsError() || memberNum < 0 || memberNum > recordsEnd - ar.Tell())
+					{
+						return false;
+					}
+					relation.members.SetNum(memberNum);
+					for (FOsmRelationMember& member : relation.members)
+					{
+						uint8 memberType;
+						int32 roleIndex;
+						ar << memberType;
+						ar << member.ref;
+						ar << roleIndex;
+						if (!strings.IsValidIndex(roleIndex))
+						{
+							return false;
+						}
+						member.type = (OsmRelationMemberType)memberType;
+						member.role = strings[roleIndex];
+					}
+					if (!ReadTags())
+					{
+						return false;
+					}
+					if (sink.WantsRelation(tags.View()))
+					{
+						relation.tags = tags.Build();
+						if (!sink.AddRelation(MoveTemp(relation)))
+						{
+							return false;
+						}
+					}
+					break;
+				}
+
+				default:
+					return false;
+				}
+
+				if (ar.IsError())
+				{
+					return false;
+				}
+				outRecordNum++;
+			}
+
+			return ar.Tell() == recordsEnd;
+		}
+	};
+
+	/// <summary>
+	/// Whether the snapshot is of the current version and its source is unchanged.
+	/// </summary>
+	static bool IsCurrent(const FString& snapshotPath)
+	{
+		TUniquePtr<FArchive> reader(IFileManager::Get().CreateFileReader(*snapshotPath));
+		if (!reader)
+		{
+			return false;
+		}
+
+		FOsmSnapshotKey storedKey;
+		FString sourcePath;
+		FOsmSnapshotKey currentKey;
+		return SerializeHeader(*reader, storedKey, sourcePath)
+			&& FPaths::IsSamePath(FOsmSnapshot::GetSnapshotPath(sourcePath), snapshotPath)
+			&& FOsmSnapshot::ComputeKey(sourcePath, currentKey)
+			&& currentKey == storedKey;
+	}
+}
+
+FOsmSnapshotWriter::FOsmSnapshotWriter(const FString& snapshotPath, const FOsmSnapshotKey& key, const FString& sourceFilePath, IOsmElementSink& innerSink)
+	: innerSink(innerSink)
+	, snapshotPath(snapshotPath)
+	, recordWriter(recordBuffer)
+{
+	// Unique, two loads of the same file may write their snapshot at the same time
+	tempPath = FString::Printf(TEXT("%s.%s.tmp"), *snapshotPath, *FGuid::NewGuid().ToString());
+	writer.Reset(IFileManager::Get().CreateFileWriter(*tempPath));
+	if (!writer)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("Failed to create OSM snapshot %s"), *tempPath);
+		return;
+	}
+
+	FOsmSnapshotKey keyCopy = key;
+	FString sourcePath = FPaths::ConvertRelativePathToFull(sourceFilePath);
+	OsmSnapshot::SerializeHeader(*writer, keyCopy, sourcePath);
+}
+
+FOsmSnapshotWriter::~FOsmSnapshotWriter()
+{
+	Discard();
+}
+
+int32 FOsmSnapshotWriter::GetStringIndex(int32 stringId)
+{
+	if (const int32* index = stringIndices.Find(stringId))
+	{
+		return *index;
+	}
+	int32 index = stringIds.Add(stringId);
+	stringIndices.Add(stringId, index);
+	return index;
+}
+
+void FOsmSnapshotWriter::WriteTags(const FOsmTagList& tags)
+{
+	int32 tagNum = tags.Num();
+	recordWriter << tagNum;
+
+	scratchTags.Reset();
+	for (const FOsmTag& tag : tags)
+	{
+		scratchTags.Add({ GetStringIndex(tag.key), GetStringIndex(tag.value) });
+	}
+	recordWriter.Serialize(scratchTags.GetData(), tagNum * sizeof(FOsmTag));
+}
+
+void FOsmSnapshotWriter::EndRecord()
+{
+	recordNum++;
+	if (recordBuffer.Num() >= OsmSnapshot::FlushSize)
+	{
+		FlushRecords();
+	}
+}
+
+void FOsmSnapshotWriter::FlushRecords()
+{
+	if (recordBuffer.IsEmpty())
+	{
+		return;
+	}
+
+	recordChecksum = OsmSnapshot::Checksum(recordBuffer.GetData(), recordBuffer.Num(), recordChecksum);
+	writer->Serialize(recordBuffer.GetData(), recordBuffer.Num());
+	recordBuffer.Reset();
+	recordWriter.Seek(0);
+}
+
+bool FOsmSnapshotWriter::AddNode(FOsmNode&& node)
+{
+	if (writer)
+	{
+		uint8 recordType = FOsmSnapshot::RT_Node;
+		recordWriter << recordType;
+		recordWriter << node.id;
+		recordWriter << node.lat;
+		recordWriter << node.lon;
+		WriteTags(node.tags);
+		EndRecord();
+	}
+	if (!node.tags.IsEmpty() && !innerSink.WantsNodeTags(node.tags))
+	{
+		node.tags.Reset();
+	}
+	return innerSink.AddNode(MoveTemp(node));
+}
+
+bool FOsmSnapshotWriter::AddWay(FOsmWay&& way)
+{
+	if (writer)
+	{
+		uint8 recordType = FOsmSnapshot::RT_Way;
+		recordWriter << recordType;
+		recordWriter << way.id;
+		way.nodeIds.BulkSerialize(recordWriter);
+		WriteTags(way.tags);
+		EndRecord();
+	}
+	return !innerSink.WantsWay(way.tags) || innerSink.AddWay(MoveTemp(way));
+}
+
+bool FOsmSnapshotWriter::AddRelation(FOsmRelation&& relation)
+{
+	if (writer)
+	{
+		FOsmTagDictionary& dictionary = FOsmTagDictionary::Get();
+		uint8 recordType = FOsmSnapshot::RT_Relation;
+		recordWriter << recordType;
+		recordWriter << relation.id;
+		int32 memberNum = relation.members.Num();
+		recordWriter << memberNum;
+		for (FOsmRelationMember& member : relation.members)
+		{
+			uint8 memberType = (uint8)member.type;
+			int32 roleIndex = GetStringIndex(dictionary.Intern(member.role));
+			recordWriter << memberType;
+			recordWriter << member.ref;
+			recordWriter << roleIndex;
+		}
+		WriteTags(relation.tags);
+		EndRecord();
+	}
+	return !innerSink.WantsRelation(relation.tags) || innerSink.AddRelation(MoveTemp(relation));
+}
+
+bool FOsmSnapshotWriter::Commit()
+{
+	if (!writer)
+	{
+		return false;
+	}
+
+	FlushRecords();
+
+	OsmSnapshot::FTrailer trailer;
+	trailer.stringTableOffset = writer->Tell();
+
+	FOsmTagDictionary& dictionary = FOsmTagDictionary::Get();
+	int32 stringNum = stringIds.Num();
+	recordWriter << stringNum;
+	for (int32 stringId : stringIds)
+	{
+		FString str = dictionary.GetString(stringId);
+		recordWriter << str;
+	}
+	FlushRecords();
+
+	trailer.recordNum = recordNum;
+	trailer.checksum = recordChecksum;
+	trailer.Serialize(*writer);
+
+	bool success = !writer->IsError() && writer->Close();
+	writer.Reset();
+
+	if (!success || !IFileManager::Get().Move(*snapshotPath, *tempPath, true, true))
+	{
+		UE_LOG(LogTemp, Warning, TEXT("Failed to write OSM snapshot %s"), *snapshotPath);
+		IFileManager::Get().Delete(*tempPath, false, true, true);
+		return false;
+	}
+
+	return true;
+}
+
+void FOsmSnapshotWriter::Discard()
+{
+	if (writer)
+	{
+		writer.Reset();
+		IFileManager::Get().Delete(*tempPath, false, true, true);
+	}
+}
+
+bool FOsmSnapshot::ComputeKey(const FString& sourceFilePath, FOsmSnapshotKey& outKey)
+{
+	IFileManager& fileManager = IFileManager::Get();
+	outKey.sourceSize = fileManager.FileSize(*sourceFilePath);
+	FDateTime timestamp = fileManager.GetTimeStamp(*sourceFilePath);
+	if (outKey.sourceSize < 0 || timestamp == FDateTime::MinValue())
+	{
+		return false;
+	}
+	outKey.sourceTimestamp = timestamp.GetTicks();
+
+	// A sample of both ends instead of the whole file, the key of a large extract costs two small reads
+	TUniquePtr<FArchive> reader(fileManager.CreateFileReader(*sourceFilePath));
+	if (!reader)
+	{
+		return false;
+	}
+
+	int64 headSize = FMath::Min(outKey.sourceSize, OsmSnapshot::SampleSize);
+	TArray<uint8> sample;
+	sample.SetNumUninitialized(headSize);
+	reader->Serialize(sample.GetData(), headSize);
+	uint32 hash = FCrc::MemCrc32(sample.GetData(), headSize);
+
+	int64 tailSize = FMath::Min(outKey.sourceSize - headSize, OsmSnapshot::SampleSize);
+	if (tailSize > 0)
+	{
+		reader->Seek(outKey.sourceSize - tailSize);
+		reader->Serialize(sample.GetData(), tailSize);
+		hash = FCrc::MemCrc32(sample.GetData(), tailSize, hash);
+	}
+
+	outKey.sampleHash = hash;
+	return !reader->IsError();
+}
+
+FString FOsmSnapshot::GetSnapshotDir()
+{
+	return FPaths::Combine(FPaths::ProjectSavedDir(), TEXT("OsmSnapshots"));
+}
+
+FString FOsmSnapshot::GetSnapshotPath(const FString& sourceFilePath)
+{
+	// Named after the source path, so a changed source overwrites its old snapshot instead of adding another
+	FString fullPath = FPaths::ConvertRelativePathToFull(sourceFilePath);
+	FString fileName = FString::Printf(TEXT("%s_%08x.osmsnap"), *FPaths::GetBaseFilename(fullPath), FCrc::StrCrc32(*fullPath.ToLower()));
+	return FPaths::Combine(GetSnapshotDir(), fileName);
+}
+
+bool FOsmSnapshot::MapWholeFile(const FString& filePath, TFunctionRef<bool(const uint8*, int64)> readFunc)
+{
+	IPlatformFile& platformFile = FPlatformFileManager::Get().GetPlatformFile();
+	if (!platformFile.FileExists(*filePath))
+	{
+		return false;
+	}
+
+	TUniquePtr<IMappedFileHandle> mappedFile(platformFile.OpenMapped(*filePath));
+	TUniquePtr<IMappedFileRegion> mappedRegion;
+	TArray<uint8> fallbackData;
+	const uint8* data = nullptr;
+	int64 dataSize = 0;
+
+	if (mappedFile)
+	{
+		mappedRegion.Reset(mappedFile->MapRegion(0, mappedFile->GetFileSize(), true));
+	}
+
+	if (mappedRegion)
+	{
+		data = mappedRegion->GetMappedPtr();
+		dataSize = mappedRegion->GetMappedSize();
+	}
+	else
+	{
+		// Not every platform supports mapping, fall back to a single read
+		if (!FFileHelper::LoadFileToArray(fallbackData, *filePath))
+		{
+			return false;
+		}
+		data = fallbackData.GetData();
+		dataSize = fallbackData.Num();
+	}
+
+	return readFunc(data, dataSize);
+}
+
+bool FOsmSnapshot::ReadWholeFile(const FString& filePath, TFunctionRef<bool(FArchive&)> readFunc)
+{
+	return MapWholeFile(filePath, [&readFunc](const uint8* data, int64 dataSize)
+		{
+			FBufferReader reader(const_cast<uint8*>(data), dataSize, false);
+			return readFunc(reader);
+		});
+}
+
+FOsmSnapshot::EReadResult FOsmSnapshot::Read(const FString& snapshotPath, const FOsmSnapshotKey& key, IOsmElementSink& sink)
+{
+	EReadResult result = EReadResult::Unusable;
+	MapWholeFile(snapshotPath, [&snapshotPath, &key, &sink, &result](const uint8* data, int64 dataSize)
+		{
+			FBufferReader reader(const_cast<uint8*>(data), dataSize, false);
+			FOsmSnapshotKey storedKey;
+			FString sourcePath;
+			if (!OsmSnapshot::SerializeHeader(reader, storedKey, sourcePath) || storedKey != key)
+			{
+				UE_LOG(LogTemp, Display, TEXT("OSM snapshot %s is stale, ignoring it."), *snapshotPath);
+				return false;
+			}
+
+			int64 recordsStart = reader.Tell();
+			int64 trailerStart = dataSize - OsmSnapshot::FTrailer::Size;
+			OsmSnapshot::FTrailer trailer;
+			if (trailerStart >= recordsStart)
+			{
+				reader.Seek(trailerStart);
+				trailer.Serialize(reader);
+			}
+
+			// One pass over the raw bytes, a damaged snapshot must not leave half its elements in the sink
+			if (trailerStart < recordsStart || reader.IsError() || trailer.magic != Magic
+				|| trailer.stringTableOffset < recordsStart || trailer.stringTableOffset > trailerStart
+				|| OsmSnapshot::Checksum(data + recordsStart, trailerStart - recordsStart, 0) != trailer.checksum)
+			{
+				UE_LOG(LogTemp, Warning, TEXT("OSM snapshot %s is corrupted!"), *snapshotPath);
+				return false;
+			}
+
+			OsmSnapshot::FRecordReader records(reader);
+			reader.Seek(trailer.stringTableOffset);
+			if (!records.ReadStringTable(trailerStart))
+			{
+				UE_LOG(LogTemp, Warning, TEXT("OSM snapshot %s is corrupted!"), *snapshotPath);
+				return false;
+			}
+
+			reader.Seek(recordsStart);
+			int64 recordNum = 0;
+			if (!records.ReadRecords(trailer.stringTableOffset, sink, recordNum) || recordNum != trailer.recordNum)
+			{
+				UE_LOG(LogTemp, Warning, TEXT("Reading OSM snapshot %s stopped after %lld of %lld records!"), *snapshotPath, recordNum, trailer.recordNum);
+				result = EReadResult::SinkFailed;
+				return false;
+			}
+
+			result = EReadResult::Success;
+			return true;
+		});
+	return result;
+}
+
+void FOsmSnapshot::EvictStale()
+{
+	IFileManager& fileManager = IFileManager::Get();
+	FString snapshotDir = GetSnapshotDir();
+	TArray<FString> fileNames;
+	fileManager.FindFiles(fileNames, *FPaths::Combine(snapshotDir, TEXT("*.osmsnap")), true, false);
+
+	int32 evictedNum = 0;
+	for (const FString& fileName : fileNames)
+	{
+		FString snapshotPath = FPaths::Combine(snapshotDir, fileName);
+		if (!OsmSnapshot::IsCurrent(snapshotPath) && fileManager.Delete(*snapshotPath, false, true, true))
+		{
+			evictedNum++;
+		}
+	}
+
+	if (evictedNum > 0)
+	{
+		UE_LOG(LogTemp, Display, TEXT("Evicted %d stale OSM snapshots"), evictedNum);
+	}
+}
+
+bool FOsmSnapshot::LoadCached(const FString& sourceFilePath, const FOsmSnapshotKey& key, IOsmElementSink& sink, TFunctionRef<bool(IOsmElementSink&)> parseSource)
+{
+	FString snapshotPath = GetSnapshotPath(sourceFilePath);
+	EReadResult readResult = Read(snapshotPath, key, sink);
+	if (readResult == EReadResult::Success)
+	{
+		UE_LOG(LogTemp, Display, TEXT("Loaded %s from OSM snapshot %s"), *sourceFilePath, *snapshotPath);
+		return true;
+	}
+	if (readResult == EReadResult::SinkFailed)
+	{
+		// The sink already has part of the data, parsing the source into it again would duplicate that part
+		return false;
+	}
+
+	// A stale or damaged snapshot is dropped now, so it does not linger when the parse below fails
+	IFileManager::Get().Delete(*snapshotPath, false, true, true);
+
+	FOsmSnapshotWriter snapshotWriter(snapshotPath, key, sourceFilePath, sink);
+	if (!snapshotWriter.IsValid())
+	{
+		return parseSource(sink);
+	}
+
+	if (!parseSource(snapshotWriter))
+	{
+		snapshotWriter.Discard();
+		return false;
+	}
+
+	snapshotWriter.Commit();
+	return true;
+}
@@ -0,0 +1,79 @@
+#include "OsmTagDictionary.h"
+
+FOsmTagDictionary::FOsmTagDictionary()
+{
+	for (std::atomic<FString*>& chunk : chunks)
+	{
+		chunk.store(nullptr, std::memory_order_relaxed);
+	}
+
+	// Id 0 is the empty string, so a zero initialized tag is never mistaken for a real one
+	Intern(FString());
+}
+
+FOsmTagDictionary::~FOsmTagDictionary()
+{
+	for (std::atomic<FString*>& chunk : chunks)
+	{
+		delete[] chunk.load(std::memory_order_relaxed);
+	}
+}
+
+FOsmTagDictionary& FOsmTagDictionary::Get()
+{
+	static FOsmTagDictionary instance;
+	return instance;
+}
+
+int32 FOsmTagDictionary::Intern(const FString& str)
+{
+	{
+		FReadScopeLock readLock(lock);
+		if (const int32* id = ids.Find(str))
+		{
+			return *id;
+		}
+	}
+
+	FWriteScopeLock writeLock(lock);
+	if (const int32* id = ids.Find(str))
+	{
+		return *id;
+	}
+
+	int32 id = stringNum;
+	int32 chunkIndex = id >> ChunkBits;
+	checkf(chunkIndex < MaxChunkNum, TEXT("Tag dictionary is full!"));
+	FString* chunk = chunks[chunkIndex].load(std::memory_order_relaxed);
+	if (!chunk)
+	{
+		chunk = new FString[ChunkSize];
+		chunks[chunkIndex].store(chunk, std::memory_order_release);
+	}
+	chunk[id & (ChunkSize - 1)] = str;
+	stringNum++;
+
+	ids.Add(str, id);
+	return id;
+}
+
+int32 FOsmTagDictionary::Find(const FString& str) const
+{
+	FReadScopeLock readLock(lock);
+	const int32* id = ids.Find(str);
+	return id ? *id : INDEX_NONE;
+}
+
+const FString& FOsmTagDictionary::GetString(int32 id) const
+{
+	check(id >= 0 && (id >> ChunkBits) < MaxChunkNum);
+	FString* chunk = chunks[id >> ChunkBits].load(std::memory_order_acquire);
+	check(chunk);
+	return chunk[id & (ChunkSize - 1)];
+}
+
+int32 FOsmTagDictionary::Num() const
+{
+	FReadScopeLock readLock(lock);
+	return stringNum;
+}
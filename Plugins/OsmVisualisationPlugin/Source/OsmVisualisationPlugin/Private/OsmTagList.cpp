@@ -0,0 +1,153 @@
+#include "OsmTagList.h"
+#include "Algo/StableSort.h"
+#include "Misc/Crc.h"
+#include "Misc/ScopeRWLock.h"
+
+namespace OsmTagList
+{
+	/// <summary>
+	/// Append-only store of distinct tag sets. Split in shards by hash, so readers interning on
+	/// several threads rarely wait for each other. Sets are never freed, pointers into the pool stay valid.
+	/// </summary>
+	class FTagSetPool
+	{
+	private:
+		static constexpr int32 ShardBits = 5;
+		static constexpr int32 ChunkTagNum = 16384;
+
+		struct FShard
+		{
+			FRWLock lock;
+			TMultiMap<uint32, TPair<const FOsmTag*, int32>> setsByHash;
+			TArray<TUniquePtr<FOsmTag[]>> chunks;
+			FOsmTag* chunk = nullptr;
+			int32 chunkUsed = ChunkTagNum;
+
+			const FOsmTag* Find(uint32 hash, TArrayView<const FOsmTag> tags) const
+			{
+				for (auto it = setsByHash.CreateConstKeyIterator(hash); it; ++it)
+				{
+					const TPair<const FOsmTag*, int32>& set = it.Value();
+					if (set.Value == tags.Num() && FMemory::Memcmp(set.Key, tags.GetData(), tags.Num() * sizeof(FOsmTag)) == 0)
+					{
+						return set.Key;
+					}
+				}
+				return nullptr;
+			}
+
+			const FOsmTag* Add(uint32 hash, TArrayView<const FOsmTag> tags)
+			{
+				FOsmTag* storage;
+				if (tags.Num() > ChunkTagNum)
+				{
+					storage = chunks.Add_GetRef(MakeUnique<FOsmTag[]>(tags.Num())).Get();
+				}
+				else
+				{
+					if (chunkUsed + tags.Num() > ChunkTagNum)
+					{
+						chunk = chunks.Add_GetRef(MakeUnique<FOsmTag[]>(ChunkTagNum)).Get();
+						chunkUsed = 0;
+					}
+					storage = chunk + chunkUsed;
+					chunkUsed += tags.Num();
+				}
+				FMemory::Memcpy(storage, tags.GetData(), tags.Num() * sizeof(FOsmTag));
+				setsByHash.Add(hash, TPair<const FOsmTag*, int32>(storage, tags.Num()));
+				return storage;
+			}
+		};
+
+		FShard shards[1 << ShardBits];
+
+	public:
+		static FTagSetPool& Get()
+		{
+			static FTagSetPool instance;
+			return instance;
+		}
+
+		const FOsmTag* Intern(TArrayView<const FOsmTag> tags)
+		{
+			uint32 hash = FCrc::MemCrc32(tags.GetData(), tags.Num() * sizeof(FOsmTag));
+			// The top bits pick the shard, the low bits stay spread for the shard's own hash buckets
+			FShard& shard = shards[hash >> (32 - ShardBits)];
+			{
+				FReadScopeLock readLock(shard.lock);
+				if (const FOsmTag* pooled = shard.Find(hash, tags))
+				{
+					return pooled;
+				}
+			}
+
+			FWriteScopeLock writeLock(shard.lock);
+			if (const FOsmTag* pooled = shard.Find(hash, tags))
+			{
+				return pooled;
+			}
+			return shard.Add(hash, tags);
+		}
+	};
+}
+
+int32 FOsmTagList::Normalize(TArrayView<FOsmTag> tags)
+{
+	// Stable, so of repeated keys the one added last stays last and is the one kept
+	Algo::StableSortBy(tags, [](const FOsmTag& tag) { return tag.key; });
+
+	int32 keptNum = 0;
+	for (int32 i = 0; i < tags.Num(); i++)
+	{
+		if (i + 1 < tags.Num() && tags[i + 1].key == tags[i].key)
+		{
+			continue;
+		}
+		tags[keptNum++] = tags[i];
+	}
+	return keptNum;
+}
+
+FOsmTagList FOsmTagList::Intern(TArrayView<const FOsmTag> tags)
+{
+	if (tags.IsEmpty())
+	{
+		return FOsmTagList();
+	}
+	return FOsmTagList(OsmTagList::FTagSetPool::Get().Intern(tags), tags.Num());
+}
+
+bool FOsmTagList::Serialize(FArchive& ar)
+{
+	FOsmTagDictionary& dictionary = FOsmTagDictionary::Get();
+
+	int32 tagNum = num;
+	ar << tagNum;
+
+	if (ar.IsLoading())
+	{
+		TArray<FOsmTag, TInlineAllocator<32>> loaded;
+		for (int32 i = 0; i < tagNum && !ar.IsError(); i++)
+		{
+			FString key;
+			FString value;
+			ar << key;
+			ar << value;
+			loaded.Add({ dictionary.Intern(key), dictionary.Intern(value) });
+		}
+		loaded.SetNum(Normalize(loaded), false);
+		*this = Intern(loaded);
+	}
+	else
+	{
+		for (const FOsmTag& tag : *this)
+		{
+			FString key = dictionary.GetString(tag.key);
+			FString value = dictionary.GetString(tag.value);
+			ar << key;
+			ar << value;
+		}
+	}
+
+	return true;
+}
@@ -1,6 +1,5 @@
 #include "OsmUtilsLibrary.h"
 #include "Earth.h"
-#include "JsonBlueprintFunctionLibrary.h"
 
 inline TArray<FString> UOsmUtilsLibrary::SplitFilePath(const FString& filePath, char separator)
 {
@@ -174,32 +173,49 @@ TArray<FString> UOsmUtilsLibrary::GetFilesMatchingPattern(const FString& pattern
 	return result;
 }
 
+TMap<FString, FString> UOsmUtilsLibrary::GetOsmTags(const FOsmTagList& tags)
+{
+	return tags.ToMap();
+}
+
+bool UOsmUtilsLibrary::FindOsmTag(const FOsmTagList& tags, const FString& key, FString& value)
+{
+	const FString* found = tags.Find(key);
+	if (!found)
+	{
+		return false;
+	}
+	value = *found;
+	return true;
+}
+
 void UOsmUtilsLibrary::BuildEarthFromJsonFile(const UObject* WorldContextObject, AEarth* earth, const FString& jsonFilePath)
 {
 	check(earth);
 
-	FJsonObjectWrapper wrapper;
-	FFilePath path;
-	path.FilePath = jsonFilePath;
-	if (!UJsonBlueprintFunctionLibrary::FromFile(const_cast<UObject*>(WorldContextObject), path, wrapper))
+	if (!earth->LoadFromJsonFile(jsonFilePath))
 	{
-		UE_LOG(LogTemp, Error, TEXT("Failed to load JSON from file %s"), *jsonFilePath);
+		UE_LOG(LogTemp, Error, TEXT("Failed to build earth from JSON file %s"), *jsonFilePath);
 		return;
 	}
+}
 
-	if (!earth->LoadFromJsonObject(wrapper))
+void UOsmUtilsLibrary::BuildEarthFromPbfFile(const UObject* WorldContextObject, AEarth* earth, const FString& pbfFilePath)
+{
+	check(earth);
+
+	if (!earth->LoadFromPbfFile(pbfFilePath))
 	{
-		UE_LOG(LogTemp, Error, TEXT("Failed to build earth from JSON file %s"), *jsonFilePath);
+		UE_LOG(LogTemp, Error, TEXT("Failed to build earth from PBF file %s"), *pbfFilePath);
 		return;
 	}
 }
 
 void UOsmUtilsLibrary::BuildEarthFromJsonFilesPattern(const UObject* WorldContextObject, AEarth* earth, const FString& jsonFilesPattern, const FString& patternMatcher)
 {
+	check(earth);
+
 	TArray<FString> matchingFiles = GetFilesMatchingPattern(jsonFilesPattern, patternMatcher);
 
-	for (const FString& file : matchingFiles)
-	{
-		BuildEarthFromJsonFile(WorldContextObject, earth, file);
-	}
+	earth->LoadFromJsonFiles(matchingFiles);
 }
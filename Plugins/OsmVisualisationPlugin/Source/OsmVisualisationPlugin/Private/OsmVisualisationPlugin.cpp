@@ -1,12 +1,16 @@
 // Copyright Epic Games, Inc. All Rights Reserved.
 
 #include "OsmVisualisationPlugin.h"
+#include "OsmSnapshot.h"
+#include "OsmIndexCache.h"
 
 #define LOCTEXT_NAMESPACE "FOsmVisualisationPluginModule"
 
 void FOsmVisualisationPluginModule::StartupModule()
 {
 	// This code will execute after your module is loaded into memory; the exact timing is specified in the .uplugin file per-module
+	FOsmSnapshot::EvictStale();
+	FOsmIndexCache::EvictStale();
 }
 
 void FOsmVisualisationPluginModule::ShutdownModule()
@@ -0,0 +1,13 @@
+#pragma once
+
+#include "CoreMinimal.h"
+
+/// <summary>
+/// How a region test classifies a cell: skip it, descend into it, or take all of it.
+/// </summary>
+enum class ECullResult : uint8
+{
+	Outside,
+	Intersects,
+	Inside
+};
@@ -10,9 +10,97 @@
 #include "Dom/JsonObject.h"
 #include "JsonObjectWrapper.h"
 #include "QuadTree.h"
+#include "LinearQuadTree.h"
+#include "PackedRTree.h"
+#include "OsmDataBatch.h"
+#include "OsmNodeStore.h"
+#include "OsmMultipolygon.h"
+#include "OsmIngestFilter.h"
+#include "SphericalCap.h"
+#include "LocalTangentFrame.h"
+#include "GeoCellId.h"
+#include "OsmIndexCache.h"
+#include "OsmBuildingMesh.h"
 #include "Earth.generated.h"
 
 class UNiagaraComponent;
+class UProceduralMeshComponent;
+class UMaterialInterface;
+class APlayerController;
+struct FConvexVolume;
+
+/// <summary>
+/// Nodes and ways of one cell, a way belongs to the cell holding the center of its nodes.
+/// </summary>
+struct FOsmCellBucket
+{
+	TArray<int64> nodeIds;
+	TArray<int64> wayIds;
+};
+
+/// <summary>
+/// Stages of FinalizeLoadedData in the order they run, Idle when no finalize is running.
+/// </summary>
+enum class EOsmFinalizeStage : uint8
+{
+	Idle,
+	FinalizeNodes,
+	ResolveWays,
+	AssembleMultipolygons,
+	UpdateWayIndex,
+	UpdateBuildingLod,
+	UpdateSpatialIndex
+};
+
+/// <summary>
+/// A building to place, either a way or a multipolygon.
+/// </summary>
+struct FOsmBuildingSource
+{
+	const FOsmWay* way = nullptr;
+	const FOsmMultipolygon* multipolygon = nullptr;
+};
+
+/// <summary>
+/// Buildings of one FGeoCellId level merged per cell into a single instance, sorted by cell id.
+/// </summary>
+struct FOsmBuildingLodLevel
+{
+	int32 level = 0;
+	TArray<uint64> cellIds;
+	// Union of the footprints of the cell's buildings, X lat and Y lon
+	TArray<FBox2D> footprints;
+	TArray<double> heightSums;
+	TArray<int32> buildingNums;
+
+	TArray<FVector> locations;
+	TArray<FQuat> rotations;
+	TArray<FVector> scales;
+
+	int32 Num() const
+	{
+		return cellIds.Num();
+	}
+
+	void Add(uint64 cellId, const FBox2D& footprint, double heightSum, int32 buildingNum)
+	{
+		cellIds.Add(cellId);
+		footprints.Add(footprint);
+		heightSums.Add(heightSum);
+		buildingNums.Add(buildingNum);
+	}
+
+	/// <summary>
+	/// Adds the aggregate at index of other, render parameters included.
+	/// </summary>
+	void Append(const FOsmBuildingLodLevel& other, int32 index)
+	{
+		Add(other.cellIds[index], other.footprints[index], other.heightSums[index], other.buildingNums[index]);
+		locations.Add(other.locations[index]);
+		rotations.Add(other.rotations[index]);
+		scales.Add(other.scales[index]);
+	}
+};
 
 UCLASS()
 class OSMVISUALISATIONPLUGIN_API AEarth : public AActor
@@ -29,16 +117,232 @@ private:
 	UPROPERTY()
 	TMap<int64, FOsmNode> osmNodes;
 
+	/// <summary>
+	/// Keep nodes in the compact structure-of-arrays store instead of osmNodes.
+	/// Meant for large extracts, GetNodes() stays empty in this mode.
+	/// </summary>
+	UPROPERTY(EditAnywhere)
+	bool useCompactNodeStore = false;
+
+	UPROPERTY()
+	FOsmNodeStore compactNodes;
+
 	UPROPERTY()
 	TMap<int64, FOsmWay> osmWays;
 
 	UPROPERTY()
 	TMap<int64, FOsmRelation> osmRelations;
 
+	TArray<FOsmMultipolygon> multipolygons;
+
+	// Index into multipolygons of every assembled relation
+	TMap<int64, int32> multipolygonIndexByRelation;
+
+	// Multipolygon relations by the ways they use, to find the ones whose ways a load changed
+	TMultiMap<int64, int64> multipolygonRelationsByWay;
+
+	// Ways and relations added since the last FinalizeLoadedData, resolved and assembled there on their own
+	TSet<int64> unresolvedWayIds;
+	TSet<int64> pendingRelationIds;
+
+	// Resolved ways with missing nodes, resolved again once a load brings new nodes
+	TSet<int64> incompleteWayIds;
+	bool nodesAddedSinceFinalize = false;
+
+	// Set when a loaded node moves, the multipolygon bounds and building aggregates are then rebuilt
+	bool nodesMovedSinceFinalize = false;
+
+	// Set when node indices or ways go away, everything is then resolved and assembled from scratch.
+	// Node indices are not saved, so it starts out set.
+	bool derivedDataStale = true;
+
+	// Ways and multipolygon relations FinalizeLoadedData changed so far, the later steps update only what depends on them
+	TSet<int64> touchedWayIds;
+	TSet<int64> touchedRelationIds;
+
+	// Stage of the running finalize, and the flags above as they were when it began
+	EOsmFinalizeStage finalizeStage = EOsmFinalizeStage::Idle;
+	bool finalizeFromScratch = false;
+	bool finalizeNodesAdded = false;
+	bool finalizeNodesMoved = false;
+
+	// Ways the running finalize resolves, how many of them are done and the node references they miss
+	TArray<int64> resolvingWayIds;
+	int32 resolvedWayNum = 0;
+	int32 resolvingMissingNodeNum = 0;
+
 	UPROPERTY(Transient)
 	UNiagaraComponent* buildingVisualizer;
 
+	/// <summary>
+	/// Write a binary snapshot next to every parsed file and read it back instead of parsing on later loads.
+	/// </summary>
+	UPROPERTY(EditAnywhere)
+	bool useSnapshotCache = true;
+
+	/// <summary>
+	/// Decides which elements are kept while loading, everything is kept when it has no rules.
+	/// </summary>
+	UPROPERTY(EditAnywhere)
+	FOsmIngestFilter ingestFilter;
+
+	// Compiled copy of ingestFilter the running loads use, edits only reach loads started after it
+	FOsmIngestFilter loadFilter;
+	int32 activeLoadNum = 0;
+
+	/// <summary>
+	/// Build the node spatial index as a pointer-free FLinearQuadTree instead of an FQuadTree.
+	/// </summary>
+	UPROPERTY(EditAnywhere)
+	bool useLinearSpatialIndex = false;
+
+	/// <summary>
+	/// Save the built node spatial index and load it instead of rebuilding while the nodes come from the same unchanged files.
+	/// </summary>
+	UPROPERTY(EditAnywhere)
+	bool useSpatialIndexCache = true;
+
+	// Cache file of the current index, deleted once the nodes change and a new one is written
+	FString spatialIndexCachePath;
+
+	// Files the current nodes were loaded from and when they were pruned, the spatial index cache is keyed on them
+	TArray<FOsmIndexSource> nodeSources;
+	TArray<int32> nodePrunedAfter;
+	// False once nodes came from something other than a whole source file, which leaves the index uncached
+	bool nodeSourcesKnown = true;
+
+	/// <summary>
+	/// Draw the spatial index after building it and lines to a sample of the placed buildings.
+	/// </summary>
+	UPROPERTY(EditAnywhere)
+	bool debugDrawing = false;
+
 	TUniquePtr<FQuadTree<int64>> nodeSpatialIndex;
+	TUniquePtr<FLinearQuadTree<int64>> linearNodeSpatialIndex;
+
+	// Nodes added since the last FinalizeLoadedData, inserted into the spatial index there
+	TArray<TPair<FVector2D, int64>> pendingIndexNodes;
+
+	// The linear index can not be edited, it is rebuilt on the next FinalizeLoadedData
+	bool linearIndexStale = false;
+
+	/// <summary>
+	/// Lat/lon bounds of every way with at least one loaded node. Each load adds a tree over its new ways and
+	/// merges it with the trees of at most twice its size, so there are only logarithmically many of them.
+	/// </summary>
+	TArray<FPackedRTree<int64>> wayIndexParts;
+
+	/// <summary>
+	/// Lat/lon bounds of the outer rings of every multipolygon, items are indices into multipolygons.
+	/// Added in parts like wayIndexParts, rebuilt when a multipolygon is replaced or goes away.
+	/// </summary>
+	TArray<FPackedRTree<int32>> multipolygonIndexParts;
+
+	/// <summary>
+	/// Keep only the buildings in the first player's view resident, updating them every frame as the camera moves.
+	/// </summary>
+	UPROPERTY(EditAnywhere)
+	bool streamVisibleBuildings = false;
+
+	/// <summary>
+	/// Most building instances added or removed per frame while streaming, 0 for no limit.
+	/// </summary>
+	UPROPERTY(EditAnywhere)
+	int32 maxBuildingChurnPerFrame = 256;
+
+	// Niagara slot of every streamed building, ways by id and multipolygons by GetMultipolygonBuildingKey
+	TMap<int64, int32> residentBuildingSlots;
+	TArray<int32> freeBuildingSlots;
+	int32 buildingSlotNum = 0;
+
+	/// <summary>
+	/// Level of the FGeoCellId cells nodes and ways are bucketed by, level 13 cells are about a kilometre across.
+	/// </summary>
+	UPROPERTY(EditAnywhere)
+	int32 cellBucketLevel = 13;
+
+	// Sorted ids of the non-empty cells and the bucket of each
+	TArray<uint64> cellBucketIds;
+	TArray<FOsmCellBucket> cellBuckets;
+	// Tangent frame at the center of each bucket's cell on the visual sphere
+	TArray<FLocalTangentFrame> cellBucketFrames;
+
+	// Level the buckets and the way index were built for, INDEX_NONE until they are built
+	int32 builtCellBucketLevel = INDEX_NONE;
+
+	// Nodes and ways added since the last FinalizeLoadedData, bucketed and indexed there on their own
+	TSet<int64> pendingCellNodeIds;
+	TSet<int64> pendingCellWayIds;
+
+	// Set when a node or way that is already bucketed moves or goes away, both are then built from scratch
+	bool cellBucketsStale = false;
+
+	// Bucketed ways with missing nodes and how many, they move once later loads bring those nodes
+	TMap<int64, int32> incompleteWayMissingNodes;
+
+	/// <summary>
+	/// Draw one aggregate instance per cell when zoomed out, the cell level following the view distance.
+	/// Closer than the finest aggregate level the visible buildings are streamed one by one.
+	/// </summary>
+	UPROPERTY(EditAnywhere)
+	bool useBuildingLod = false;
+
+	/// <summary>
+	/// Coarsest cell level aggregates are built for, the finest is cellBucketLevel.
+	/// </summary>
+	UPROPERTY(EditAnywhere)
+	int32 minBuildingLodLevel = 3;
+
+	/// <summary>
+	/// About how many aggregate cells span the visible ground, keeping the instance count steady while zooming.
+	/// </summary>
+	UPROPERTY(EditAnywhere)
+	double buildingLodCellsAcrossView = 32.0;
+
+	// Distance of the camera from the planet center, reported by the viewer
+	double viewDistance = 0.0;
+
+	// Aggregates from minBuildingLodLevel up to cellBucketLevel, coarsest first
+	TArray<FOsmBuildingLodLevel> buildingLodLevels;
+
+	// Finest aggregate cell of every building, ways by id and multipolygons by GetMultipolygonBuildingKey, and the reverse
+	TMap<int64, uint64> buildingLodCells;
+	TMultiMap<uint64, int64> buildingLodCellBuildings;
+
+	// Levels buildingLodLevels were built for, INDEX_NONE until they are built
+	int32 builtBuildingLodFinestLevel = INDEX_NONE;
+	int32 builtBuildingLodCoarsestLevel = INDEX_NONE;
+
+	// Level and aggregate indices sent to Niagara last, INDEX_NONE while buildings are streamed
+	int32 renderedLodLevel = INDEX_NONE;
+	TArray<int32> renderedLodCells;
+
+	/// <summary>
+	/// Draw buildings as extruded footprints, one merged mesh per cellBucketLevel tile, instead of Niagara instances.
+	/// </summary>
+	UPROPERTY(EditAnywhere)
+	bool useFootprintMeshes = false;
+
+	UPROPERTY(EditAnywhere)
+	UMaterialInterface* footprintMeshMaterial = nullptr;
+
+	/// <summary>
+	/// Height in metres of buildings tagged with neither height nor building:levels.
+	/// </summary>
+	UPROPERTY(EditAnywhere)
+	double defaultBuildingHeight = 10.0;
+
+	/// <summary>
+	/// Most finished tile meshes turned into components per frame.
+	/// </summary>
+	UPROPERTY(EditAnywhere)
+	int32 maxTileMeshCommitsPerFrame = 4;
+
+	UPROPERTY(Transient)
+	TMap<int64, UProceduralMeshComponent*> tileMeshComponents;
+
+	// Shared with the workers building the tile meshes, replaced on every rebuild
+	TSharedPtr<FOsmTileMeshQueue, ESPMode::ThreadSafe> tileMeshQueue;
 	
 public:	
 	// Sets default values for this actor's properties
@@ -48,12 +352,19 @@ protected:
 	// Called when the game starts or when spawned
 	virtual void BeginPlay() override;
 
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
+#if WITH_EDITOR
+	virtual void PostEditChangeProperty(FPropertyChangedEvent& PropertyChangedEvent) override;
+#endif
+
 	template<typename OsgElement>
 	bool LoadTagsFromJsonArray(OsgElement& osgElement, const TSharedPtr<FJsonObject>& jsonObjectPtr)
 	{
 		if (jsonObjectPtr->HasField("tags"))
 		{
 			auto tagsObject = jsonObjectPtr->GetObjectField("tags");
+			FOsmTagListBuilder tags;
 			for (auto tag : tagsObject->Values)
 			{
 				FString tagValue;
@@ -62,8 +373,9 @@ protected:
 					UE_LOG(LogTemp, Error, TEXT("Non-string tag!"));
 					return false;
 				}
-				osgElement.tags.Add(tag.Key, tagValue);
+				tags.Add(tag.Key, tagValue);
 			}
+			osgElement.tags = tags.Build();
 		}
 
 		return true;
@@ -95,6 +407,200 @@ public:
 	UFUNCTION(BlueprintCallable)
 	bool LoadFromJsonObject(const FJsonObjectWrapper& jsonObjectWrapper);
 
+	/// <summary>
+	/// Streams an Overpass JSON file element by element straight into the node, way and relation stores.
+	/// Peak memory stays bounded by the largest single element instead of the whole JSON DOM.
+	/// </summary>
+	UFUNCTION(BlueprintCallable)
+	bool LoadFromJsonFile(const FString& jsonFilePath);
+
+	/// <summary>
+	/// Reads and parses the files concurrently into per-file staging batches, then merges
+	/// the batches in the given order, so the result is identical to loading them one by one.
+	/// Files that fail to parse are skipped as a whole.
+	/// </summary>
+	UFUNCTION(BlueprintCallable)
+	bool LoadFromJsonFiles(const TArray<FString>& jsonFilePaths);
+
+	/// <summary>
+	/// Loads an .osm.pbf file, primitive blocks are decoded in parallel on task graph workers.
+	/// </summary>
+	UFUNCTION(BlueprintCallable)
+	bool LoadFromPbfFile(const FString& pbfFilePath);
+
+	/// <summary>
+	/// Reads a .json or .pbf file into the sink, going through the snapshot cache if requested. Thread-safe.
+	/// outSourceKey is the snapshot key of the file, unset if it could not be computed.
+	/// </summary>
+	static bool ReadOsmFile(const FString& filePath, IOsmElementSink& sink, bool useSnapshotCache, TOptional<FOsmSnapshotKey>& outSourceKey);
+
+	/// <summary>
+	/// Records a file whose elements went into the earth. Call during the load, so the filter hash is the one it used.
+	/// Without a key, or when the file was only partly loaded, the nodes are no longer known by their sources.
+	/// </summary>
+	void AddNodeSource(const FString& filePath, const TOptional<FOsmSnapshotKey>& sourceKey, bool complete);
+
+	bool IsSnapshotCacheEnabled() const
+	{
+		return useSnapshotCache;
+	}
+
+	void MergeBatch(FOsmDataBatch&& batch);
+
+	UFUNCTION(BlueprintCallable)
+	void SetIngestFilter(const FOsmIngestFilter& filter);
+
+	const FOsmIngestFilter& GetIngestFilter() const
+	{
+		return ingestFilter;
+	}
+
+	/// <summary>
+	/// Opens a load on the game thread and returns the filter it runs with. The filter is compiled
+	/// when the first of overlapping loads opens and stays unchanged until the last one ends.
+	/// </summary>
+	const FOsmIngestFilter& BeginLoad();
+
+	void EndLoad();
+
+	/// <summary>
+	/// Drops untagged ways no relation uses and untagged nodes nothing references. Call it once the whole
+	/// dataset is loaded, ways loaded afterwards can not use nodes pruned here. Refused while a load is running.
+	/// </summary>
+	UFUNCTION(BlueprintCallable)
+	void PruneUnreferencedElements();
+
+	/// <summary>
+	/// Add* apply the filter of the running load and must be called between BeginLoad and EndLoad.
+	/// They return whether the element was kept.
+	/// </summary>
+	bool AddNode(FOsmNode&& node);
+	bool AddWay(FOsmWay&& way);
+	bool AddRelation(FOsmRelation&& relation);
+
+	/// <summary>
+	/// Called after every load, prepares the loaded data for queries in one go.
+	/// </summary>
+	UFUNCTION(BlueprintCallable)
+	void FinalizeLoadedData();
+
+	/// <summary>
+	/// Starts a finalize that StepFinalize carries out over several frames, finishing a running one first.
+	/// </summary>
+	void BeginFinalize();
+
+	/// <summary>
+	/// Runs finalize stages on the game thread until the deadline passes, at least one slice per call.
+	/// Returns true once the finalize is complete.
+	/// </summary>
+	bool StepFinalize(double deadline);
+
+	/// <summary>
+	/// Runs the remaining stages of a running finalize at once.
+	/// </summary>
+	void CompleteFinalize();
+
+	/// <summary>
+	/// Picks the ways ResolveWayNodeSlice resolves: the ways added since the last finalize and, once new nodes arrived,
+	/// the ways that still miss some.
+	/// </summary>
+	void BeginResolveWayNodes();
+
+	/// <summary>
+	/// Resolves up to maxWayNum more of the ways picked by BeginResolveWayNodes, true when all of them are.
+	/// </summary>
+	bool ResolveWayNodeSlice(int32 maxWayNum);
+
+	/// <summary>
+	/// Turns node ids into indices for GetResolvedNodeLatLon, for the ways BeginResolveWayNodes picks, in one go.
+	/// Node indices are slots of the compact store or element ids of osmNodes, both stay put while nodes are
+	/// added, so resolved ways stay valid.
+	/// </summary>
+	void ResolveWayNodes();
+
+	FVector2D GetResolvedNodeLatLon(int32 nodeIndex) const
+	{
+		return useCompactNodeStore ? compactNodes.GetLatLon(nodeIndex) : osmNodes.Get(FSetElementId::FromInteger(nodeIndex)).Value.GetLatLon();
+	}
+
+	/// <summary>
+	/// Assembles the rings of the multipolygon relations added since the last call and of the ones using ways
+	/// ResolveWayNodes changed, in parallel. Needs resolved ways.
+	/// </summary>
+	void AssembleMultipolygons();
+
+	/// <summary>
+	/// Adds a tree over the multipolygons to the multipolygon index, merging it like AddToWayIndex.
+	/// </summary>
+	void AddToMultipolygonIndex(const TArray<int32>& indices);
+
+	/// <summary>
+	/// Drops the multipolygon of the relation, moving the last multipolygon into its index.
+	/// </summary>
+	void RemoveMultipolygon(int64 relationId);
+
+	const TArray<FOsmMultipolygon>& GetMultipolygons() const
+	{
+		return multipolygons;
+	}
+
+	/// <summary>
+	/// Calls func(const FVector2D& latLon) for every node of the way that exists, in order.
+	/// Uses the resolved indices when the way has them and falls back to id lookups otherwise.
+	/// </summary>
+	template<typename Func>
+	void ForEachWayNodeLatLon(const FOsmWay& way, Func&& func) const
+	{
+		if (way.IsResolved())
+		{
+			for (int32 nodeIndex : way.nodeIndices)
+			{
+				if (nodeIndex != INDEX_NONE)
+				{
+					func(GetResolvedNodeLatLon(nodeIndex));
+				}
+			}
+			return;
+		}
+
+		for (int64 nodeId : way.nodeIds)
+		{
+			FVector2D latLon;
+			if (GetNodeLatLon(nodeId, latLon))
+			{
+				func(latLon);
+			}
+		}
+	}
+
+	UFUNCTION(BlueprintCallable)
+	bool GetNodeLatLon(int64 nodeId, FVector2D& latLon) const;
+
+	UFUNCTION(BlueprintCallable)
+	int32 GetNodeNum() const;
+
+	/// <summary>
+	/// Calls func(int64 nodeId, const FVector2D& latLon) for every node in whichever store is active.
+	/// </summary>
+	template<typename Func>
+	void ForEachNode(Func&& func) const
+	{
+		if (useCompactNodeStore)
+		{
+			for (int32 index = 0; index < compactNodes.Num(); index++)
+			{
+				func(compactNodes.GetId(index), compactNodes.GetLatLon(index));
+			}
+		}
+		else
+		{
+			for (const auto& nodePair : osmNodes)
+			{
+				func(nodePair.Key, nodePair.Value.GetLatLon());
+			}
+		}
+	}
+
 	UFUNCTION(BlueprintCallable)
 	const TMap<int64, FOsmNode>& GetNodes();
 	UFUNCTION(BlueprintCallable)
@@ -105,17 +611,296 @@ public:
 	UFUNCTION(BlueprintCallable)
 	void BuildSpatialIndex();
 
+	/// <summary>
+	/// Builds the node spatial index from all nodes, or loads it from the index cache when useCache is set.
+	/// </summary>
+	void BuildNodeSpatialIndex(bool useCache);
+
+	/// <summary>
+	/// Brings an already built node index up to date with the nodes added or removed since it was built.
+	/// The FQuadTree index is edited in place, the linear one is rebuilt.
+	/// </summary>
+	void UpdateSpatialIndex();
+
+	void RemoveNodeFromSpatialIndex(int64 nodeId);
+
+	/// <summary>
+	/// Key of the spatial index cache for the sources of the current nodes and the index settings.
+	/// False when the nodes are not known by their sources, the index is then not cached.
+	/// </summary>
+	bool ComputeSpatialIndexCacheKey(FOsmIndexCacheKey& outKey) const;
+
+	void BuildWayIndex();
+
+	/// <summary>
+	/// Adds a tree over the ways to the way index, merging it with the trees that are not more than twice as big.
+	/// </summary>
+	void AddToWayIndex(const TArray<const FOsmWay*>& ways);
+
+	const TArray<FPackedRTree<int64>>& GetWayIndexParts() const
+	{
+		return wayIndexParts;
+	}
+
+	/// <summary>
+	/// Ids of the ways whose bounds intersect the lat/lon box.
+	/// </summary>
+	UFUNCTION(BlueprintCallable)
+	void QueryWaysInBox(const FVector2D& latLonMin, const FVector2D& latLonMax, TArray<int64>& wayIds) const;
+
+	/// <summary>
+	/// Ids of the ways within radiusMeters of centerLatLon by great-circle distance, judged by their bounds.
+	/// </summary>
+	UFUNCTION(BlueprintCallable)
+	void QueryWaysInCap(const FVector2D& centerLatLon, double radiusMeters, TArray<int64>& wayIds) const;
+
+	/// <summary>
+	/// Frustum and position of the player's camera, false if the player has no viewport.
+	/// </summary>
+	static bool GetPlayerView(APlayerController* playerController, FConvexVolume& outFrustum, FVector& outViewOrigin);
+
+	/// <summary>
+	/// Ids of the ways that may be visible from viewOrigin. Cells of the way index outside the frustum or
+	/// over the horizon are rejected as a whole, cells entirely in view are taken without testing their ways.
+	/// </summary>
+	void QueryVisibleWays(const FConvexVolume& frustum, const FVector& viewOrigin, TArray<int64>& wayIds) const;
+
+	/// <summary>
+	/// Indices into GetMultipolygons() of the multipolygons that may be visible, see QueryVisibleWays.
+	/// </summary>
+	void QueryVisibleMultipolygons(const FConvexVolume& frustum, const FVector& viewOrigin, TArray<int32>& multipolygonIndices) const;
+
+	/// <summary>
+	/// Ids of the building ways that may be visible to the player.
+	/// </summary>
+	UFUNCTION(BlueprintCallable)
+	void QueryBuildingsVisibleToPlayer(APlayerController* playerController, TArray<int64>& wayIds) const;
+
+	/// <summary>
+	/// Sorts all nodes and ways into cells of cellBucketLevel.
+	/// </summary>
+	void BuildCellBuckets();
+
+	/// <summary>
+	/// Sorts the nodes and ways into cells of cellBucketLevel and merges them into the existing buckets.
+	/// </summary>
+	void AddToCellBuckets(const TArray<TPair<int64, FVector2D>>& nodes, const TArray<const FOsmWay*>& ways);
+
+	/// <summary>
+	/// Brings the way index and the cell buckets up to date after a load. Only the added nodes and ways are
+	/// bucketed and indexed, unless already bucketed ones moved or went away, or the bucket level changed.
+	/// </summary>
+	void UpdateWayIndexAndCellBuckets();
+
+	int32 GetCellBucketLevel() const
+	{
+		return cellBucketLevel;
+	}
+
+	const FOsmCellBucket* FindCellBucket(FGeoCellId cell) const;
+
+	/// <summary>
+	/// Local frame at the center of the tile on the visual sphere, geometry of the tile is built in it and
+	/// placed with its transform. Buckets keep theirs precomputed, other cells get one made on the spot.
+	/// </summary>
+	FLocalTangentFrame GetTileFrame(FGeoCellId tile) const;
+
+	/// <summary>
+	/// Calls func(FGeoCellId bucketCell, const FOsmCellBucket& bucket) for every non-empty bucket inside the cell.
+	/// A cell finer than the bucket level gets the one bucket containing it.
+	/// </summary>
+	template<typename Func>
+	void ForEachCellBucket(FGeoCellId cell, Func&& func) const
+	{
+		if (cell.GetLevel() > cellBucketLevel)
+		{
+			cell = cell.GetParent(cellBucketLevel);
+		}
+		int32 index = Algo::LowerBound(cellBucketIds, cell.GetRangeMin());
+		for (; index < cellBucketIds.Num() && cellBucketIds[index] <= cell.GetRangeMax(); index++)
+		{
+			func(FGeoCellId(cellBucketIds[index]), cellBuckets[index]);
+		}
+	}
+
+	/// <summary>
+	/// Id of the cell of the given level holding the point. Ids are FGeoCellId bits stored in an int64.
+	/// </summary>
+	UFUNCTION(BlueprintCallable)
+	int64 GetCellId(const FVector2D& latLon, int32 level) const;
+
+	/// <summary>
+	/// Cells of at most the given level covering the lat/lon box, refined while there are at most about maxCells.
+	/// </summary>
+	UFUNCTION(BlueprintCallable)
+	void GetCellsCoveringBox(const FVector2D& latLonMin, const FVector2D& latLonMax, int32 level, int32 maxCells, TArray<int64>& cellIds) const;
+
+	UFUNCTION(BlueprintCallable)
+	void GetCellParent(int64 cellId, int64& parentCellId) const;
+
+	UFUNCTION(BlueprintCallable)
+	void GetCellChildren(int64 cellId, TArray<int64>& childCellIds) const;
+
+	UFUNCTION(BlueprintCallable)
+	void GetCellNeighbors(int64 cellId, TArray<int64>& neighborCellIds) const;
+
+	/// <summary>
+	/// Ids of the nodes and ways bucketed inside the cell.
+	/// </summary>
+	UFUNCTION(BlueprintCallable)
+	void GetCellContents(int64 cellId, TArray<int64>& nodeIds, TArray<int64>& wayIds) const;
+
+	/// <summary>
+	/// Merges the buildings per cell on every level from minBuildingLodLevel to cellBucketLevel.
+	/// Each aggregate covers the footprints of its buildings and is as tall as they are on average.
+	/// </summary>
+	void BuildBuildingLod();
+
+	/// <summary>
+	/// Brings the aggregates up to date after a load. Only the cells the changed buildings leave or enter are
+	/// merged again, with their parents, unless loaded nodes moved or the levels changed.
+	/// </summary>
+	void UpdateBuildingLod();
+
+	/// <summary>
+	/// Bounds of the building's outline and the sum of its points on the unit sphere, which points at its center.
+	/// </summary>
+	void GetBuildingFootprint(const FOsmBuildingSource& building, FBox2D& footprint, FVector& pointSum) const;
+
+	/// <summary>
+	/// Way or multipolygon of a building key as used by buildingLodCells, false if it is no building any more.
+	/// buildingTag is the interned "building" key.
+	/// </summary>
+	bool FindBuildingSource(int64 buildingKey, int32 buildingTag, FOsmBuildingSource& building) const;
+
+	void ComputeBuildingLodRenderParameters(FOsmBuildingLodLevel& lod) const;
+
+	const TArray<FOsmBuildingLodLevel>& GetBuildingLodLevels() const
+	{
+		return buildingLodLevels;
+	}
+
+	/// <summary>
+	/// Distance from the camera to the planet center in world units, drives the building level of detail.
+	/// </summary>
+	UFUNCTION(BlueprintCallable)
+	void SetViewDistance(double distance);
+
+	/// <summary>
+	/// Cell level whose cells are about the visible ground divided by buildingLodCellsAcrossView,
+	/// greater than cellBucketLevel when single buildings should be drawn.
+	/// </summary>
+	UFUNCTION(BlueprintCallable)
+	int32 GetBuildingLodLevel() const;
+
+	/// <summary>
+	/// Ids of the count nodes closest to latLon by great-circle distance, nearest first. Needs BuildSpatialIndex().
+	/// </summary>
+	UFUNCTION(BlueprintCallable)
+	void FindNearestNodes(const FVector2D& latLon, int32 count, TArray<int64>& nodeIds) const;
+
+	/// <summary>
+	/// Ids of the nodes within radiusMeters of latLon by great-circle distance. Needs BuildSpatialIndex().
+	/// </summary>
+	UFUNCTION(BlueprintCallable)
+	void FindNodesInRadius(const FVector2D& latLon, double radiusMeters, TArray<int64>& nodeIds) const;
+
 	UFUNCTION(BlueprintCallable)
 	void DebugDrawGeoLine(const FVector2D& latLonFrom, const FVector2D& latLonTo, double angleStep, const FColor& color, float time) const;
 
+	void DebugDrawLatLonBox(const FLatLonBoundingBox& box, double time) const;
+
 	void DebugDrawQuadTreeNode(FQuadTree<int64>* quadTreeNode, double time) const;
+	void DebugDrawQuadTreeNode(const FLinearQuadTree<int64>::FNodeRef& quadTreeNode, double time) const;
 
 	UFUNCTION(BlueprintCallable)
 	void DebugDrawSpatialIndex(double time) const;
 
 	UFUNCTION(BlueprintCallable)
-	void GetBuildingRenderParameters(const FOsmWay& building, FVector& location, FQuat& rotation, FVector& scale);
+	void GetBuildingRenderParameters(const FOsmWay& building, FVector& location, FQuat& rotation, FVector& scale) const;
+
+	void GetMultipolygonRenderParameters(const FOsmMultipolygon& multipolygon, FVector& location, FQuat& rotation, FVector& scale) const;
+
+	void GetRenderParameters(TFunctionRef<void(TFunctionRef<void(const FVector2D&)>)> forEachLatLon, FVector& location, FQuat& rotation, FVector& scale) const;
+
+	/// <summary>
+	/// Render parameters of all the buildings at once, computed on all workers into arrays sized to match.
+	/// </summary>
+	void GetBuildingTransforms(TConstArrayView<FOsmBuildingSource> buildings, TArray<FVector>& locations, TArray<FQuat>& rotations, TArray<FVector>& scales) const;
+
+	/// <summary>
+	/// Every building to place, the ways tagged as buildings followed by the building multipolygons.
+	/// </summary>
+	void GetAllBuildings(TArray<FOsmBuildingSource>& buildings) const;
 
 	UFUNCTION(BlueprintCallable)
 	void RenderBuildings();
+
+	/// <summary>
+	/// Like RenderBuildings, but sends only the buildings that may be visible to the player.
+	/// </summary>
+	UFUNCTION(BlueprintCallable)
+	void RenderVisibleBuildings(APlayerController* playerController);
+
+	/// <summary>
+	/// Brings the resident buildings up to date with the player's view. Only buildings entering or leaving the view
+	/// are written to their Niagara slots, at most maxBuildingChurnPerFrame of them, the rest follow in later frames.
+	/// Leaving buildings are removed first and their slots reused by the entering ones in the same frame.
+	/// </summary>
+	UFUNCTION(BlueprintCallable)
+	void StreamVisibleBuildings(APlayerController* playerController);
+
+	/// <summary>
+	/// Draws the visible aggregates of the level picked by GetBuildingLodLevel, or streams single buildings
+	/// past the finest level. Niagara is only updated when the level or the set of visible cells changes.
+	/// </summary>
+	UFUNCTION(BlueprintCallable)
+	void RenderBuildingLod(APlayerController* playerController);
+
+	/// <summary>
+	/// Forgets the resident buildings, the next StreamVisibleBuildings starts over.
+	/// </summary>
+	UFUNCTION(BlueprintCallable)
+	void ResetBuildingStreaming();
+
+	/// <summary>
+	/// Building height in world units from its tags, see FOsmBuildingMeshBuilder::GetHeightMeters.
+	/// </summary>
+	double GetBuildingHeight(const FOsmTagList& tags) const;
+
+	/// <summary>
+	/// Footprints of all buildings grouped by their cellBucketLevel tile. Multipolygons give one footprint per outer ring.
+	/// </summary>
+	void GatherBuildingFootprints(TMap<uint64, TArray<FOsmBuildingFootprint>>& tileFootprints) const;
+
+	/// <summary>
+	/// Replaces the footprint meshes. Tiles are triangulated and extruded on worker threads,
+	/// each becomes a procedural mesh component once CommitReadyTileMeshes picks it up.
+	/// </summary>
+	UFUNCTION(BlueprintCallable)
+	void BuildFootprintMeshes();
+
+	/// <summary>
+	/// Creates the components of up to maxTileMeshCommitsPerFrame finished tiles, called every tick.
+	/// </summary>
+	void CommitReadyTileMeshes();
+
+	/// <summary>
+	/// Stops pending tile builds and destroys the footprint mesh components.
+	/// </summary>
+	UFUNCTION(BlueprintCallable)
+	void ClearFootprintMeshes();
+
+	/// <summary>
+	/// Resident set key of a multipolygon building, kept apart from the positive way ids.
+	/// </summary>
+	static int64 GetMultipolygonBuildingKey(int64 relationId)
+	{
+		return ~relationId;
+	}
+
+protected:
+	void UploadBuildingTransforms(const TArray<FVector>& locations, const TArray<FQuat>& rotations, const TArray<FVector>& scales);
+
+	void SetBuildingSlot(int32 slot, const FVector& location, const FQuat& rotation, const FVector& scale);
 };
@@ -0,0 +1,455 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "MortonCode.h"
+#include "GreatCircle.h"
+#include "CullResult.h"
+
+/// <summary>
+/// Hierarchical cell on the sphere in the style of S2. The sphere is projected onto the six faces of a cube,
+/// a quadratic transform evens out cell areas, and every face is a quadtree of up to MaxLevel levels.
+/// The 64-bit id holds the face in the top 3 bits, two bits per level of the Morton position below it and a
+/// single 1 bit marking the level, so all cells nested in a cell form one contiguous id range.
+/// Positions are geographic lat/lon in degrees, X being the latitude.
+/// </summary>
+struct FGeoCellId
+{
+	static constexpr int32 FaceNum = 6;
+	static constexpr int32 MaxLevel = 30;
+	static constexpr int32 PositionBits = 2 * MaxLevel + 1;
+	static constexpr int32 MaxSize = 1 << MaxLevel;
+
+	uint64 id = 0;
+
+	FGeoCellId()
+	{
+
+	}
+
+	explicit FGeoCellId(uint64 id)
+		: id(id)
+	{
+
+	}
+
+	static FGeoCellId FromFace(int32 face)
+	{
+		return FGeoCellId(((uint64)face << PositionBits) + GetLowestBitForLevel(0));
+	}
+
+	static FGeoCellId FromFaceIJ(int32 face, uint32 i, uint32 j, int32 level)
+	{
+		uint64 leaf = ((uint64)face << PositionBits) | (FMortonCode::Encode(i, j) << 1) | 1;
+		return FGeoCellId(leaf).GetParent(level);
+	}
+
+	static FGeoCellId FromPoint(const FVector& point, int32 level)
+	{
+		int32 face = GetFace(point);
+		double u, v;
+		PointToFaceUV(face, point, u, v);
+		return FromFaceIJ(face, STToIJ(UVToST(u)), STToIJ(UVToST(v)), level);
+	}
+
+	static FGeoCellId FromLatLon(const FVector2D& latLon, int32 level)
+	{
+		return FromPoint(LatLonToPoint(latLon), level);
+	}
+
+	bool IsValid() const
+	{
+		return GetFace() < FaceNum && (GetLowestBit() & 0x1555555555555555ull) != 0;
+	}
+
+	int32 GetFace() const
+	{
+		return (int32)(id >> PositionBits);
+	}
+
+	uint64 GetLowestBit() const
+	{
+		return id & (~id + 1);
+	}
+
+	static uint64 GetLowestBitForLevel(int32 level)
+	{
+		return 1ull << (2 * (MaxLevel - level));
+	}
+
+	int32 GetLevel() const
+	{
+		return MaxLevel - (int32)(FMath::CountTrailingZeros64(id) >> 1);
+	}
+
+	bool IsLeaf() const
+	{
+		return (id & 1) != 0;
+	}
+
+	FGeoCellId GetParent() const
+	{
+		uint64 lowestBit = GetLowestBit() << 2;
+		return FGeoCellId((id & (~lowestBit + 1)) | lowestBit);
+	}
+
+	FGeoCellId GetParent(int32 level) const
+	{
+		uint64 lowestBit = GetLowestBitForLevel(level);
+		return FGeoCellId((id & (~lowestBit + 1)) | lowestBit);
+	}
+
+	/// <summary>
+	/// Child 0 to 3 in Morton order, must not be called on a leaf.
+	/// </summary>
+	FGeoCellId GetChild(int32 position) const
+	{
+		uint64 lowestBit = GetLowestBit();
+		return FGeoCellId(id - lowestBit + (2 * (uint64)position + 1) * (lowestBit >> 2));
+	}
+
+	/// <summary>
+	/// Smallest and largest leaf id inside this cell.
+	/// </summary>
+	uint64 GetRangeMin() const
+	{
+		return id - (GetLowestBit() - 1);
+	}
+
+	uint64 GetRangeMax() const
+	{
+		return id + (GetLowestBit() - 1);
+	}
+
+	bool Contains(const FGeoCellId& other) const
+	{
+		return other.id >= GetRangeMin() && other.id <= GetRangeMax();
+	}
+
+	bool Intersects(const FGeoCellId& other) const
+	{
+		return other.GetRangeMin() <= GetRangeMax() && other.GetRangeMax() >= GetRangeMin();
+	}
+
+	/// <summary>
+	/// Face coordinates of the cell's lowest leaf and the cell's size in leaves.
+	/// </summary>
+	void GetFaceIJ(int32& outFace, uint32& outI, uint32& outJ, uint32& outSize) const
+	{
+		uint64 position = (GetRangeMin() >> 1) & ((1ull << (2 * MaxLevel)) - 1);
+		outFace = GetFace();
+		outI = FMortonCode::CompactBits(position);
+		outJ = FMortonCode::CompactBits(position >> 1);
+		outSize = 1u << (MaxLevel - GetLevel());
+	}
+
+	/// <summary>
+	/// The four cells of the same level sharing an edge with this one, across face boundaries as well.
+	/// </summary>
+	void GetEdgeNeighbors(FGeoCellId outNeighbors[4]) const
+	{
+		int32 face;
+		uint32 i, j, size;
+		GetFaceIJ(face, i, j, size);
+		int32 level = GetLevel();
+
+		const int32 steps[4][2] = { { 0, -1 }, { 1, 0 }, { 0, 1 }, { -1, 0 } };
+		for (int32 edge = 0; edge < 4; edge++)
+		{
+			int64 neighborI = (int64)i + steps[edge][0] * (int64)size;
+			int64 neighborJ = (int64)j + steps[edge][1] * (int64)size;
+			if (neighborI >= 0 && neighborI < MaxSize && neighborJ >= 0 && neighborJ < MaxSize)
+			{
+				outNeighbors[edge] = FromFaceIJ(face, (uint32)neighborI, (uint32)neighborJ, level);
+				continue;
+			}
+
+			// Off the face, the center of the would-be cell projects onto the adjacent face
+			double u = STToUV((neighborI + size * 0.5) / MaxSize);
+			double v = STToUV((neighborJ + size * 0.5) / MaxSize);
+			outNeighbors[edge] = FromPoint(FaceUVToPoint(face, u, v), level);
+		}
+	}
+
+	FVector GetCenterPoint() const
+	{
+		int32 face;
+		uint32 i, j, size;
+		GetFaceIJ(face, i, j, size);
+		double u = STToUV((i + size * 0.5) / MaxSize);
+		double v = STToUV((j + size * 0.5) / MaxSize);
+		return FaceUVToPoint(face, u, v).GetUnsafeNormal();
+	}
+
+	FVector2D GetCenterLatLon() const
+	{
+		return PointToLatLon(GetCenterPoint());
+	}
+
+	/// <summary>
+	/// Corners in counterclockwise order on the face.
+	/// </summary>
+	void GetVertices(FVector outVertices[4]) const
+	{
+		int32 face;
+		uint32 i, j, size;
+		GetFaceIJ(face, i, j, size);
+		double uMin = STToUV((double)i / MaxSize);
+		double uMax = STToUV((double)(i + size) / MaxSize);
+		double vMin = STToUV((double)j / MaxSize);
+		double vMax = STToUV((double)(j + size) / MaxSize);
+		outVertices[0] = FaceUVToPoint(face, uMin, vMin).GetUnsafeNormal();
+		outVertices[1] = FaceUVToPoint(face, uMax, vMin).GetUnsafeNormal();
+		outVertices[2] = FaceUVToPoint(face, uMax, vMax).GetUnsafeNormal();
+		outVertices[3] = FaceUVToPoint(face, uMin, vMax).GetUnsafeNormal();
+	}
+
+	/// <summary>
+	/// Central angle in radians from the center to the farthest vertex. Cells are convex, so the cap around
+	/// the center with this radius holds the whole cell.
+	/// </summary>
+	double GetBoundingAngle() const
+	{
+		FVector center = GetCenterPoint();
+		FVector vertices[4];
+		GetVertices(vertices);
+
+		double result = 0.0;
+		for (const FVector& vertex : vertices)
+		{
+			result = FMath::Max(result, FMath::Acos(FMath::Clamp(FVector::DotProduct(center, vertex), -1.0, 1.0)));
+		}
+		return result;
+	}
+
+	/// <summary>
+	/// Lat/lon box (X lat, Y lon) around the cap bounding the cell. Cells reaching a pole get the full longitude range.
+	/// </summary>
+	FBox2D GetLatLonBounds() const
+	{
+		FVector2D center = GetCenterLatLon();
+		double angle = GetBoundingAngle();
+		double angleDeg = FMath::RadiansToDegrees(angle);
+		if (FMath::Abs(center.X) + angleDeg >= 90.0)
+		{
+			return FBox2D(FVector2D(FMath::Max(-90.0, center.X - angleDeg), -180.0), FVector2D(FMath::Min(90.0, center.X + angleDeg), 180.0));
+		}
+		double lonHalfSize = FMath::RadiansToDegrees(FMath::Asin(FMath::Min(1.0, FMath::Sin(angle) / FMath::Cos(FMath::DegreesToRadians(center.X)))));
+		return FBox2D(FVector2D(center.X - angleDeg, center.Y - lonHalfSize), FVector2D(center.X + angleDeg, center.Y + lonHalfSize));
+	}
+
+	/// <summary>
+	/// Hex digits of the id without its trailing zeros, a short stable name for file and cache keys.
+	/// </summary>
+	FString ToToken() const
+	{
+		if (id == 0)
+		{
+			return TEXT("X");
+		}
+		int32 zeroDigits = (int32)(FMath::CountTrailingZeros64(id) / 4);
+		return FString::Printf(TEXT("%016llx"), id).LeftChop(zeroDigits);
+	}
+
+	bool operator==(const FGeoCellId& other) const
+	{
+		return id == other.id;
+	}
+
+	bool operator!=(const FGeoCellId& other) const
+	{
+		return id != other.id;
+	}
+
+	bool operator<(const FGeoCellId& other) const
+	{
+		return id < other.id;
+	}
+
+	friend uint32 GetTypeHash(const FGeoCellId& cell)
+	{
+		return GetTypeHash(cell.id);
+	}
+
+	/// <summary>
+	/// Cells up to maxLevel that together cover the region, coarse where the region holds whole cells.
+	/// test(const FGeoCellId& cell) classifies cells against the region. Refinement stops once it would
+	/// yield more than about maxCells cells. The result is sorted by id.
+	/// </summary>
+	template<typename RegionTest>
+	static void Cover(RegionTest&& test, int32 maxLevel, int32 maxCells, TArray<FGeoCellId>& OutResult)
+	{
+		maxLevel = FMath::Clamp(maxLevel, 0, MaxLevel);
+
+		TArray<FGeoCellId> candidates;
+		for (int32 face = 0; face < FaceNum; face++)
+		{
+			candidates.Add(FromFace(face));
+		}
+
+		while (candidates.Num() > 0)
+		{
+			TArray<FGeoCellId> partial;
+			for (const FGeoCellId& cell : candidates)
+			{
+				ECullResult result = test(cell);
+				if (result == ECullResult::Outside)
+				{
+					continue;
+				}
+				if (result == ECullResult::Inside || cell.GetLevel() >= maxLevel)
+				{
+					OutResult.Add(cell);
+				}
+				else
+				{
+					partial.Add(cell);
+				}
+			}
+
+			candidates.Reset();
+			if (OutResult.Num() + partial.Num() * 4 > maxCells)
+			{
+				OutResult.Append(partial);
+				break;
+			}
+			for (const FGeoCellId& cell : partial)
+			{
+				for (int32 child = 0; child < 4; child++)
+				{
+					candidates.Add(cell.GetChild(child));
+				}
+			}
+		}
+
+		OutResult.Sort();
+	}
+
+	/// <summary>
+	/// Classifies the cell against a lat/lon box through the cap bounding the cell.
+	/// </summary>
+	static ECullResult TestBox(const FGeoCellId& cell, const FLatLonBoundingBox& box)
+	{
+		FVector2D center = cell.GetCenterLatLon();
+		double angle = cell.GetBoundingAngle();
+		if (FGreatCircle::MinAngularDistance(center, box) > angle)
+		{
+			return ECullResult::Outside;
+		}
+
+		// Lat/lon bounds of the cap
+		double angleDeg = FMath::RadiansToDegrees(angle);
+		if (FMath::Abs(center.X) + angleDeg >= 90.0)
+		{
+			return ECullResult::Intersects;
+		}
+		double lonHalfSize = FMath::RadiansToDegrees(FMath::Asin(FMath::Min(1.0, FMath::Sin(angle) / FMath::Cos(FMath::DegreesToRadians(center.X)))));
+
+		double dLat = FMath::Abs(center.X - box.centerLatLon.X);
+		double dLon = FMath::Abs(FMath::FindDeltaAngleDegrees(box.centerLatLon.Y, center.Y));
+		bool inside = dLat + angleDeg <= box.angleHalfSize.X && dLon + lonHalfSize <= box.angleHalfSize.Y;
+		return inside ? ECullResult::Inside : ECullResult::Intersects;
+	}
+
+	/// <summary>
+	/// Classifies the cell against the points within angle radians of latLon.
+	/// </summary>
+	static ECullResult TestCap(const FGeoCellId& cell, const FVector2D& latLon, double angle)
+	{
+		double distance = FGreatCircle::AngularDistance(latLon, cell.GetCenterLatLon());
+		double cellAngle = cell.GetBoundingAngle();
+		if (distance > angle + cellAngle)
+		{
+			return ECullResult::Outside;
+		}
+		return distance + cellAngle <= angle ? ECullResult::Inside : ECullResult::Intersects;
+	}
+
+	static void CoverBox(const FLatLonBoundingBox& box, int32 maxLevel, int32 maxCells, TArray<FGeoCellId>& OutResult)
+	{
+		Cover([&box](const FGeoCellId& cell)
+			{
+				return TestBox(cell, box);
+			}, maxLevel, maxCells, OutResult);
+	}
+
+	static void CoverCap(const FVector2D& latLon, double angle, int32 maxLevel, int32 maxCells, TArray<FGeoCellId>& OutResult)
+	{
+		Cover([&latLon, angle](const FGeoCellId& cell)
+			{
+				return TestCap(cell, latLon, angle);
+			}, maxLevel, maxCells, OutResult);
+	}
+
+	static FVector LatLonToPoint(const FVector2D& latLon)
+	{
+		double sinLat, cosLat, sinLon, cosLon;
+		FMath::SinCos(&sinLat, &cosLat, FMath::DegreesToRadians(latLon.X));
+		FMath::SinCos(&sinLon, &cosLon, FMath::DegreesToRadians(latLon.Y));
+		return FVector(cosLat * cosLon, cosLat * sinLon, sinLat);
+	}
+
+	static FVector2D PointToLatLon(const FVector& point)
+	{
+		double lat = FMath::Atan2(point.Z, FMath::Sqrt(point.X * point.X + point.Y * point.Y));
+		double lon = FMath::Atan2(point.Y, point.X);
+		return FVector2D(FMath::RadiansToDegrees(lat), FMath::RadiansToDegrees(lon));
+	}
+
+	/// <summary>
+	/// Faces 0 to 2 are the +X, +Y and +Z sides of the cube, 3 to 5 the opposite ones.
+	/// </summary>
+	static int32 GetFace(const FVector& point)
+	{
+		FVector absPoint = point.GetAbs();
+		int32 axis = absPoint.X >= absPoint.Y ? (absPoint.X >= absPoint.Z ? 0 : 2) : (absPoint.Y >= absPoint.Z ? 1 : 2);
+		return point[axis] < 0 ? axis + 3 : axis;
+	}
+
+	static void PointToFaceUV(int32 face, const FVector& point, double& outU, double& outV)
+	{
+		switch (face)
+		{
+		case 0: outU = point.Y / point.X; outV = point.Z / point.X; break;
+		case 1: outU = -point.X / point.Y; outV = point.Z / point.Y; break;
+		case 2: outU = -point.X / point.Z; outV = -point.Y / point.Z; break;
+		case 3: outU = point.Z / point.X; outV = point.Y / point.X; break;
+		case 4: outU = point.Z / point.Y; outV = -point.X / point.Y; break;
+		default: outU = -point.Y / point.Z; outV = -point.X / point.Z; break;
+		}
+	}
+
+	/// <summary>
+	/// Point on the cube, not normalized. u and v may lie outside [-1, 1], the point then belongs to another face.
+	/// </summary>
+	static FVector FaceUVToPoint(int32 face, double u, double v)
+	{
+		switch (face)
+		{
+		case 0: return FVector(1, u, v);
+		case 1: return FVector(-u, 1, v);
+		case 2: return FVector(-u, -v, 1);
+		case 3: return FVector(-1, -v, -u);
+		case 4: return FVector(v, -1, -u);
+		default: return FVector(v, u, -1);
+		}
+	}
+
+	/// <summary>
+	/// Quadratic transform between the cube coordinate u in [-1, 1] and the cell coordinate s in [0, 1].
+	/// Cells equal in s differ less in area than cells equal in u.
+	/// </summary>
+	static double UVToST(double u)
+	{
+		return u >= 0 ? 0.5 * FMath::Sqrt(1 + 3 * u) : 1 - 0.5 * FMath::Sqrt(1 - 3 * u);
+	}
+
+	static double STToUV(double s)
+	{
+		return s >= 0.5 ? (4 * s * s - 1) / 3.0 : (1 - 4 * (1 - s) * (1 - s)) / 3.0;
+	}
+
+	static uint32 STToIJ(double s)
+	{
+		return (uint32)FMath::Clamp<int64>((int64)FMath::FloorToDouble(s * MaxSize), 0, MaxSize - 1);
+	}
+};
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "LatLonBoundingBox.h"
+
+/// <summary>
+/// Distances on the unit sphere between lat/lon points given in degrees. Results are central angles
+/// in radians, multiply by the planet radius to get lengths.
+/// </summary>
+struct FGreatCircle
+{
+	/// <summary>
+	/// Haversine formula, stays accurate for small distances.
+	/// </summary>
+	static double AngularDistance(const FVector2D& latLonA, const FVector2D& latLonB)
+	{
+		double latA = FMath::DegreesToRadians(latLonA.X);
+		double latB = FMath::DegreesToRadians(latLonB.X);
+		double sinHalfDLat = FMath::Sin((latB - latA) * 0.5);
+		double sinHalfDLon = FMath::Sin(FMath::DegreesToRadians(FMath::FindDeltaAngleDegrees(latLonA.Y, latLonB.Y)) * 0.5);
+		double h = sinHalfDLat * sinHalfDLat + FMath::Cos(latA) * FMath::Cos(latB) * sinHalfDLon * sinHalfDLon;
+		return 2.0 * FMath::Asin(FMath::Min(1.0, FMath::Sqrt(h)));
+	}
+
+	/// <summary>
+	/// Smallest central angle between the point and any point of the box, 0 if the point is inside.
+	/// Outside the box's longitude range the closest point lies on one of its two bounding meridians, at the
+	/// latitude closest to the point along that meridian, clamped to the box.
+	/// </summary>
+	static double MinAngularDistance(const FVector2D& latLon, const FLatLonBoundingBox& box)
+	{
+		double latMin = FMath::Max(-90.0, box.centerLatLon.X - box.angleHalfSize.X);
+		double latMax = FMath::Min(90.0, box.centerLatLon.X + box.angleHalfSize.X);
+
+		double dLonCenter = FMath::Abs(FMath::FindDeltaAngleDegrees(box.centerLatLon.Y, latLon.Y));
+		if (dLonCenter <= box.angleHalfSize.Y)
+		{
+			double lat = FMath::Clamp(latLon.X, latMin, latMax);
+			return FMath::DegreesToRadians(FMath::Abs(latLon.X - lat));
+		}
+
+		double sinLat, cosLat;
+		FMath::SinCos(&sinLat, &cosLat, FMath::DegreesToRadians(latLon.X));
+
+		double result = PI;
+		const double edgeLons[2] = { box.centerLatLon.Y - box.angleHalfSize.Y, box.centerLatLon.Y + box.angleHalfSize.Y };
+		for (double edgeLon : edgeLons)
+		{
+			double dLon = FMath::DegreesToRadians(FMath::FindDeltaAngleDegrees(edgeLon, latLon.Y));
+			double closestLat = FMath::RadiansToDegrees(FMath::Atan2(sinLat, cosLat * FMath::Cos(dLon)));
+			closestLat = FMath::Clamp(closestLat, latMin, latMax);
+			result = FMath::Min(result, AngularDistance(latLon, FVector2D(closestLat, edgeLon)));
+		}
+		return result;
+	}
+};
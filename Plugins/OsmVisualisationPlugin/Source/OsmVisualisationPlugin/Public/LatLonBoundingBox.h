@@ -34,8 +34,8 @@ public:
 		double dLat = FMath::Abs(FMath::FindDeltaAngleDegrees(centerLatLon.X, box.centerLatLon.X));
 		double dLon = FMath::Abs(FMath::FindDeltaAngleDegrees(centerLatLon.Y, box.centerLatLon.Y));
 
-		bool latIntersects = dLat < (centerLatLon.X + box.centerLatLon.X);
-		bool lonIntersects = dLon < (centerLatLon.Y + box.centerLatLon.Y);
+		bool latIntersects = dLat <= (angleHalfSize.X + box.angleHalfSize.X);
+		bool lonIntersects = dLon <= (angleHalfSize.Y + box.angleHalfSize.Y);
 		return latIntersects && lonIntersects;
 	}
 
@@ -96,23 +96,23 @@ public:
 		FLatLonBoundingBox& southEast
 	) const
 	{
-		northWest.centerLatLon.X = centerLatLon.X + angleHalfSize.X / 4;
-		northWest.centerLatLon.Y = centerLatLon.Y - angleHalfSize.Y / 4;
+		northWest.centerLatLon.X = centerLatLon.X + angleHalfSize.X / 2;
+		northWest.centerLatLon.Y = centerLatLon.Y - angleHalfSize.Y / 2;
 		northWest.angleHalfSize = angleHalfSize / 2;
 		northWest.Normalize();
 
-		northEast.centerLatLon.X = centerLatLon.X + angleHalfSize.X / 4;
-		northEast.centerLatLon.Y = centerLatLon.Y + angleHalfSize.Y / 4;
+		northEast.centerLatLon.X = centerLatLon.X + angleHalfSize.X / 2;
+		northEast.centerLatLon.Y = centerLatLon.Y + angleHalfSize.Y / 2;
 		northEast.angleHalfSize = angleHalfSize / 2;
 		northEast.Normalize();
 
-		southWest.centerLatLon.X = centerLatLon.X - angleHalfSize.X / 4;
-		southWest.centerLatLon.Y = centerLatLon.Y - angleHalfSize.Y / 4;
+		southWest.centerLatLon.X = centerLatLon.X - angleHalfSize.X / 2;
+		southWest.centerLatLon.Y = centerLatLon.Y - angleHalfSize.Y / 2;
 		southWest.angleHalfSize = angleHalfSize / 2;
 		southWest.Normalize();
 
-		southEast.centerLatLon.X = centerLatLon.X - angleHalfSize.X / 4;
-		southEast.centerLatLon.Y = centerLatLon.Y + angleHalfSize.Y / 4;
+		southEast.centerLatLon.X = centerLatLon.X - angleHalfSize.X / 2;
+		southEast.centerLatLon.Y = centerLatLon.Y + angleHalfSize.Y / 2;
 		southEast.angleHalfSize = angleHalfSize / 2;
 		southEast.Normalize();
 	}
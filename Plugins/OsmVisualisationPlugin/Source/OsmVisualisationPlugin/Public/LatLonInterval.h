@@ -0,0 +1,107 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Math/VectorRegister.h"
+#include "LatLonBoundingBox.h"
+
+/// <summary>
+/// A lat/lon box unwrapped into plain intervals for fast point tests. A box crossing the antimeridian
+/// becomes two longitude intervals, points are expected with longitudes in [-180, 180]. Bounds are inclusive.
+/// </summary>
+struct FLatLonInterval
+{
+	double latMin;
+	double latMax;
+	double lonMin[2];
+	double lonMax[2];
+
+	explicit FLatLonInterval(const FLatLonBoundingBox& box)
+	{
+		latMin = box.centerLatLon.X - box.angleHalfSize.X;
+		latMax = box.centerLatLon.X + box.angleHalfSize.X;
+
+		// Second interval empty unless needed
+		lonMin[1] = 1.0;
+		lonMax[1] = 0.0;
+
+		double center = FMath::UnwindDegrees(box.centerLatLon.Y);
+		double west = center - box.angleHalfSize.Y;
+		double east = center + box.angleHalfSize.Y;
+		if (box.angleHalfSize.Y >= 180.0)
+		{
+			lonMin[0] = -180.0;
+			lonMax[0] = 180.0;
+		}
+		else if (west < -180.0)
+		{
+			lonMin[0] = -180.0;
+			lonMax[0] = east;
+			lonMin[1] = west + 360.0;
+			lonMax[1] = 180.0;
+		}
+		else if (east > 180.0)
+		{
+			lonMin[0] = west;
+			lonMax[0] = 180.0;
+			lonMin[1] = -180.0;
+			lonMax[1] = east - 360.0;
+		}
+		else
+		{
+			lonMin[0] = west;
+			lonMax[0] = east;
+		}
+	}
+
+	bool Contains(double lat, double lon) const
+	{
+		return lat >= latMin && lat <= latMax
+			&& ((lon >= lonMin[0] && lon <= lonMax[0]) || (lon >= lonMin[1] && lon <= lonMax[1]));
+	}
+
+	/// <summary>
+	/// Calls visitor(int32 index) for every point inside, testing four points per step with vector compares.
+	/// Stops and returns false as soon as the visitor returns false.
+	/// </summary>
+	template<typename Visitor>
+	bool ScanPoints(const double* lats, const double* lons, int32 num, Visitor&& visitor) const
+	{
+		const VectorRegister4Double latMinV = VectorSetFloat1(latMin);
+		const VectorRegister4Double latMaxV = VectorSetFloat1(latMax);
+		const VectorRegister4Double lonMin0V = VectorSetFloat1(lonMin[0]);
+		const VectorRegister4Double lonMax0V = VectorSetFloat1(lonMax[0]);
+		const VectorRegister4Double lonMin1V = VectorSetFloat1(lonMin[1]);
+		const VectorRegister4Double lonMax1V = VectorSetFloat1(lonMax[1]);
+
+		int32 index = 0;
+		for (; index + 4 <= num; index += 4)
+		{
+			VectorRegister4Double lat = VectorLoad(lats + index);
+			VectorRegister4Double lon = VectorLoad(lons + index);
+
+			VectorRegister4Double inLat = VectorBitwiseAnd(VectorCompareGE(lat, latMinV), VectorCompareLE(lat, latMaxV));
+			VectorRegister4Double inLon0 = VectorBitwiseAnd(VectorCompareGE(lon, lonMin0V), VectorCompareLE(lon, lonMax0V));
+			VectorRegister4Double inLon1 = VectorBitwiseAnd(VectorCompareGE(lon, lonMin1V), VectorCompareLE(lon, lonMax1V));
+			uint32 mask = (uint32)VectorMaskBits(VectorBitwiseAnd(inLat, VectorBitwiseOr(inLon0, inLon1)));
+
+			while (mask)
+			{
+				int32 lane = (int32)FMath::CountTrailingZeros(mask);
+				mask &= mask - 1;
+				if (!visitor(index + lane))
+				{
+					return false;
+				}
+			}
+		}
+
+		for (; index < num; index++)
+		{
+			if (Contains(lats[index], lons[index]) && !visitor(index))
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+};
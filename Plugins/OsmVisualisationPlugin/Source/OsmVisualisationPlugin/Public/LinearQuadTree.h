@@ -0,0 +1,353 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "LatLonBoundingBox.h"
+#include "QuadTree.h"
+
+/// <summary>
+/// Read-only quadtree stored without pointers. Nodes live in one array and refer to their four
+/// children by the index of the first one, children are stored next to each other in
+/// NW, NE, SW, SE order. Points live in shared lat, lon and data arrays, every node owns a contiguous range of them.
+/// Node boundaries are not stored, they are derived from the root while descending.
+/// </summary>
+template<typename PointData>
+class FLinearQuadTree
+{
+public:
+	struct FNode
+	{
+		int32 firstChild = INDEX_NONE;
+		int32 firstPoint = 0;
+		int32 pointNum = 0;
+	};
+
+	/// <summary>
+	/// Lightweight view of one node, offers the same traversal surface as FQuadTree.
+	/// </summary>
+	class FNodeRef
+	{
+	private:
+		const FLinearQuadTree* tree;
+		int32 index;
+		FLatLonBoundingBox boundary;
+
+	public:
+		FNodeRef(const FLinearQuadTree* tree, int32 index, const FLatLonBoundingBox& boundary)
+			: tree(tree)
+			, index(index)
+			, boundary(boundary)
+		{
+
+		}
+
+		int32 GetIndex() const
+		{
+			return index;
+		}
+
+		FLatLonBoundingBox GetLatLonBoundingBox() const
+		{
+			return boundary;
+		}
+
+		bool IsLeaf() const
+		{
+			return tree->nodes[index].firstChild == INDEX_NONE;
+		}
+
+		TArray<FNodeRef> GetSubtrees() const
+		{
+			TArray<FNodeRef> result;
+			GetSubtrees(result);
+			return result;
+		}
+
+		void GetSubtrees(TArray<FNodeRef>& OutResult) const
+		{
+			int32 firstChild = tree->nodes[index].firstChild;
+			if (firstChild == INDEX_NONE)
+			{
+				return;
+			}
+
+			FLatLonBoundingBox childBoundaries[4];
+			boundary.Subdivide(childBoundaries[0], childBoundaries[1], childBoundaries[2], childBoundaries[3]);
+			for (int32 child = 0; child < 4; child++)
+			{
+				OutResult.Emplace(tree, firstChild + child, childBoundaries[child]);
+			}
+		}
+
+		int32 GetPointNum() const
+		{
+			return tree->nodes[index].pointNum;
+		}
+
+		FVector2D GetPointLatLon(int32 pointIndex) const
+		{
+			int32 point = tree->nodes[index].firstPoint + pointIndex;
+			return FVector2D(tree->pointLats[point], tree->pointLons[point]);
+		}
+
+		const PointData& GetPointData(int32 pointIndex) const
+		{
+			return tree->pointData[tree->nodes[index].firstPoint + pointIndex];
+		}
+	};
+
+private:
+	int nodeCapacity = 128;
+	FLatLonBoundingBox boundary;
+
+	TArray<FNode> nodes;
+	TArray<double> pointLats;
+	TArray<double> pointLons;
+	TArray<PointData> pointData;
+
+	// Morton quadrant (SW, SE, NW, NE) to child slot (NW, NE, SW, SE)
+	static constexpr int32 QuadrantToChild[4] = { 2, 3, 0, 1 };
+
+	void BuildFromSorted(int32 nodeIndex, TArrayView<const uint64> keys, int32 firstPoint, int32 pointNum, int32 depth)
+	{
+		if (pointNum <= nodeCapacity || depth >= FMortonCode::AxisBits)
+		{
+			nodes[nodeIndex].firstPoint = firstPoint;
+			nodes[nodeIndex].pointNum = pointNum;
+			return;
+		}
+
+		int32 firstChild = nodes.AddDefaulted(4);
+		nodes[nodeIndex].firstChild = firstChild;
+		nodes[nodeIndex].firstPoint = firstPoint;
+
+		int32 bounds[5];
+		bounds[0] = 0;
+		bounds[4] = keys.Num();
+		for (int32 quadrant = 1; quadrant < 4; quadrant++)
+		{
+			bounds[quadrant] = Algo::LowerBoundBy(keys, quadrant, [depth](uint64 key)
+				{
+					return FMortonCode::GetQuadrant(key, depth);
+				});
+		}
+
+		for (int32 quadrant = 0; quadrant < 4; quadrant++)
+		{
+			int32 num = bounds[quadrant + 1] - bounds[quadrant];
+			BuildFromSorted(firstChild + QuadrantToChild[quadrant], keys.Slice(bounds[quadrant], num), firstPoint + bounds[quadrant], num, depth + 1);
+		}
+	}
+
+	void Flatten(int32 nodeIndex, const FQuadTree<PointData>& source)
+	{
+		nodes[nodeIndex].firstPoint = pointData.Num();
+		nodes[nodeIndex].pointNum = source.GetPointNum();
+		for (int32 i = 0; i < source.GetPointNum(); i++)
+		{
+			FVector2D latLon = source.GetPointLatLon(i);
+			pointLats.Add(latLon.X);
+			pointLons.Add(latLon.Y);
+			pointData.Add(source.GetPointData(i));
+		}
+
+		TArray<FQuadTree<PointData>*> subtrees = source.GetSubtrees();
+		if (subtrees.IsEmpty())
+		{
+			return;
+		}
+
+		int32 firstChild = nodes.AddDefaulted(4);
+		nodes[nodeIndex].firstChild = firstChild;
+		for (int32 child = 0; child < 4; child++)
+		{
+			Flatten(firstChild + child, *subtrees[child]);
+		}
+	}
+
+public:
+	FLinearQuadTree()
+	{
+		nodes.AddDefaulted();
+	}
+
+	/// <summary>
+	/// Bulk-loads the tree from Morton-sorted points, the sorted order becomes the shared point order as it is.
+	/// </summary>
+	FLinearQuadTree(const FLatLonBoundingBox& box, TArray<TPair<FVector2D, PointData>>&& inPoints, int nodeCapacity = 128)
+	{
+		this->boundary = box;
+		this->nodeCapacity = nodeCapacity;
+
+		TArray<uint64> sortedKeys;
+		TArray<TPair<FVector2D, PointData>> sortedPoints;
+		FQuadTree<PointData>::SortByMortonKey(box, MoveTemp(inPoints), sortedKeys, sortedPoints);
+
+		pointLats.SetNumUninitialized(sortedPoints.Num());
+		pointLons.SetNumUninitialized(sortedPoints.Num());
+		pointData.SetNum(sortedPoints.Num());
+		ParallelFor(sortedPoints.Num(), [this, &sortedPoints](int32 index)
+			{
+				pointLats[index] = sortedPoints[index].Key.X;
+				pointLons[index] = FMath::UnwindDegrees(sortedPoints[index].Key.Y);
+				pointData[index] = MoveTemp(sortedPoints[index].Value);
+			});
+		sortedPoints.Empty();
+
+		nodes.AddDefaulted();
+		BuildFromSorted(0, sortedKeys, 0, pointData.Num(), 0);
+		nodes.Shrink();
+	}
+
+	/// <summary>
+	/// Copies a pointer-based tree, keeping its exact shape.
+	/// </summary>
+	explicit FLinearQuadTree(const FQuadTree<PointData>& source)
+	{
+		this->boundary = source.GetLatLonBoundingBox();
+
+		nodes.AddDefaulted();
+		Flatten(0, source);
+		nodes.Shrink();
+		pointLats.Shrink();
+		pointLons.Shrink();
+		pointData.Shrink();
+	}
+
+	/// <summary>
+	/// Writes the tree, or reads it into a default-constructed one. Every array is a single block, so reading
+	/// costs about as much as copying the file. PointData has to be trivially copyable.
+	/// </summary>
+	bool Serialize(FArchive& ar)
+	{
+		ar << nodeCapacity;
+		ar << boundary.centerLatLon;
+		ar << boundary.angleHalfSize;
+		if (ar.IsError()
+			|| !SerializeQuadTreeArray(ar, nodes)
+			|| !SerializeQuadTreeArray(ar, pointLats)
+			|| !SerializeQuadTreeArray(ar, pointLons)
+			|| !SerializeQuadTreeArray(ar, pointData))
+		{
+			return false;
+		}
+		if (!ar.IsLoading())
+		{
+			return true;
+		}
+
+		// Reject anything that would index out of bounds while traversing
+		int32 pointNum = pointData.Num();
+		if (nodes.Num() == 0 || pointLats.Num() != pointNum || pointLons.Num() != pointNum)
+		{
+			return false;
+		}
+		for (int32 index = 0; index < nodes.Num(); index++)
+		{
+			const FNode& node = nodes[index];
+			bool childrenValid = node.firstChild == INDEX_NONE || (node.firstChild > index && node.firstChild <= nodes.Num() - 4);
+			bool pointsValid = node.firstPoint >= 0 && node.pointNum >= 0 && node.firstPoint <= pointNum - node.pointNum;
+			if (!childrenValid || !pointsValid)
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	FNodeRef GetRoot() const
+	{
+		return FNodeRef(this, 0, boundary);
+	}
+
+	FLatLonBoundingBox GetLatLonBoundingBox() const
+	{
+		return boundary;
+	}
+
+	int32 GetNodeNum() const
+	{
+		return nodes.Num();
+	}
+
+	int32 GetPointNum() const
+	{
+		return pointData.Num();
+	}
+
+	SIZE_T GetAllocatedSize() const
+	{
+		return nodes.GetAllocatedSize() + pointLats.GetAllocatedSize() + pointLons.GetAllocatedSize() + pointData.GetAllocatedSize();
+	}
+
+	TArray<TPair<FVector2D, PointData>> Query(const FLatLonBoundingBox& range) const
+	{
+		TArray<TPair<FVector2D, PointData>> result;
+		Query(range, result);
+		return result;
+	}
+
+	void FindNearest(const FVector2D& latLon, int32 count, TArray<TPair<FVector2D, PointData>>& OutResult, double maxAngle = PI) const
+	{
+		FQuadTreeSearch::FindNearest(GetRoot(), latLon, count, maxAngle, OutResult);
+	}
+
+	void QueryRadius(const FVector2D& latLon, double angle, TArray<TPair<FVector2D, PointData>>& OutResult) const
+	{
+		FQuadTreeSearch::QueryRadius(GetRoot(), latLon, angle, OutResult);
+	}
+
+	void Query(const FLatLonBoundingBox& range, TArray<TPair<FVector2D, PointData>>& OutResult) const
+	{
+		Visit(range, [&OutResult](const FVector2D& latLon, const PointData& data)
+			{
+				OutResult.Emplace(latLon, data);
+				return true;
+			});
+	}
+
+	/// <summary>
+	/// Calls visitor(const FVector2D& latLon, const PointData& data) for every point inside the range without
+	/// allocating. The visitor returns false to stop the query, in which case Visit returns false as well.
+	/// </summary>
+	template<typename Visitor>
+	bool Visit(const FLatLonBoundingBox& range, Visitor&& visitor) const
+	{
+		FLatLonInterval interval(range);
+		TArray<TPair<int32, FLatLonBoundingBox>, TInlineAllocator<64>> stack;
+		stack.Emplace(0, boundary);
+
+		while (stack.Num() > 0)
+		{
+			TPair<int32, FLatLonBoundingBox> entry = stack.Pop(false);
+			if (!entry.Value.Intersects(range))
+			{
+				continue;
+			}
+
+			// Only leaves have points, unless the tree was copied from an FQuadTree built by insertion
+			const FNode& node = nodes[entry.Key];
+			bool completed = interval.ScanPoints(pointLats.GetData() + node.firstPoint, pointLons.GetData() + node.firstPoint, node.pointNum, [this, &node, &visitor](int32 index)
+				{
+					int32 point = node.firstPoint + index;
+					return visitor(FVector2D(pointLats[point], pointLons[point]), pointData[point]);
+				});
+			if (!completed)
+			{
+				return false;
+			}
+
+			if (node.firstChild == INDEX_NONE)
+			{
+				continue;
+			}
+
+			FLatLonBoundingBox childBoundaries[4];
+			entry.Value.Subdivide(childBoundaries[0], childBoundaries[1], childBoundaries[2], childBoundaries[3]);
+			for (int32 child = 3; child >= 0; child--)
+			{
+				stack.Emplace(node.firstChild + child, childBoundaries[child]);
+			}
+		}
+		return true;
+	}
+};
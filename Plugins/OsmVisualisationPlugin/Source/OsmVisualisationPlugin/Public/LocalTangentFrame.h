@@ -0,0 +1,72 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "SphericalCap.h"
+
+/// <summary>
+/// Local frame touching the rendered sphere at a tile's center, X along increasing latitude, Y along increasing
+/// longitude and Z up, in the mapping of AEarth::ConvertSphericalCoordinatesDeg. Points near the center are placed
+/// with a second order expansion of the mapping instead of trig calls, and stay small enough for float vertices.
+/// </summary>
+struct FLocalTangentFrame
+{
+	FVector2D centerLatLon = FVector2D::ZeroVector;
+	double radius = 0.0;
+
+	// Position of the center and rotation of the frame, relative to the planet center
+	FVector origin = FVector::ZeroVector;
+	FQuat rotation = FQuat::Identity;
+
+	double sinTheta = 0.0;
+	double cosTheta = 1.0;
+
+	FLocalTangentFrame()
+	{
+
+	}
+
+	FLocalTangentFrame(const FVector2D& centerLatLon, double radius)
+		: centerLatLon(centerLatLon)
+		, radius(radius)
+	{
+		double sinPhi, cosPhi;
+		FMath::SinCos(&sinTheta, &cosTheta, FMath::DegreesToRadians(centerLatLon.X));
+		FMath::SinCos(&sinPhi, &cosPhi, FMath::DegreesToRadians(centerLatLon.Y));
+
+		FVector up(sinTheta * cosPhi, sinTheta * sinPhi, cosTheta);
+		FVector alongLat(cosTheta * cosPhi, cosTheta * sinPhi, -sinTheta);
+		FVector alongLon(-sinPhi, cosPhi, 0.0);
+		origin = up * radius;
+		rotation = FMatrix(alongLat, alongLon, up, FVector::ZeroVector).ToQuat();
+	}
+
+	/// <summary>
+	/// Frame position of the point height above the sphere at latLon. The error grows with the cube of the
+	/// angular distance from the center, far below float precision within a tile.
+	/// </summary>
+	FVector LatLonToLocal(const FVector2D& latLon, double height = 0.0) const
+	{
+		double dTheta = FMath::DegreesToRadians(latLon.X - centerLatLon.X);
+		double dPhi = FMath::DegreesToRadians(FMath::FindDeltaAngleDegrees(centerLatLon.Y, latLon.Y));
+
+		double x = dTheta - 0.5 * sinTheta * cosTheta * dPhi * dPhi;
+		double y = sinTheta * dPhi + cosTheta * dTheta * dPhi;
+		double drop = 0.5 * (dTheta * dTheta + sinTheta * sinTheta * dPhi * dPhi);
+
+		double pointRadius = radius + height;
+		return FVector(pointRadius * x, pointRadius * y, height - pointRadius * drop);
+	}
+
+	FVector LocalToRelative(const FVector& local) const
+	{
+		return origin + rotation.RotateVector(local);
+	}
+
+	/// <summary>
+	/// Places geometry built in the frame relative to the planet center.
+	/// </summary>
+	FTransform GetTransform() const
+	{
+		return FTransform(rotation, origin);
+	}
+};
@@ -0,0 +1,142 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Async/ParallelFor.h"
+#include "Algo/Sort.h"
+
+/// <summary>
+/// Z-order curve key of a point and the index of the point it was computed for.
+/// </summary>
+struct FMortonEntry
+{
+	uint64 key;
+	int32 index;
+
+	bool operator<(const FMortonEntry& other) const
+	{
+		return key < other.key || (key == other.key && index < other.index);
+	}
+};
+
+struct FMortonCode
+{
+	/// <summary>
+	/// Bits per axis, two axes fit into 62 bits of the key.
+	/// </summary>
+	static constexpr int32 AxisBits = 31;
+
+	static constexpr uint32 AxisMax = (1u << AxisBits) - 1;
+
+	/// <summary>
+	/// Spreads the lower 32 bits of value to the even bits of the result.
+	/// </summary>
+	static uint64 SpreadBits(uint32 value)
+	{
+		uint64 x = value;
+		x = (x | (x << 16)) & 0x0000FFFF0000FFFFull;
+		x = (x | (x << 8)) & 0x00FF00FF00FF00FFull;
+		x = (x | (x << 4)) & 0x0F0F0F0F0F0F0F0Full;
+		x = (x | (x << 2)) & 0x3333333333333333ull;
+		x = (x | (x << 1)) & 0x5555555555555555ull;
+		return x;
+	}
+
+	static uint32 CompactBits(uint64 value)
+	{
+		uint64 x = value & 0x5555555555555555ull;
+		x = (x | (x >> 1)) & 0x3333333333333333ull;
+		x = (x | (x >> 2)) & 0x0F0F0F0F0F0F0F0Full;
+		x = (x | (x >> 4)) & 0x00FF00FF00FF00FFull;
+		x = (x | (x >> 8)) & 0x0000FFFF0000FFFFull;
+		x = (x | (x >> 16)) & 0x00000000FFFFFFFFull;
+		return (uint32)x;
+	}
+
+	/// <summary>
+	/// Interleaves y into the odd and x into the even bits, so every pair of bits from the top
+	/// selects a quadrant: 0 = low y low x, 1 = low y high x, 2 = high y low x, 3 = high y high x.
+	/// </summary>
+	static uint64 Encode(uint32 x, uint32 y)
+	{
+		return (SpreadBits(y) << 1) | SpreadBits(x);
+	}
+
+	/// <summary>
+	/// Maps t in [0, 1] to [0, AxisMax].
+	/// </summary>
+	static uint32 Quantize(double t)
+	{
+		return (uint32)FMath::Clamp<int64>((int64)(t * (AxisMax + 1.0)), 0, AxisMax);
+	}
+
+	/// <summary>
+	/// Quadrant of the key at the given depth, 0 being the root's children.
+	/// </summary>
+	static int32 GetQuadrant(uint64 key, int32 depth)
+	{
+		return (int32)((key >> (2 * (AxisBits - depth - 1))) & 3);
+	}
+
+	/// <summary>
+	/// Sorts the entries by key on all workers: chunks are sorted in parallel, then merged pairwise in parallel rounds.
+	/// </summary>
+	static void ParallelSort(TArray<FMortonEntry>& entries)
+	{
+		const int32 minChunkSize = 16384;
+		int32 chunkNum = FMath::Min(FMath::Max(1, FTaskGraphInterface::Get().GetNumWorkerThreads() + 1), FMath::DivideAndRoundUp(entries.Num(), minChunkSize));
+		if (chunkNum <= 1)
+		{
+			Algo::Sort(entries);
+			return;
+		}
+
+		int32 chunkSize = FMath::DivideAndRoundUp(entries.Num(), chunkNum);
+		ParallelFor(chunkNum, [&entries, chunkSize](int32 chunk)
+			{
+				int32 begin = chunk * chunkSize;
+				int32 end = FMath::Min(begin + chunkSize, entries.Num());
+				Algo::Sort(TArrayView<FMortonEntry>(entries.GetData() + begin, end - begin));
+			});
+
+		TArray<FMortonEntry> buffer;
+		buffer.SetNumUninitialized(entries.Num());
+		TArray<FMortonEntry>* source = &entries;
+		TArray<FMortonEntry>* target = &buffer;
+
+		for (int32 runSize = chunkSize; runSize < entries.Num(); runSize *= 2)
+		{
+			int32 pairNum = FMath::DivideAndRoundUp(entries.Num(), runSize * 2);
+			ParallelFor(pairNum, [source, target, runSize](int32 pair)
+				{
+					int32 num = source->Num();
+					int32 left = pair * runSize * 2;
+					int32 middle = FMath::Min(left + runSize, num);
+					int32 right = FMath::Min(left + runSize * 2, num);
+
+					const FMortonEntry* from = source->GetData();
+					FMortonEntry* to = target->GetData();
+					int32 a = left;
+					int32 b = middle;
+					int32 out = left;
+					while (a < middle && b < right)
+					{
+						to[out++] = from[b] < from[a] ? from[b++] : from[a++];
+					}
+					while (a < middle)
+					{
+						to[out++] = from[a++];
+					}
+					while (b < right)
+					{
+						to[out++] = from[b++];
+					}
+				});
+			Swap(source, target);
+		}
+
+		if (source != &entries)
+		{
+			entries = MoveTemp(buffer);
+		}
+	}
+};
@@ -0,0 +1,99 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Kismet/BlueprintAsyncActionBase.h"
+#include "Containers/Ticker.h"
+#include "OsmDataBatch.h"
+#include "OsmAsyncLoadAction.generated.h"
+
+class AEarth;
+struct FOsmAsyncLoadState;
+
+/// <summary>
+/// Elements the earth kept so far, the ones its ingest filter dropped are not counted.
+/// </summary>
+USTRUCT(BlueprintType)
+struct FOsmLoadProgress
+{
+	GENERATED_BODY()
+
+public:
+	UPROPERTY(BlueprintReadOnly)
+	int32 nodesLoaded = 0;
+
+	UPROPERTY(BlueprintReadOnly)
+	int32 waysLoaded = 0;
+
+	UPROPERTY(BlueprintReadOnly)
+	int32 relationsLoaded = 0;
+};
+
+DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FOsmAsyncLoadDelegate, const FOsmLoadProgress&, progress);
+
+/**
+ * Parses an OSM file (JSON or PBF) on a background thread and commits the parsed elements
+ * to AEarth in bounded slices on the game thread, so loading does not stall the frame.
+ * Finalizing the loaded data is stepped in the same frame budget before the action completes.
+ */
+UCLASS()
+class OSMVISUALISATIONPLUGIN_API UOsmAsyncLoadAction : public UBlueprintAsyncActionBase
+{
+	GENERATED_BODY()
+
+private:
+	TWeakObjectPtr<AEarth> earth;
+	FString filePath;
+
+	int32 elementsPerFrame = 20000;
+	double frameBudgetSeconds = 0.004;
+
+	TSharedPtr<FOsmAsyncLoadState, ESPMode::ThreadSafe> state;
+	TUniquePtr<FOsmDataBatch> currentBatch;
+	int32 currentNodeIndex = 0;
+	int32 currentWayIndex = 0;
+	int32 currentRelationIndex = 0;
+
+	FOsmLoadProgress progress;
+	FTSTicker::FDelegateHandle tickerHandle;
+	// Set between the earth's BeginLoad and EndLoad
+	bool loadOpen = false;
+	// Set once everything is committed and the earth's finalize is stepped on every tick
+	bool finalizing = false;
+
+	bool Tick(float deltaTime);
+	bool CommitCurrentBatch(int32& budget, double deadline);
+	void Finish(bool success);
+
+public:
+	UPROPERTY(BlueprintAssignable)
+	FOsmAsyncLoadDelegate OnProgress;
+
+	UPROPERTY(BlueprintAssignable)
+	FOsmAsyncLoadDelegate OnCompleted;
+
+	UPROPERTY(BlueprintAssignable)
+	FOsmAsyncLoadDelegate OnFailed;
+
+	/// <summary>
+	/// Loads a .json or .pbf file into the earth without blocking the game thread.
+	/// </summary>
+	/// <param name="elementsPerFrame">Upper bound of elements committed to the earth per frame</param>
+	/// <param name="frameBudgetMs">Game thread time spent committing and finalizing per frame, a finalize stage may overrun it</param>
+	UFUNCTION(BlueprintCallable, Category = "OSM", meta = (BlueprintInternalUseOnly = "true", WorldContext = "WorldContextObject"))
+	static UOsmAsyncLoadAction* LoadOsmFileAsync(const UObject* WorldContextObject, AEarth* earth, const FString& filePath, int32 elementsPerFrame = 20000, float frameBudgetMs = 4.0f);
+
+	virtual void Activate() override;
+
+	/// <summary>
+	/// Stops the parsing worker when the action goes away unfinished, for example when the game instance shuts down.
+	/// </summary>
+	virtual void BeginDestroy() override;
+
+	UFUNCTION(BlueprintCallable, Category = "OSM")
+	void Cancel();
+
+	UFUNCTION(BlueprintCallable, Category = "OSM")
+	const FOsmLoadProgress& GetProgress() const;
+};
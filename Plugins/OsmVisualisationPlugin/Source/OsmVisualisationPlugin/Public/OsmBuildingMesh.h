@@ -0,0 +1,74 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "OsmTagList.h"
+#include "LocalTangentFrame.h"
+#include "Containers/Queue.h"
+#include <atomic>
+
+/// <summary>
+/// Outline of one building to extrude, an open ring of lat/lon points (X lat, Y lon) and its height in metres.
+/// </summary>
+struct FOsmBuildingFootprint
+{
+	TArray<FVector2D> outline;
+	double heightMeters = 0.0;
+};
+
+/// <summary>
+/// Merged mesh of all the buildings of one tile, positions in the tile's frame.
+/// </summary>
+struct FOsmTileMeshData
+{
+	uint64 tileId = 0;
+	FLocalTangentFrame frame;
+	TArray<FVector> vertices;
+	TArray<FVector> normals;
+	TArray<int32> triangles;
+};
+
+/// <summary>
+/// Hands tile meshes built on workers over to the game thread. Setting cancelled makes
+/// workers that have not started yet skip their tile.
+/// </summary>
+struct FOsmTileMeshQueue
+{
+	TQueue<TUniquePtr<FOsmTileMeshData>, EQueueMode::Mpsc> readyMeshes;
+	std::atomic<int32> pendingNum{ 0 };
+	std::atomic<bool> cancelled{ false };
+};
+
+/// <summary>
+/// Triangulates building footprints and extrudes them into tile meshes in a tile's local tangent frame.
+/// Thread-safe, works on copied footprints only.
+/// </summary>
+struct OSMVISUALISATIONPLUGIN_API FOsmBuildingMeshBuilder
+{
+	static constexpr double LevelHeightMeters = 3.0;
+
+	/// <summary>
+	/// Height from the height tag, metres unless given in feet, or from building:levels.
+	/// </summary>
+	static double GetHeightMeters(const FOsmTagList& tags, double defaultHeightMeters);
+
+	/// <summary>
+	/// Ear clipping of a simple polygon, a repeated closing point is ignored. Adds three indices into
+	/// polygon per triangle, false if the polygon has less than three points or no area.
+	/// Self-intersecting outlines still yield triangles, just not a correct cover.
+	/// </summary>
+	static bool Triangulate(TConstArrayView<FVector2D> polygon, TArray<int32>& OutTriangles);
+
+	/// <summary>
+	/// Walls and a flat roof for the footprint, appended to the mesh in mesh.frame.
+	/// metersToWorld converts building heights to the units of the frame's radius.
+	/// </summary>
+	static void AppendExtrudedFootprint(const FOsmBuildingFootprint& footprint, double metersToWorld, FOsmTileMeshData& mesh);
+
+	static void BuildTileMesh(const TArray<FOsmBuildingFootprint>& footprints, double metersToWorld, FOsmTileMeshData& mesh);
+
+private:
+	static bool ParseLength(const FString& text, double& outMeters);
+
+	// Winds the triangle so that it faces along outward
+	static void AddOrientedTriangle(FOsmTileMeshData& mesh, int32 a, int32 b, int32 c, const FVector& outward);
+};
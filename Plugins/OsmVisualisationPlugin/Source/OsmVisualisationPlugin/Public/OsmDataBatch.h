@@ -0,0 +1,95 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "OsmElementSink.h"
+
+/// <summary>
+/// Staging buffer for elements decoded off the game thread.
+/// Filled by a worker, then drained into the final stores in a fixed order.
+/// </summary>
+struct FOsmDataBatch : public IOsmElementSink
+{
+	TArray<FOsmNode> nodes;
+	TArray<FOsmWay> ways;
+	TArray<FOsmRelation> relations;
+
+	/// <summary>
+	/// Optional sink the batch will be drained into, readers filling the batch ask it what to skip.
+	/// </summary>
+	const IOsmElementSink* consumer = nullptr;
+
+	virtual bool WantsNodeTags(const FOsmTagList& tags) const override
+	{
+		return !consumer || consumer->WantsNodeTags(tags);
+	}
+
+	virtual bool WantsWay(const FOsmTagList& tags) const override
+	{
+		return !consumer || consumer->WantsWay(tags);
+	}
+
+	virtual bool WantsRelation(const FOsmTagList& tags) const override
+	{
+		return !consumer || consumer->WantsRelation(tags);
+	}
+
+	virtual bool AddNode(FOsmNode&& node) override
+	{
+		nodes.Add(MoveTemp(node));
+		return true;
+	}
+
+	virtual bool AddWay(FOsmWay&& way) override
+	{
+		ways.Add(MoveTemp(way));
+		return true;
+	}
+
+	virtual bool AddRelation(FOsmRelation&& relation) override
+	{
+		relations.Add(MoveTemp(relation));
+		return true;
+	}
+
+	int32 Num() const
+	{
+		return nodes.Num() + ways.Num() + relations.Num();
+	}
+
+	void Reset()
+	{
+		nodes.Reset();
+		ways.Reset();
+		relations.Reset();
+	}
+
+	/// <summary>
+	/// Moves every element into the sink, nodes first, then ways, then relations.
+	/// </summary>
+	bool Drain(IOsmElementSink& sink)
+	{
+		for (FOsmNode& node : nodes)
+		{
+			if (!sink.AddNode(MoveTemp(node)))
+			{
+				return false;
+			}
+		}
+		for (FOsmWay& way : ways)
+		{
+			if (!sink.AddWay(MoveTemp(way)))
+			{
+				return false;
+			}
+		}
+		for (FOsmRelation& relation : relations)
+		{
+			if (!sink.AddRelation(MoveTemp(relation)))
+			{
+				return false;
+			}
+		}
+		Reset();
+		return true;
+	}
+};
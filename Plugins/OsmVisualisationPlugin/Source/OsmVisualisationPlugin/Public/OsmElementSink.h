@@ -0,0 +1,42 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "OsmNode.h"
+#include "OsmWay.h"
+#include "OsmRelation.h"
+
+/// <summary>
+/// Receives OSM elements one at a time from a streaming reader.
+/// Returning false from any of the Add* functions aborts the read.
+/// </summary>
+class OSMVISUALISATIONPLUGIN_API IOsmElementSink
+{
+public:
+	virtual ~IOsmElementSink()
+	{
+
+	}
+
+	virtual bool AddNode(FOsmNode&& node) = 0;
+	virtual bool AddWay(FOsmWay&& way) = 0;
+	virtual bool AddRelation(FOsmRelation&& relation) = 0;
+
+	/// <summary>
+	/// Let readers skip building what the sink would drop anyway. A node whose tags are not
+	/// wanted is still added, just without tags. May be called from worker threads.
+	/// </summary>
+	virtual bool WantsNodeTags(const FOsmTagList& tags) const
+	{
+		return true;
+	}
+
+	virtual bool WantsWay(const FOsmTagList& tags) const
+	{
+		return true;
+	}
+
+	virtual bool WantsRelation(const FOsmTagList& tags) const
+	{
+		return true;
+	}
+};
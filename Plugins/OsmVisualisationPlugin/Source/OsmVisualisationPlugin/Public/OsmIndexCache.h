@@ -0,0 +1,85 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Serialization/Archive.h"
+#include "OsmSnapshot.h"
+
+/// <summary>
+/// A source file nodes were loaded from, with the hash of the ingest filter it was loaded through.
+/// </summary>
+struct FOsmIndexSource
+{
+	FString path;
+	FOsmSnapshotKey key;
+	uint32 filterHash = 0;
+
+	bool operator==(const FOsmIndexSource& other) const
+	{
+		return key == other.key && filterHash == other.filterHash && path == other.path;
+	}
+
+	friend FArchive& operator<<(FArchive& ar, FOsmIndexSource& source)
+	{
+		ar << source.path;
+		ar << source.key;
+		ar << source.filterHash;
+		return ar;
+	}
+};
+
+/// <summary>
+/// Identifies the node data and the kind of index a cached spatial index was built for. The nodes are
+/// described by the sources they were loaded from, the same keys the snapshots use, instead of by the nodes themselves.
+/// </summary>
+struct FOsmIndexCacheKey
+{
+	// Source files in load order, the nodes are what loading them in this order produced
+	TArray<FOsmIndexSource> sources;
+	// Number of sources loaded before each prune of unreferenced nodes
+	TArray<int32> prunedAfter;
+	int64 nodeNum = 0;
+	uint8 layout = 0;
+	int32 nodeCapacity = 0;
+
+	uint64 GetHash() const;
+
+	bool operator==(const FOsmIndexCacheKey& other) const
+	{
+		return nodeNum == other.nodeNum && layout == other.layout && nodeCapacity == other.nodeCapacity
+			&& sources == other.sources && prunedAfter == other.prunedAfter;
+	}
+
+	bool operator!=(const FOsmIndexCacheKey& other) const
+	{
+		return !(*this == other);
+	}
+};
+
+/// <summary>
+/// Binary cache of built spatial indices, stored next to the OSM snapshots under Saved/OsmSnapshots.
+/// The file name and header carry the key, so changed node data simply misses the cache.
+/// </summary>
+class OSMVISUALISATIONPLUGIN_API FOsmIndexCache
+{
+public:
+	static const uint32 Magic = 0x494D534F; // "OSMI"
+	static const uint32 Version = 2;
+
+	static FString GetCachePath(const FOsmIndexCacheKey& key);
+
+	/// <summary>
+	/// Writes the header and lets writeFunc serialize the index, to a temporary file moved into place on success.
+	/// </summary>
+	static bool Write(const FString& cachePath, const FOsmIndexCacheKey& key, TFunctionRef<bool(FArchive&)> writeFunc);
+
+	/// <summary>
+	/// Maps the cache file and lets readFunc deserialize the index if the header matches the key.
+	/// </summary>
+	static bool Read(const FString& cachePath, const FOsmIndexCacheKey& key, TFunctionRef<bool(FArchive&)> readFunc);
+
+	/// <summary>
+	/// Deletes cached indices of older versions and those with a source that changed or is gone.
+	/// Only reads the headers and samples of the sources, meant to run once at startup.
+	/// </summary>
+	static void EvictStale();
+};
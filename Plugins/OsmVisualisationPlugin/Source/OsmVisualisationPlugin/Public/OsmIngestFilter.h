@@ -0,0 +1,142 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "OsmTagList.h"
+#include "OsmIngestFilter.generated.h"
+
+USTRUCT(BlueprintType)
+struct FOsmTagRule
+{
+	GENERATED_BODY()
+
+public:
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+	FString key;
+
+	/// <summary>
+	/// Empty matches any value of the key.
+	/// </summary>
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+	FString value;
+};
+
+/// <summary>
+/// Decides which elements are kept while loading. An element is dropped if it matches any exclude rule,
+/// otherwise it is kept if there are no include rules or it matches one of them.
+/// Untagged ways pass the filter, they may still turn out to be multipolygon members, AEarth::PruneUnreferencedElements
+/// drops the ones nothing uses once the whole dataset is loaded.
+/// Compile() or CompileIfNeeded() must be called on the game thread after editing the rules, Accepts() is thread-safe
+/// afterwards as long as the filter is not compiled again.
+/// </summary>
+USTRUCT(BlueprintType)
+struct OSMVISUALISATIONPLUGIN_API FOsmIngestFilter
+{
+	GENERATED_BODY()
+
+public:
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+	TArray<FOsmTagRule> includeRules;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+	TArray<FOsmTagRule> excludeRules;
+
+private:
+	// Value id INDEX_NONE matches any value
+	TArray<FOsmTag> compiledInclude;
+	TArray<FOsmTag> compiledExclude;
+	bool compiled = false;
+	// Hash of the rules the compiled arrays were made from
+	uint32 compiledRuleHash = 0;
+
+	static uint32 HashRules(const TArray<FOsmTagRule>& rules, uint32 hash)
+	{
+		hash = HashCombine(hash, GetTypeHash(rules.Num()));
+		for (const FOsmTagRule& rule : rules)
+		{
+			hash = HashCombine(hash, GetTypeHash(rule.key));
+			hash = HashCombine(hash, GetTypeHash(rule.value));
+		}
+		return hash;
+	}
+
+	static void CompileRules(const TArray<FOsmTagRule>& rules, TArray<FOsmTag>& outCompiled)
+	{
+		FOsmTagDictionary& dictionary = FOsmTagDictionary::Get();
+		outCompiled.Reset(rules.Num());
+		for (const FOsmTagRule& rule : rules)
+		{
+			int32 valueId = rule.value.IsEmpty() ? INDEX_NONE : dictionary.Intern(rule.value);
+			outCompiled.Add({ dictionary.Intern(rule.key), valueId });
+		}
+	}
+
+	static bool MatchesAny(const TArray<FOsmTag>& compiled, const FOsmTagList& tags)
+	{
+		for (const FOsmTag& rule : compiled)
+		{
+			int32 valueId = tags.Find(rule.key);
+			if (valueId != INDEX_NONE && (rule.value == INDEX_NONE || rule.value == valueId))
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+
+public:
+	bool IsActive() const
+	{
+		return includeRules.Num() > 0 || excludeRules.Num() > 0;
+	}
+
+	void Compile()
+	{
+		CompileRules(includeRules, compiledInclude);
+		CompileRules(excludeRules, compiledExclude);
+		compiled = true;
+		compiledRuleHash = GetRuleHash();
+	}
+
+	uint32 GetRuleHash() const
+	{
+		return HashRules(excludeRules, HashRules(includeRules, 0));
+	}
+
+	/// <summary>
+	/// Compiles if never compiled or any rule was added, removed or edited since.
+	/// </summary>
+	void CompileIfNeeded()
+	{
+		if (!compiled || compiledRuleHash != GetRuleHash())
+		{
+			Compile();
+		}
+	}
+
+	bool Accepts(const FOsmTagList& tags) const
+	{
+		if (MatchesAny(compiledExclude, tags))
+		{
+			return false;
+		}
+		return compiledInclude.IsEmpty() || MatchesAny(compiledInclude, tags);
+	}
+
+	/// <summary>
+	/// Whether a node keeps its tags. Nodes themselves are always loaded, ways may need them.
+	/// </summary>
+	bool AcceptsNodeTags(const FOsmTagList& tags) const
+	{
+		return !IsActive() || Accepts(tags);
+	}
+
+	bool AcceptsWay(const FOsmTagList& tags) const
+	{
+		return !IsActive() || tags.IsEmpty() || Accepts(tags);
+	}
+
+	bool AcceptsRelation(const FOsmTagList& tags) const
+	{
+		return !IsActive() || Accepts(tags);
+	}
+};
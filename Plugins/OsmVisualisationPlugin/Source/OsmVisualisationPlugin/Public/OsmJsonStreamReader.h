@@ -0,0 +1,93 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Serialization/Archive.h"
+#include "Serialization/JsonReader.h"
+#include "OsmElementSink.h"
+
+/// <summary>
+/// Decodes a UTF-8 byte stream into TCHARs on the fly, so that TJsonReader<TCHAR>
+/// can consume a file without loading it into a string first.
+/// </summary>
+class OSMVISUALISATIONPLUGIN_API FOsmUtf8StreamArchive : public FArchive
+{
+private:
+	FArchive* innerArchive;
+
+	TArray<uint8> buffer;
+	int32 bufferSize = 0;
+	int32 bufferPos = 0;
+	int64 innerRemaining = 0;
+
+	TCHAR pendingChar = 0;
+	bool hasPendingChar = false;
+
+	bool FillBuffer();
+	bool ReadByte(uint8& outByte);
+	bool DecodeChar(TCHAR& outChar);
+
+public:
+	FOsmUtf8StreamArchive(FArchive* innerArchive, int32 bufferSize = 64 * 1024);
+
+	virtual void Serialize(void* data, int64 num) override;
+	virtual bool AtEnd() override;
+	virtual FString GetArchiveName() const override;
+};
+
+/// <summary>
+/// SAX-style reader for Overpass JSON. Walks the "elements" array one object at a time
+/// and hands each node, way and relation to a sink without building a JSON DOM.
+/// </summary>
+class OSMVISUALISATIONPLUGIN_API FOsmJsonStreamReader
+{
+private:
+	FOsmUtf8StreamArchive utf8Archive;
+	TSharedRef<TJsonReader<TCHAR>> jsonReader;
+
+	int nodeNum = 0;
+	int wayNum = 0;
+	int relationNum = 0;
+
+	// Fields of the element being read, moved (tags interned) into the element once it is complete and reset for the next one
+	FString elementType;
+	TArray<int64> scratchNodeIds;
+	FOsmTagListBuilder scratchTags;
+	TArray<FOsmRelationMember> scratchMembers;
+
+	bool ReadElementsArray(IOsmElementSink& sink);
+	bool ReadElement(IOsmElementSink& sink);
+	bool ReadNodeIds(TArray<int64>& outNodeIds);
+	bool ReadTags(FOsmTagListBuilder& outTags);
+	bool ReadMembers(TArray<FOsmRelationMember>& outMembers);
+	// outKnownType is false for members of an unknown type, which are read but should be dropped
+	bool ReadMember(FOsmRelationMember& outMember, bool& outKnownType);
+	bool SkipValue(EJsonNotation notation);
+	bool ReportError(const TCHAR* message);
+
+public:
+	FOsmJsonStreamReader(FArchive* archive);
+
+	bool Read(IOsmElementSink& sink);
+
+	int GetNodeNum() const
+	{
+		return nodeNum;
+	}
+
+	int GetWayNum() const
+	{
+		return wayNum;
+	}
+
+	int GetRelationNum() const
+	{
+		return relationNum;
+	}
+
+	/// <summary>
+	/// Opens a JSON file and streams it into the sink.
+	/// </summary>
+	static bool ReadFile(const FString& jsonFilePath, IOsmElementSink& sink);
+
+	static bool ParseRelationMemberType(const FString& typeStr, OsmRelationMemberType& outType);
+};
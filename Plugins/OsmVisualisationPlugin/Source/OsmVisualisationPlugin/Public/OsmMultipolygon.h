@@ -0,0 +1,48 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "OsmWay.h"
+#include "OsmRelation.h"
+
+/// <summary>
+/// Closed ring of a multipolygon. Node indices are read through AEarth::GetResolvedNodeLatLon,
+/// the first index is repeated at the end like in a closed OSM way.
+/// </summary>
+struct FOsmRing
+{
+	TArray<int32> nodeIndices;
+};
+
+struct FOsmMultipolygon
+{
+	int64 relationId = 0;
+	TArray<FOsmRing> outerRings;
+	TArray<FOsmRing> innerRings;
+
+	bool IsValid() const
+	{
+		return outerRings.Num() > 0;
+	}
+};
+
+/// <summary>
+/// Stitches the member ways of a multipolygon relation into closed rings.
+/// Ways are joined at shared endpoint node ids found through a hash map, in either direction.
+/// Stateless and thread-safe, the ways must have been resolved before.
+/// </summary>
+class OSMVISUALISATIONPLUGIN_API FOsmMultipolygonAssembler
+{
+public:
+	static bool IsMultipolygon(const FOsmRelation& relation);
+
+	/// <summary>
+	/// Builds the rings of the relation. Members with an empty role count as outer.
+	/// Open chains and chains over missing nodes are dropped and counted in outUnclosedNum.
+	/// </summary>
+	static bool Assemble(const FOsmRelation& relation, const TMap<int64, FOsmWay>& ways, FOsmMultipolygon& outMultipolygon, int32& outUnclosedNum);
+
+	/// <summary>
+	/// Joins the ways into as many closed rings as possible and returns the number of chains that could not be closed.
+	/// </summary>
+	static int32 AssembleRings(const TArray<const FOsmWay*>& ringWays, TArray<FOsmRing>& outRings);
+};
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "CoreMinimal.h"
+#include "OsmTagList.h"
 #include "OsmNode.generated.h"
 
 USTRUCT(BlueprintType)
@@ -20,7 +21,7 @@ public:
 	double lon;
 
 	UPROPERTY(EditAnywhere)
-	TMap<FString, FString> tags;
+	FOsmTagList tags;
 
 public:
 	FVector2D GetLatLon() const
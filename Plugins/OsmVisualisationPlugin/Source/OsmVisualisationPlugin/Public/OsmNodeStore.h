@@ -0,0 +1,264 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Algo/BinarySearch.h"
+#include "OsmNode.h"
+#include "OsmTagList.h"
+#include "OsmNodeStore.generated.h"
+
+/// <summary>
+/// Structure-of-arrays node storage. Every node keeps the slot it was first added in, so indices handed out
+/// stay valid across loads, and a sorted array of slots gives lookups by id. Coordinates are stored as int32 in
+/// 1e-7 degree units (OSM native precision) in separate contiguous arrays, and the few tagged nodes keep their
+/// tags in a sparse side table. About 20 bytes per untagged node.
+/// </summary>
+USTRUCT()
+struct OSMVISUALISATIONPLUGIN_API FOsmNodeStore
+{
+	GENERATED_BODY()
+
+public:
+	static constexpr double CoordinateScale = 1e7;
+
+private:
+	TArray<int64> ids;
+	TArray<int32> lats;
+	TArray<int32> lons;
+	TMap<int64, FOsmTagList> tags;
+
+	// Slots of the nodes added before the last Finalize(), ordered by id
+	TArray<int32> sortedSlots;
+
+	// Slot of every id added since the last Finalize(), so lookups before it do not scan
+	TMap<int64, int32> tailSlots;
+
+	void SortSlots();
+
+public:
+	static int32 ToFixed(double degrees)
+	{
+		return (int32)FMath::RoundToInt64(degrees * CoordinateScale);
+	}
+
+	static double FromFixed(int32 fixed)
+	{
+		return fixed / CoordinateScale;
+	}
+
+	int32 Num() const
+	{
+		return ids.Num();
+	}
+
+	bool IsFinalized() const
+	{
+		return tailSlots.IsEmpty();
+	}
+
+	void Reserve(int32 num)
+	{
+		ids.Reserve(num);
+		lats.Reserve(num);
+		lons.Reserve(num);
+	}
+
+	void Empty()
+	{
+		ids.Empty();
+		lats.Empty();
+		lons.Empty();
+		tags.Empty();
+		sortedSlots.Empty();
+		tailSlots.Empty();
+	}
+
+	/// <summary>
+	/// Stores the node in the slot of its id, an id seen for the first time gets a new slot at the end.
+	/// Returns whether the id is new.
+	/// </summary>
+	bool Add(FOsmNode&& node)
+	{
+		int32 slot = ids.Num();
+		if (tailSlots.IsEmpty() && (sortedSlots.IsEmpty() || ids[sortedSlots.Last()] < node.id))
+		{
+			// Nodes added in id order stay finalized
+			sortedSlots.Add(slot);
+		}
+		else
+		{
+			int32 existingSlot = Find(node.id);
+			if (existingSlot != INDEX_NONE)
+			{
+				slot = existingSlot;
+			}
+			else
+			{
+				tailSlots.Add(node.id, slot);
+			}
+		}
+
+		bool isNew = slot == ids.Num();
+		if (isNew)
+		{
+			ids.Add(node.id);
+			lats.Add(ToFixed(node.lat));
+			lons.Add(ToFixed(node.lon));
+		}
+		else
+		{
+			lats[slot] = ToFixed(node.lat);
+			lons[slot] = ToFixed(node.lon);
+		}
+
+		if (!node.tags.IsEmpty())
+		{
+			tags.Add(node.id, MoveTemp(node.tags));
+		}
+		else
+		{
+			tags.Remove(node.id);
+		}
+		return isNew;
+	}
+
+	/// <summary>
+	/// Sorts the slots added since the last call and merges them into the sorted slots in one linear pass,
+	/// so the cost is the tail's sort plus a move of the slot array. The nodes themselves do not move.
+	/// </summary>
+	void Finalize();
+
+	/// <summary>
+	/// Removes every node for whose index the predicate returns true. The rest keep their order but
+	/// move to lower slots, indices taken before are invalid afterwards.
+	/// </summary>
+	template<typename Predicate>
+	int32 RemoveAll(Predicate predicate)
+	{
+		Finalize();
+
+		TArray<int32> movedSlots;
+		movedSlots.SetNumUninitialized(ids.Num());
+		int32 writeIndex = 0;
+		for (int32 readIndex = 0; readIndex < ids.Num(); readIndex++)
+		{
+			if (predicate(readIndex))
+			{
+				tags.Remove(ids[readIndex]);
+				movedSlots[readIndex] = INDEX_NONE;
+				continue;
+			}
+			ids[writeIndex] = ids[readIndex];
+			lats[writeIndex] = lats[readIndex];
+			lons[writeIndex] = lons[readIndex];
+			movedSlots[readIndex] = writeIndex;
+			writeIndex++;
+		}
+
+		int32 removedNum = ids.Num() - writeIndex;
+		ids.SetNum(writeIndex);
+		lats.SetNum(writeIndex);
+		lons.SetNum(writeIndex);
+
+		// Remapping keeps the id order of the slots that are left
+		int32 sortedWrite = 0;
+		for (int32 sortedRead = 0; sortedRead < sortedSlots.Num(); sortedRead++)
+		{
+			int32 slot = movedSlots[sortedSlots[sortedRead]];
+			if (slot != INDEX_NONE)
+			{
+				sortedSlots[sortedWrite++] = slot;
+			}
+		}
+		sortedSlots.SetNum(sortedWrite);
+		return removedNum;
+	}
+
+	/// <summary>
+	/// Returns the index of the node or INDEX_NONE.
+	/// </summary>
+	int32 Find(int64 id) const
+	{
+		if (const int32* tailSlot = tailSlots.Find(id))
+		{
+			return *tailSlot;
+		}
+		return FindFinalized(id);
+	}
+
+	/// <summary>
+	/// Like Find, but only looks at the nodes added before the last Finalize(), so it never touches the hash map.
+	/// </summary>
+	int32 FindFinalized(int64 id) const
+	{
+		// Ids past the largest one are the common case while a file is read in id order
+		if (sortedSlots.IsEmpty() || ids[sortedSlots.Last()] < id)
+		{
+			return INDEX_NONE;
+		}
+		int32 position = Algo::LowerBoundBy(sortedSlots, id, [this](int32 slot)
+			{
+				return ids[slot];
+			});
+		return position < sortedSlots.Num() && ids[sortedSlots[position]] == id ? sortedSlots[position] : INDEX_NONE;
+	}
+
+	int64 GetId(int32 index) const
+	{
+		return ids[index];
+	}
+
+	FVector2D GetLatLon(int32 index) const
+	{
+		return FVector2D(FromFixed(lats[index]), FromFixed(lons[index]));
+	}
+
+	const FOsmTagList* GetTags(int64 id) const
+	{
+		return tags.Find(id);
+	}
+
+	// Indexed by slot, the ids are in the order they were first added
+	const TArray<int64>& GetIds() const
+	{
+		return ids;
+	}
+
+	const TArray<int32>& GetFixedLats() const
+	{
+		return lats;
+	}
+
+	const TArray<int32>& GetFixedLons() const
+	{
+		return lons;
+	}
+
+	FOsmNode GetNode(int32 index) const
+	{
+		FOsmNode node;
+		node.id = ids[index];
+		node.lat = FromFixed(lats[index]);
+		node.lon = FromFixed(lons[index]);
+		if (const FOsmTagList* nodeTags = tags.Find(node.id))
+		{
+			node.tags = *nodeTags;
+		}
+		return node;
+	}
+
+	SIZE_T GetAllocatedSize() const
+	{
+		return ids.GetAllocatedSize() + lats.GetAllocatedSize() + lons.GetAllocatedSize() + tags.GetAllocatedSize() + sortedSlots.GetAllocatedSize() + tailSlots.GetAllocatedSize();
+	}
+
+	bool Serialize(FArchive& ar);
+};
+
+template<>
+struct TStructOpsTypeTraits<FOsmNodeStore> : public TStructOpsTypeTraitsBase2<FOsmNodeStore>
+{
+	enum
+	{
+		WithSerializer = true,
+	};
+};
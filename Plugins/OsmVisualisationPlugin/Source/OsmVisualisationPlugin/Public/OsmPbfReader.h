@@ -0,0 +1,55 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Serialization/Archive.h"
+#include "OsmElementSink.h"
+#include "OsmDataBatch.h"
+
+/// <summary>
+/// Reader for the OSM PBF format (https://wiki.openstreetmap.org/wiki/PBF_Format).
+/// Raw blobs are read sequentially, then decompressed and decoded in parallel on task graph
+/// workers and handed to the sink in file order.
+/// </summary>
+class OSMVISUALISATIONPLUGIN_API FOsmPbfReader
+{
+private:
+	FArchive* archive;
+
+	int32 blobsPerWave;
+
+	int nodeNum = 0;
+	int wayNum = 0;
+	int relationNum = 0;
+
+	bool ReadBlob(FString& outType, TArray<uint8>& outBlob);
+	bool CheckHeaderBlock(const TArray<uint8>& blob);
+
+public:
+	/// <param name="blobsPerWave">Blobs decoded in parallel before they are drained to the sink, 0 picks a default from the worker count</param>
+	FOsmPbfReader(FArchive* archive, int32 blobsPerWave = 0);
+
+	bool Read(IOsmElementSink& sink);
+
+	int GetNodeNum() const
+	{
+		return nodeNum;
+	}
+
+	int GetWayNum() const
+	{
+		return wayNum;
+	}
+
+	int GetRelationNum() const
+	{
+		return relationNum;
+	}
+
+	/// <summary>
+	/// Opens a PBF file and reads it into the sink.
+	/// </summary>
+	static bool ReadFile(const FString& pbfFilePath, IOsmElementSink& sink);
+
+	static bool DecompressBlob(const TArray<uint8>& blob, TArray<uint8>& outData);
+	static bool DecodePrimitiveBlock(const TArray<uint8>& blockData, FOsmDataBatch& outBatch);
+};
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "CoreMinimal.h"
+#include "OsmTagList.h"
 #include "OsmRelationMember.h"
 #include "OsmRelation.generated.h"
 
@@ -18,5 +19,5 @@ public:
 	TArray<FOsmRelationMember> members;
 	
 	UPROPERTY(EditAnywhere)
-	TMap<FString, FString> tags;
+	FOsmTagList tags;
 };
\ No newline at end of file
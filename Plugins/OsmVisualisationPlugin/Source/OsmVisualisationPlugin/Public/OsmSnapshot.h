@@ -0,0 +1,147 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Serialization/Archive.h"
+#include "Serialization/MemoryWriter.h"
+#include "OsmElementSink.h"
+
+/// <summary>
+/// Identifies the version of the source file a snapshot was made from, cheap to compute for large files.
+/// </summary>
+struct FOsmSnapshotKey
+{
+	int64 sourceSize = 0;
+	// Last write time of the source in ticks
+	int64 sourceTimestamp = 0;
+	// CRC of the first and last bytes of the source, catches a changed source with the same size and time
+	uint32 sampleHash = 0;
+
+	bool operator==(const FOsmSnapshotKey& other) const
+	{
+		return sourceSize == other.sourceSize && sourceTimestamp == other.sourceTimestamp && sampleHash == other.sampleHash;
+	}
+
+	bool operator!=(const FOsmSnapshotKey& other) const
+	{
+		return !(*this == other);
+	}
+
+	friend FArchive& operator<<(FArchive& ar, FOsmSnapshotKey& key)
+	{
+		ar << key.sourceSize;
+		ar << key.sourceTimestamp;
+		ar << key.sampleHash;
+		return ar;
+	}
+};
+
+/// <summary>
+/// Writes every element passing through it to a snapshot file and forwards those the inner sink wants to it.
+/// The snapshot keeps filtered out elements too, so it stays valid for any ingest filter.
+/// The snapshot is written to a temporary file and only moved into place by Commit().
+/// </summary>
+class OSMVISUALISATIONPLUGIN_API FOsmSnapshotWriter : public IOsmElementSink
+{
+private:
+	IOsmElementSink& innerSink;
+	TUniquePtr<FArchive> writer;
+	FString snapshotPath;
+	FString tempPath;
+
+	// Records are collected here and written in blocks, the checksum is updated block by block
+	TArray<uint8> recordBuffer;
+	FMemoryWriter recordWriter;
+	uint32 recordChecksum = 0;
+	int64 recordNum = 0;
+
+	// Dictionary ids in the order they went into the snapshot string table, tags and roles refer to them by index
+	TArray<int32> stringIds;
+	TMap<int32, int32> stringIndices;
+	TArray<FOsmTag> scratchTags;
+
+	int32 GetStringIndex(int32 stringId);
+	void WriteTags(const FOsmTagList& tags);
+	void EndRecord();
+	void FlushRecords();
+
+public:
+	FOsmSnapshotWriter(const FString& snapshotPath, const FOsmSnapshotKey& key, const FString& sourceFilePath, IOsmElementSink& innerSink);
+	virtual ~FOsmSnapshotWriter();
+
+	bool IsValid() const
+	{
+		return writer.IsValid();
+	}
+
+	virtual bool AddNode(FOsmNode&& node) override;
+	virtual bool AddWay(FOsmWay&& way) override;
+	virtual bool AddRelation(FOsmRelation&& relation) override;
+
+	bool Commit();
+	void Discard();
+};
+
+/// <summary>
+/// Compact binary cache of parsed OSM data, stored under Saved/OsmSnapshots with one snapshot per source path.
+/// Tags are stored as index pairs into a string table at the end of the file, and a trailer holds the record
+/// count and a checksum of everything between header and trailer. Snapshots are memory-mapped when read back.
+/// </summary>
+class OSMVISUALISATIONPLUGIN_API FOsmSnapshot
+{
+public:
+	static const uint32 Magic = 0x534D534F; // "OSMS"
+	static const uint32 Version = 2;
+
+	enum ERecordType : uint8
+	{
+		RT_Node = 1,
+		RT_Way = 2,
+		RT_Relation = 3
+	};
+
+	enum class EReadResult : uint8
+	{
+		Success,
+		// Missing, stale or corrupted, the sink was not touched
+		Unusable,
+		// Reading stopped after elements were already handed to the sink
+		SinkFailed
+	};
+
+	/// <summary>
+	/// Builds the key from the size, write time and a sample of the first and last bytes of the source.
+	/// </summary>
+	static bool ComputeKey(const FString& sourceFilePath, FOsmSnapshotKey& outKey);
+
+	/// <summary>
+	/// Maps the file, or reads it in one go where mapping is not supported, and hands its bytes to readFunc.
+	/// </summary>
+	static bool MapWholeFile(const FString& filePath, TFunctionRef<bool(const uint8*, int64)> readFunc);
+
+	/// <summary>
+	/// Like MapWholeFile, with the bytes wrapped in an archive.
+	/// </summary>
+	static bool ReadWholeFile(const FString& filePath, TFunctionRef<bool(FArchive&)> readFunc);
+
+	static FString GetSnapshotDir();
+
+	static FString GetSnapshotPath(const FString& sourceFilePath);
+
+	/// <summary>
+	/// Reads a snapshot into the sink. The checksum is verified over the raw bytes before the first element
+	/// is decoded, so a missing, stale, truncated or corrupted snapshot is Unusable without touching the sink.
+	/// </summary>
+	static EReadResult Read(const FString& snapshotPath, const FOsmSnapshotKey& key, IOsmElementSink& sink);
+
+	/// <summary>
+	/// Deletes snapshots whose source changed or is gone, and those of older snapshot versions.
+	/// Only reads the headers and samples of the sources, meant to run once at startup.
+	/// </summary>
+	static void EvictStale();
+
+	/// <summary>
+	/// Feeds the sink from the snapshot of the source file when there is a valid one for its key. Otherwise
+	/// runs parseSource and writes a new snapshot along the way, replacing the stale one.
+	/// </summary>
+	static bool LoadCached(const FString& sourceFilePath, const FOsmSnapshotKey& key, IOsmElementSink& sink, TFunctionRef<bool(IOsmElementSink&)> parseSource);
+};
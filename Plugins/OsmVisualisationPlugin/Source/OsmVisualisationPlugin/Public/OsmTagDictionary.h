@@ -0,0 +1,48 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Misc/ScopeRWLock.h"
+#include <atomic>
+
+/// <summary>
+/// Process-wide string table for tag keys and values. Every distinct string is stored once and
+/// referred to by a stable integer id, so tag checks become integer compares. Thread-safe.
+/// </summary>
+class OSMVISUALISATIONPLUGIN_API FOsmTagDictionary
+{
+private:
+	static constexpr int32 ChunkBits = 12;
+	static constexpr int32 ChunkSize = 1 << ChunkBits;
+	static constexpr int32 MaxChunkNum = 1 << 14;
+
+	// Guards ids and adding strings, reading a string by id needs no lock
+	mutable FRWLock lock;
+	TMap<FString, int32> ids;
+	// Strings live in fixed size chunks that never move, and the chunk table never grows. A string
+	// is written before its id is handed out, so GetString can read it while other threads add more.
+	std::atomic<FString*> chunks[MaxChunkNum];
+	int32 stringNum = 0;
+
+	FOsmTagDictionary();
+	~FOsmTagDictionary();
+
+public:
+	static FOsmTagDictionary& Get();
+
+	/// <summary>
+	/// Returns the id of the string, adding it to the dictionary if needed.
+	/// </summary>
+	int32 Intern(const FString& str);
+
+	/// <summary>
+	/// Returns the id of the string or INDEX_NONE if it was never interned.
+	/// </summary>
+	int32 Find(const FString& str) const;
+
+	/// <summary>
+	/// Returns the string of an id. Lock-free, fine to call for every tag of every element.
+	/// </summary>
+	const FString& GetString(int32 id) const;
+
+	int32 Num() const;
+};
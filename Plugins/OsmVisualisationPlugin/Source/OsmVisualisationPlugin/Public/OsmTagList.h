@@ -0,0 +1,220 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "OsmTagDictionary.h"
+#include "OsmTagList.generated.h"
+
+/// <summary>
+/// Key and value ids from FOsmTagDictionary.
+/// </summary>
+struct FOsmTag
+{
+	int32 key;
+	int32 value;
+};
+
+/// <summary>
+/// Tags of an OSM element, an immutable list of interned key/value id pairs sorted by key.
+/// The pairs live in a process-wide pool where equal tag sets share storage, so copying a tag list
+/// is copying a pointer and elements with common tags cost nothing extra. Lists are built with
+/// FOsmTagListBuilder. Serialized as strings, since ids are only meaningful within one process.
+/// </summary>
+USTRUCT(BlueprintType)
+struct OSMVISUALISATIONPLUGIN_API FOsmTagList
+{
+	GENERATED_BODY()
+
+	friend struct FOsmTagListBuilder;
+
+private:
+	const FOsmTag* data = nullptr;
+	int32 num = 0;
+
+	FOsmTagList(const FOsmTag* inData, int32 inNum)
+		: data(inData), num(inNum)
+	{
+	}
+
+	/// <summary>
+	/// Sorts the tags by key and drops all but the last of repeated keys, returns the remaining number.
+	/// </summary>
+	static int32 Normalize(TArrayView<FOsmTag> tags);
+
+	/// <summary>
+	/// Returns the pooled copy of normalized tags, adding it to the pool if it is not there yet.
+	/// </summary>
+	static FOsmTagList Intern(TArrayView<const FOsmTag> tags);
+
+public:
+	FOsmTagList() = default;
+
+	int32 Num() const
+	{
+		return num;
+	}
+
+	bool IsEmpty() const
+	{
+		return num == 0;
+	}
+
+	void Reset()
+	{
+		data = nullptr;
+		num = 0;
+	}
+
+	bool Contains(int32 keyId) const
+	{
+		return Find(keyId) != INDEX_NONE;
+	}
+
+	/// <summary>
+	/// Slow, takes the dictionary lock to look the key up. Use the id overload when checking many elements.
+	/// </summary>
+	bool Contains(const FString& key) const
+	{
+		int32 keyId = FOsmTagDictionary::Get().Find(key);
+		return keyId != INDEX_NONE && Contains(keyId);
+	}
+
+	/// <summary>
+	/// Returns the value id of the key or INDEX_NONE.
+	/// </summary>
+	int32 Find(int32 keyId) const
+	{
+		// Tag lists are short, a scan that stops at the first larger key beats a binary search
+		for (const FOsmTag& tag : *this)
+		{
+			if (tag.key >= keyId)
+			{
+				return tag.key == keyId ? tag.value : INDEX_NONE;
+			}
+		}
+		return INDEX_NONE;
+	}
+
+	/// <summary>
+	/// Slow, takes the dictionary lock to look the key up. Intern the key once with
+	/// FOsmTagDictionary and use the id overload when checking many elements.
+	/// </summary>
+	const FString* Find(const FString& key) const
+	{
+		FOsmTagDictionary& dictionary = FOsmTagDictionary::Get();
+		int32 keyId = dictionary.Find(key);
+		if (keyId == INDEX_NONE)
+		{
+			return nullptr;
+		}
+		int32 valueId = Find(keyId);
+		return valueId == INDEX_NONE ? nullptr : &dictionary.GetString(valueId);
+	}
+
+	TMap<FString, FString> ToMap() const
+	{
+		FOsmTagDictionary& dictionary = FOsmTagDictionary::Get();
+		TMap<FString, FString> result;
+		result.Reserve(num);
+		for (const FOsmTag& tag : *this)
+		{
+			result.Add(dictionary.GetString(tag.key), dictionary.GetString(tag.value));
+		}
+		return result;
+	}
+
+	const FOsmTag* begin() const
+	{
+		return data;
+	}
+
+	const FOsmTag* end() const
+	{
+		return data + num;
+	}
+
+	/// <summary>
+	/// Equal tag sets share their pooled storage, so comparing the pointers is enough.
+	/// </summary>
+	bool operator==(const FOsmTagList& other) const
+	{
+		return data == other.data && num == other.num;
+	}
+
+	bool Serialize(FArchive& ar);
+};
+
+template<>
+struct TStructOpsTypeTraits<FOsmTagList> : public TStructOpsTypeTraitsBase2<FOsmTagList>
+{
+	enum
+	{
+		WithSerializer = true,
+		WithIdenticalViaEquality = true,
+	};
+};
+
+/// <summary>
+/// Collects the tags of one element and interns them into an FOsmTagList. Readers keep one builder
+/// and reuse it for every element, so reading tags allocates nothing once the builder has grown.
+/// </summary>
+struct OSMVISUALISATIONPLUGIN_API FOsmTagListBuilder
+{
+private:
+	TArray<FOsmTag> tags;
+	bool normalized = true;
+
+public:
+	void Reset()
+	{
+		tags.Reset();
+		normalized = true;
+	}
+
+	bool IsEmpty() const
+	{
+		return tags.IsEmpty();
+	}
+
+	void Reserve(int32 tagNum)
+	{
+		tags.Reserve(tagNum);
+	}
+
+	/// <summary>
+	/// Adds a tag, a later value for the same key replaces the earlier one.
+	/// </summary>
+	void Add(int32 keyId, int32 valueId)
+	{
+		tags.Add({ keyId, valueId });
+		normalized = false;
+	}
+
+	void Add(const FString& key, const FString& value)
+	{
+		FOsmTagDictionary& dictionary = FOsmTagDictionary::Get();
+		Add(dictionary.Intern(key), dictionary.Intern(value));
+	}
+
+	/// <summary>
+	/// Returns the collected tags without interning them, valid until the builder changes.
+	/// Lets filters look at an element before its tags are added to the pool.
+	/// </summary>
+	FOsmTagList View()
+	{
+		if (!normalized)
+		{
+			tags.SetNum(FOsmTagList::Normalize(tags), false);
+			normalized = true;
+		}
+		return FOsmTagList(tags.GetData(), tags.Num());
+	}
+
+	/// <summary>
+	/// Returns the collected tags as a pooled list. The builder keeps its tags until reset.
+	/// </summary>
+	FOsmTagList Build()
+	{
+		FOsmTagList view = View();
+		return FOsmTagList::Intern(TArrayView<const FOsmTag>(view.data, view.num));
+	}
+};
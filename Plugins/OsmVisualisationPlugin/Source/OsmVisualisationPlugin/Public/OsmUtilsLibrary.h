@@ -5,6 +5,7 @@
 #include "CoreMinimal.h"
 #include "Kismet/BlueprintFunctionLibrary.h"
 #include "HAL/FileManagerGeneric.h"
+#include "OsmTagList.h"
 #include "OsmUtilsLibrary.generated.h"
 
 class AEarth;
@@ -35,4 +36,13 @@ public:
 	UFUNCTION(BlueprintCallable, meta = (WorldContext = WorldContextObject))
 	static void BuildEarthFromJsonFile(const UObject* WorldContextObject, AEarth* earth, const FString& jsonFilesPattern);
 
+	UFUNCTION(BlueprintPure, Category = "OSM")
+	static TMap<FString, FString> GetOsmTags(const FOsmTagList& tags);
+
+	UFUNCTION(BlueprintPure, Category = "OSM")
+	static bool FindOsmTag(const FOsmTagList& tags, const FString& key, FString& value);
+
+	UFUNCTION(BlueprintCallable, meta = (WorldContext = WorldContextObject))
+	static void BuildEarthFromPbfFile(const UObject* WorldContextObject, AEarth* earth, const FString& pbfFilePath);
+
 };
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "CoreMinimal.h"
+#include "OsmTagList.h"
 #include "OsmWay.generated.h"
 
 USTRUCT(BlueprintType)
@@ -17,5 +18,16 @@ public:
 	TArray<int64> nodeIds;
 	
 	UPROPERTY(EditAnywhere)
-	TMap<FString, FString> tags;
+	FOsmTagList tags;
+
+	/// <summary>
+	/// Indices of nodeIds for AEarth::GetResolvedNodeLatLon, INDEX_NONE for missing nodes.
+	/// Filled by AEarth::ResolveWayNodes() after loading, not serialized.
+	/// </summary>
+	TArray<int32> nodeIndices;
+
+	bool IsResolved() const
+	{
+		return nodeIndices.Num() == nodeIds.Num();
+	}
 };
\ No newline at end of file
@@ -0,0 +1,258 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "MortonCode.h"
+#include "CullResult.h"
+#include "Async/ParallelFor.h"
+
+/// <summary>
+/// Static R-tree bulk-loaded with Sort-Tile-Recursive packing. Boxes are lat/lon rectangles,
+/// X being latitude and Y longitude in degrees. All nodes live in one array, level by level
+/// from the items up to the root, and every node refers to its children by the index of the first one.
+/// </summary>
+template<typename ItemData>
+class FPackedRTree
+{
+private:
+	int32 nodeSize = 16;
+	int32 itemNum = 0;
+
+	// Items first, then each upper level, the root is last
+	TArray<FBox2D> boxes;
+	// Index of the first child for upper nodes, index into items for leaf entries
+	TArray<int32> firstChild;
+	TArray<ItemData> items;
+	// Start of each level in boxes, plus the end
+	TArray<int32> levelBounds;
+
+	static uint32 QuantizeCoordinate(double value, double minValue, double maxValue)
+	{
+		double range = maxValue - minValue;
+		return FMortonCode::Quantize(range > 0 ? (value - minValue) / range : 0.0);
+	}
+
+public:
+	FPackedRTree()
+	{
+
+	}
+
+	/// <summary>
+	/// Builds the tree on all workers. Items are sorted by latitude into vertical slices,
+	/// each slice by longitude, packed into leaves of nodeSize, and the levels above are packed the same way.
+	/// </summary>
+	FPackedRTree(TArray<TPair<FBox2D, ItemData>>&& inItems, int32 nodeSize = 16)
+	{
+		this->nodeSize = FMath::Max(2, nodeSize);
+		itemNum = inItems.Num();
+		if (itemNum == 0)
+		{
+			return;
+		}
+
+		FBox2D totalBox(ForceInit);
+		for (const auto& item : inItems)
+		{
+			totalBox += item.Key;
+		}
+
+		TArray<FMortonEntry> order;
+		order.SetNumUninitialized(itemNum);
+		ParallelFor(itemNum, [&inItems, &order, &totalBox](int32 index)
+			{
+				FVector2D center = inItems[index].Key.GetCenter();
+				order[index].key = QuantizeCoordinate(center.X, totalBox.Min.X, totalBox.Max.X);
+				order[index].index = index;
+			});
+		FMortonCode::ParallelSort(order);
+
+		int32 leafNum = FMath::DivideAndRoundUp(itemNum, this->nodeSize);
+		int32 sliceNum = FMath::CeilToInt32(FMath::Sqrt((double)leafNum));
+		int32 sliceSize = FMath::DivideAndRoundUp(leafNum, sliceNum) * this->nodeSize;
+
+		ParallelFor(FMath::DivideAndRoundUp(itemNum, sliceSize), [&inItems, &order, &totalBox, sliceSize, this](int32 slice)
+			{
+				int32 begin = slice * sliceSize;
+				int32 end = FMath::Min(begin + sliceSize, itemNum);
+				for (int32 i = begin; i < end; i++)
+				{
+					FVector2D center = inItems[order[i].index].Key.GetCenter();
+					order[i].key = QuantizeCoordinate(center.Y, totalBox.Min.Y, totalBox.Max.Y);
+				}
+				Algo::Sort(TArrayView<FMortonEntry>(order.GetData() + begin, end - begin));
+			});
+
+		// Even a single item gets a root above it
+		int32 totalNum = itemNum;
+		int32 levelNum = itemNum;
+		do
+		{
+			levelNum = FMath::DivideAndRoundUp(levelNum, this->nodeSize);
+			totalNum += levelNum;
+		}
+		while (levelNum > 1);
+
+		boxes.SetNumUninitialized(totalNum);
+		firstChild.SetNumUninitialized(totalNum);
+		items.SetNum(itemNum);
+
+		ParallelFor(itemNum, [&inItems, &order, this](int32 i)
+			{
+				auto& item = inItems[order[i].index];
+				boxes[i] = item.Key;
+				firstChild[i] = i;
+				items[i] = MoveTemp(item.Value);
+			});
+		inItems.Empty();
+
+		levelBounds.Add(0);
+		int32 levelStart = 0;
+		int32 levelEnd = itemNum;
+		while (levelEnd - levelStart > 1 || levelBounds.Num() == 1)
+		{
+			levelBounds.Add(levelEnd);
+			int32 parentNum = FMath::DivideAndRoundUp(levelEnd - levelStart, this->nodeSize);
+			ParallelFor(parentNum, [levelStart, levelEnd, this](int32 parent)
+				{
+					int32 childBegin = levelStart + parent * this->nodeSize;
+					int32 childEnd = FMath::Min(childBegin + this->nodeSize, levelEnd);
+					FBox2D box(ForceInit);
+					for (int32 child = childBegin; child < childEnd; child++)
+					{
+						box += boxes[child];
+					}
+					boxes[levelEnd + parent] = box;
+					firstChild[levelEnd + parent] = childBegin;
+				});
+			levelStart = levelEnd;
+			levelEnd += parentNum;
+		}
+		levelBounds.Add(levelEnd);
+	}
+
+	int32 Num() const
+	{
+		return itemNum;
+	}
+
+	FBox2D GetBounds() const
+	{
+		return boxes.Num() > 0 ? boxes.Last() : FBox2D(ForceInit);
+	}
+
+	/// <summary>
+	/// Appends every item with its box, for building a bigger tree out of this one.
+	/// </summary>
+	void GetItems(TArray<TPair<FBox2D, ItemData>>& OutItems) const
+	{
+		OutItems.Reserve(OutItems.Num() + itemNum);
+		for (int32 i = 0; i < itemNum; i++)
+		{
+			OutItems.Emplace(boxes[i], items[firstChild[i]]);
+		}
+	}
+
+	SIZE_T GetAllocatedSize() const
+	{
+		return boxes.GetAllocatedSize() + firstChild.GetAllocatedSize() + items.GetAllocatedSize() + levelBounds.GetAllocatedSize();
+	}
+
+	/// <summary>
+	/// Calls visitor(const FBox2D& box, const ItemData& item) for every item whose box intersects the range.
+	/// </summary>
+	template<typename Visitor>
+	void Query(const FBox2D& range, Visitor&& visitor) const
+	{
+		if (itemNum == 0)
+		{
+			return;
+		}
+
+		TArray<TPair<int32, int32>, TInlineAllocator<64>> stack;
+		int32 rootLevel = levelBounds.Num() - 2;
+		stack.Emplace(boxes.Num() - 1, rootLevel);
+
+		while (stack.Num() > 0)
+		{
+			TPair<int32, int32> entry = stack.Pop(false);
+			int32 nodeIndex = entry.Key;
+			int32 level = entry.Value;
+			if (!boxes[nodeIndex].Intersect(range))
+			{
+				continue;
+			}
+
+			if (level == 0)
+			{
+				visitor(boxes[nodeIndex], items[firstChild[nodeIndex]]);
+				continue;
+			}
+
+			int32 childBegin = firstChild[nodeIndex];
+			int32 childEnd = FMath::Min(childBegin + nodeSize, levelBounds[level]);
+			for (int32 child = childEnd - 1; child >= childBegin; child--)
+			{
+				stack.Emplace(child, level - 1);
+			}
+		}
+	}
+
+	/// <summary>
+	/// Hierarchical culling. test(const FBox2D& box) classifies a node, subtrees it rejects are skipped and subtrees
+	/// it fully accepts are visited without further tests. Calls visitor(const FBox2D& box, const ItemData& item) for every item kept.
+	/// </summary>
+	template<typename NodeTest, typename Visitor>
+	void Cull(NodeTest&& test, Visitor&& visitor) const
+	{
+		if (itemNum == 0)
+		{
+			return;
+		}
+
+		struct FStackEntry
+		{
+			int32 nodeIndex;
+			int32 level;
+			bool accepted;
+		};
+
+		TArray<FStackEntry, TInlineAllocator<64>> stack;
+		stack.Add({ boxes.Num() - 1, levelBounds.Num() - 2, false });
+
+		while (stack.Num() > 0)
+		{
+			FStackEntry entry = stack.Pop(false);
+			bool accepted = entry.accepted;
+			if (!accepted)
+			{
+				ECullResult result = test(boxes[entry.nodeIndex]);
+				if (result == ECullResult::Outside)
+				{
+					continue;
+				}
+				accepted = result == ECullResult::Inside;
+			}
+
+			if (entry.level == 0)
+			{
+				visitor(boxes[entry.nodeIndex], items[firstChild[entry.nodeIndex]]);
+				continue;
+			}
+
+			int32 childBegin = firstChild[entry.nodeIndex];
+			int32 childEnd = FMath::Min(childBegin + nodeSize, levelBounds[entry.level]);
+			for (int32 child = childEnd - 1; child >= childBegin; child--)
+			{
+				stack.Add({ child, entry.level - 1, accepted });
+			}
+		}
+	}
+
+	void Query(const FBox2D& range, TArray<ItemData>& OutResult) const
+	{
+		Query(range, [&OutResult](const FBox2D& box, const ItemData& item)
+			{
+				OutResult.Add(item);
+			});
+	}
+};
@@ -2,7 +2,36 @@
 
 #include "CoreMinimal.h"
 #include "LatLonBoundingBox.h"
+#include "MortonCode.h"
+#include "QuadTreeSearch.h"
+#include "LatLonInterval.h"
+#include "Algo/BinarySearch.h"
 #include "Templates/UniquePtr.h"
+#include "Serialization/Archive.h"
+
+/// <summary>
+/// Serializes an array of trivially copyable elements as one block. When loading, a count larger than
+/// the rest of the archive fails instead of allocating.
+/// </summary>
+template<typename T>
+bool SerializeQuadTreeArray(FArchive& ar, TArray<T>& array)
+{
+	static_assert(TIsTriviallyCopyable<T>::Value, "Only trivially copyable arrays can be serialized as one block");
+
+	int32 num = array.Num();
+	ar << num;
+	if (ar.IsLoading())
+	{
+		if (ar.IsError() || num < 0 || (int64)num * (int64)sizeof(T) > ar.TotalSize() - ar.Tell())
+		{
+			ar.SetError();
+			return false;
+		}
+		array.SetNumUninitialized(num);
+	}
+	ar.Serialize(array.GetData(), (int64)num * sizeof(T));
+	return !ar.IsError();
+}
 
 template<typename PointData>
 class FQuadTree
@@ -11,7 +40,10 @@ private:
 	int nodeCapacity = 128;
 	FLatLonBoundingBox boundary;
 
-	TArray<TPair<FVector2D, PointData>> points;
+	// Points as separate arrays so a whole bucket can be tested with vector compares, longitudes in [-180, 180]
+	TArray<double> pointLats;
+	TArray<double> pointLons;
+	TArray<PointData> pointData;
 
 	TUniquePtr<FQuadTree<PointData>> northWest;
 	TUniquePtr<FQuadTree<PointData>> northEast;
@@ -31,6 +63,168 @@ private:
 		southEast.Reset(new FQuadTree<PointData>(southEastBoundary, nodeCapacity));
 	}
 
+	/// <summary>
+	/// Inclusive on all edges, unlike FLatLonBoundingBox::Contains, so points on cell borders always find a cell.
+	/// </summary>
+	bool ContainsInclusive(const FVector2D& latLon) const
+	{
+		return FLatLonInterval(boundary).Contains(latLon.X, FMath::UnwindDegrees(latLon.Y));
+	}
+
+	void RemovePointAt(int32 index)
+	{
+		pointLats.RemoveAtSwap(index, 1, false);
+		pointLons.RemoveAtSwap(index, 1, false);
+		pointData.RemoveAtSwap(index, 1, false);
+	}
+
+	/// <summary>
+	/// Pulls the points of the children back up and drops them once they all are leaves that fit into this node.
+	/// </summary>
+	void TryMerge()
+	{
+		if (northWest == nullptr)
+		{
+			return;
+		}
+
+		FQuadTree<PointData>* children[4] = { northWest.Get(), northEast.Get(), southWest.Get(), southEast.Get() };
+		int32 total = pointData.Num();
+		for (FQuadTree<PointData>* child : children)
+		{
+			if (child->northWest != nullptr)
+			{
+				return;
+			}
+			total += child->pointData.Num();
+		}
+		if (total > nodeCapacity)
+		{
+			return;
+		}
+
+		for (FQuadTree<PointData>* child : children)
+		{
+			pointLats.Append(child->pointLats);
+			pointLons.Append(child->pointLons);
+			pointData.Append(child->pointData);
+		}
+		northWest.Reset();
+		northEast.Reset();
+		southWest.Reset();
+		southEast.Reset();
+	}
+
+	// Deeper than any tree built from a valid index, guards recursion when reading a broken file
+	static constexpr int32 MaxSerializedDepth = 64;
+
+	bool SerializeNode(FArchive& ar, int32 depth)
+	{
+		if (depth > MaxSerializedDepth
+			|| !SerializeQuadTreeArray(ar, pointLats)
+			|| !SerializeQuadTreeArray(ar, pointLons)
+			|| !SerializeQuadTreeArray(ar, pointData))
+		{
+			return false;
+		}
+		if (pointLons.Num() != pointLats.Num() || pointData.Num() != pointLats.Num())
+		{
+			return false;
+		}
+
+		uint8 hasChildren = northWest != nullptr;
+		ar << hasChildren;
+		if (ar.IsError())
+		{
+			return false;
+		}
+		if (!hasChildren)
+		{
+			return true;
+		}
+
+		if (ar.IsLoading())
+		{
+			Subdivide();
+		}
+		return northWest->SerializeNode(ar, depth + 1)
+			&& northEast->SerializeNode(ar, depth + 1)
+			&& southWest->SerializeNode(ar, depth + 1)
+			&& southEast->SerializeNode(ar, depth + 1);
+	}
+
+	void AddPoint(const FVector2D& latLon, const PointData& data)
+	{
+		pointLats.Add(latLon.X);
+		pointLons.Add(FMath::UnwindDegrees(latLon.Y));
+		pointData.Add(data);
+	}
+
+	// Ranges smaller than this are built on the calling thread
+	static constexpr int32 MinParallelPointNum = 32768;
+
+	/// <summary>
+	/// Depth down to which subtrees are built as separate tasks, deep enough to give every worker a few subtrees to balance the load.
+	/// </summary>
+	static int32 GetParallelDepth()
+	{
+		int32 workerNum = FMath::Max(1, FTaskGraphInterface::Get().GetNumWorkerThreads() + 1);
+		int32 depth = 0;
+		for (int32 subtreeNum = 1; subtreeNum < workerNum * 4; subtreeNum *= 4)
+		{
+			depth++;
+		}
+		return depth;
+	}
+
+	void BuildFromSorted(TArrayView<const uint64> keys, TArrayView<TPair<FVector2D, PointData>> sortedPoints, int32 depth, int32 parallelDepth)
+	{
+		if (sortedPoints.Num() <= nodeCapacity || depth >= FMortonCode::AxisBits)
+		{
+			pointLats.Reserve(sortedPoints.Num());
+			pointLons.Reserve(sortedPoints.Num());
+			pointData.Reserve(sortedPoints.Num());
+			for (const auto& point : sortedPoints)
+			{
+				AddPoint(point.Key, point.Value);
+			}
+			return;
+		}
+
+		Subdivide();
+
+		// Quadrants are ascending within the range, so each child is one contiguous slice
+		int32 bounds[5];
+		bounds[0] = 0;
+		bounds[4] = keys.Num();
+		for (int32 quadrant = 1; quadrant < 4; quadrant++)
+		{
+			bounds[quadrant] = Algo::LowerBoundBy(keys, quadrant, [depth](uint64 key)
+				{
+					return FMortonCode::GetQuadrant(key, depth);
+				});
+		}
+
+		// Children only touch their own slice and their own nodes, building them concurrently gives the same tree
+		FQuadTree<PointData>* children[4] = { southWest.Get(), southEast.Get(), northWest.Get(), northEast.Get() };
+		auto buildChild = [&](int32 quadrant)
+		{
+			int32 num = bounds[quadrant + 1] - bounds[quadrant];
+			children[quadrant]->BuildFromSorted(keys.Slice(bounds[quadrant], num), sortedPoints.Slice(bounds[quadrant], num), depth + 1, parallelDepth);
+		};
+
+		if (depth < parallelDepth && sortedPoints.Num() >= MinParallelPointNum)
+		{
+			ParallelFor(4, buildChild);
+		}
+		else
+		{
+			for (int32 quadrant = 0; quadrant < 4; quadrant++)
+			{
+				buildChild(quadrant);
+			}
+		}
+	}
 
 public:
 	FQuadTree()
@@ -49,49 +243,160 @@ public:
 		this->nodeCapacity = nodeCapacity;
 	}
 
-	TArray<TPair<FVector2D, PointData>> Query(const FLatLonBoundingBox& range)
+	/// <summary>
+	/// Bulk-load constructor. Points are sorted along a Morton curve over the box in parallel and
+	/// every node is cut out of the sorted array as a contiguous range in a single pass, so only
+	/// leaves hold points. The upper levels fan out into tasks, subtrees below are built on one thread each.
+	/// Points outside the box are dropped.
+	/// </summary>
+	FQuadTree(const FLatLonBoundingBox& box, TArray<TPair<FVector2D, PointData>>&& inPoints, int nodeCapacity = 128)
+	{
+		this->boundary = box;
+		this->nodeCapacity = nodeCapacity;
+
+		TArray<uint64> sortedKeys;
+		TArray<TPair<FVector2D, PointData>> sortedPoints;
+		SortByMortonKey(box, MoveTemp(inPoints), sortedKeys, sortedPoints);
+
+		BuildFromSorted(sortedKeys, sortedPoints, 0, GetParallelDepth());
+	}
+
+	/// <summary>
+	/// Position of the point inside the box, both axes in [0, 1]. False if the point is outside.
+	/// </summary>
+	static bool GetLocalPosition(const FLatLonBoundingBox& box, const FVector2D& latLon, double& outLatT, double& outLonT)
+	{
+		double dLat = FMath::FindDeltaAngleDegrees(box.centerLatLon.X, latLon.X);
+		double dLon = FMath::FindDeltaAngleDegrees(box.centerLatLon.Y, latLon.Y);
+		outLatT = (dLat + box.angleHalfSize.X) / (2 * box.angleHalfSize.X);
+		outLonT = (dLon + box.angleHalfSize.Y) / (2 * box.angleHalfSize.Y);
+		return outLatT >= 0 && outLatT <= 1 && outLonT >= 0 && outLonT <= 1;
+	}
+
+	/// <summary>
+	/// Sorts the points along a Morton curve over the box using all workers. Points outside the box are dropped.
+	/// </summary>
+	static void SortByMortonKey(const FLatLonBoundingBox& box, TArray<TPair<FVector2D, PointData>>&& inPoints, TArray<uint64>& outKeys, TArray<TPair<FVector2D, PointData>>& outSortedPoints)
+	{
+		TArray<FMortonEntry> entries;
+		entries.SetNumUninitialized(inPoints.Num());
+		ParallelFor(inPoints.Num(), [&box, &inPoints, &entries](int32 index)
+			{
+				double latT, lonT;
+				bool inside = GetLocalPosition(box, inPoints[index].Key, latT, lonT);
+				entries[index].key = inside ? FMortonCode::Encode(FMortonCode::Quantize(lonT), FMortonCode::Quantize(latT)) : MAX_uint64;
+				entries[index].index = index;
+			});
+
+		FMortonCode::ParallelSort(entries);
+
+		int32 insideNum = Algo::LowerBoundBy(entries, MAX_uint64, [](const FMortonEntry& entry)
+			{
+				return entry.key;
+			});
+
+		outKeys.SetNumUninitialized(insideNum);
+		outSortedPoints.SetNum(insideNum);
+		ParallelFor(insideNum, [&entries, &inPoints, &outKeys, &outSortedPoints](int32 index)
+			{
+				outKeys[index] = entries[index].key;
+				outSortedPoints[index] = MoveTemp(inPoints[entries[index].index]);
+			});
+		inPoints.Empty();
+	}
+
+	/// <summary>
+	/// Writes the tree, or reads it into a default-constructed one. Nodes are stored in preorder, each with its
+	/// points as blocks and a flag for its children. PointData has to be trivially copyable.
+	/// </summary>
+	bool Serialize(FArchive& ar)
+	{
+		ar << nodeCapacity;
+		ar << boundary.centerLatLon;
+		ar << boundary.angleHalfSize;
+		return !ar.IsError() && SerializeNode(ar, 0);
+	}
+
+	TArray<TPair<FVector2D, PointData>> Query(const FLatLonBoundingBox& range) const
 	{
 		TArray<TPair<FVector2D, PointData>> result;
-		Query(box, result);
+		Query(range, result);
 		return result;
 	}
 
+	/// <summary>
+	/// The count points closest to latLon by great-circle distance, nearest first, at most maxAngle radians away.
+	/// </summary>
+	void FindNearest(const FVector2D& latLon, int32 count, TArray<TPair<FVector2D, PointData>>& OutResult, double maxAngle = PI) const
+	{
+		FQuadTreeSearch::FindNearest(this, latLon, count, maxAngle, OutResult);
+	}
+
+	/// <summary>
+	/// Every point within angle radians of latLon by great-circle distance.
+	/// </summary>
+	void QueryRadius(const FVector2D& latLon, double angle, TArray<TPair<FVector2D, PointData>>& OutResult) const
+	{
+		FQuadTreeSearch::QueryRadius(this, latLon, angle, OutResult);
+	}
+
 	void Query(const FLatLonBoundingBox& range, TArray<TPair<FVector2D, PointData>>& OutResult) const
+	{
+		Visit(range, [&OutResult](const FVector2D& latLon, const PointData& data)
+			{
+				OutResult.Emplace(latLon, data);
+				return true;
+			});
+	}
+
+	/// <summary>
+	/// Calls visitor(const FVector2D& latLon, const PointData& data) for every point inside the range without
+	/// allocating. The visitor returns false to stop the query, in which case Visit returns false as well.
+	/// </summary>
+	template<typename Visitor>
+	bool Visit(const FLatLonBoundingBox& range, Visitor&& visitor) const
+	{
+		return Visit(range, FLatLonInterval(range), visitor);
+	}
+
+	template<typename Visitor>
+	bool Visit(const FLatLonBoundingBox& range, const FLatLonInterval& interval, Visitor& visitor) const
 	{
 		if (!boundary.Intersects(range))
 		{
-			return;
+			return true;
 		}
 
-		for (auto& point : points)
-		{
-			if (range.Contains(point.Key))
+		bool completed = interval.ScanPoints(pointLats.GetData(), pointLons.GetData(), pointData.Num(), [this, &visitor](int32 index)
 			{
-				OutResult.Add(point);
-			}
+				return visitor(GetPointLatLon(index), pointData[index]);
+			});
+		if (!completed)
+		{
+			return false;
 		}
 
 		if (northWest == nullptr)
 		{
-			return;
+			return true;
 		}
 
-		northWest->Query(range, OutResult);
-		northEast->Query(range, OutResult);
-		southWest->Query(range, OutResult);
-		southEast->Query(range, OutResult);
+		return northWest->Visit(range, interval, visitor)
+			&& northEast->Visit(range, interval, visitor)
+			&& southWest->Visit(range, interval, visitor)
+			&& southEast->Visit(range, interval, visitor);
 	}
 
 	bool Insert(const TPair<FVector2D, PointData>& point)
 	{
-		if (!boundary.Contains(point.Key))
+		if (!ContainsInclusive(point.Key))
 		{
 			return false;
 		}
 
-		if (points.Num() < nodeCapacity && northWest == nullptr)
+		if (pointData.Num() < nodeCapacity && northWest == nullptr)
 		{
-			points.Add(point);
+			AddPoint(point.Key, point.Value);
 			return true;
 		}
 
@@ -127,6 +432,57 @@ public:
 		return Insert(point);
 	}
 
+	/// <summary>
+	/// Removes one point with exactly this position and data. Cells left with few enough points are merged
+	/// back into their parent on the way up.
+	/// </summary>
+	bool Remove(const FVector2D& latLon, const PointData& data)
+	{
+		if (!ContainsInclusive(latLon))
+		{
+			return false;
+		}
+
+		double lon = FMath::UnwindDegrees(latLon.Y);
+		for (int32 index = 0; index < pointData.Num(); index++)
+		{
+			if (pointData[index] == data && pointLats[index] == latLon.X && pointLons[index] == lon)
+			{
+				RemovePointAt(index);
+				return true;
+			}
+		}
+
+		if (northWest == nullptr)
+		{
+			return false;
+		}
+
+		if (northWest->Remove(latLon, data) || northEast->Remove(latLon, data) || southWest->Remove(latLon, data) || southEast->Remove(latLon, data))
+		{
+			TryMerge();
+			return true;
+		}
+		return false;
+	}
+
+	/// <summary>
+	/// Moves a point. Returns false and leaves the tree unchanged if the old point is not found.
+	/// </summary>
+	bool Update(const FVector2D& oldLatLon, const FVector2D& newLatLon, const PointData& data)
+	{
+		if (!Remove(oldLatLon, data))
+		{
+			return false;
+		}
+		return Insert(newLatLon, data);
+	}
+
+	bool IsEmpty() const
+	{
+		return pointData.Num() == 0 && northWest == nullptr;
+	}
+
 	TArray<FQuadTree*> GetSubtrees() const
 	{
 		TArray<FQuadTree*> result;
@@ -150,8 +506,18 @@ public:
 		}		
 	}
 
-	const TArray<TPair<FVector2D, PointData>>& GetPoints() const
+	int32 GetPointNum() const
+	{
+		return pointData.Num();
+	}
+
+	FVector2D GetPointLatLon(int32 index) const
+	{
+		return FVector2D(pointLats[index], pointLons[index]);
+	}
+
+	const PointData& GetPointData(int32 index) const
 	{
-		return points;
+		return pointData[index];
 	}
 };
\ No newline at end of file
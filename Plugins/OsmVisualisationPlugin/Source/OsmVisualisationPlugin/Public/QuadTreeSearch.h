@@ -0,0 +1,149 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "GreatCircle.h"
+
+/// <summary>
+/// Great-circle searches shared by FQuadTree and FLinearQuadTree. A node handle is either a tree pointer
+/// or a node view, anything offering GetLatLonBoundingBox(), GetPointNum(), GetPointLatLon(), GetPointData() and GetSubtrees().
+/// Distances are central angles in radians.
+/// </summary>
+struct FQuadTreeSearch
+{
+private:
+	template<typename T>
+	static const T& Deref(T* node)
+	{
+		return *node;
+	}
+
+	template<typename T>
+	static const T& Deref(const T& node)
+	{
+		return node;
+	}
+
+	template<typename NodeHandle>
+	struct FCellEntry
+	{
+		double distance;
+		NodeHandle node;
+
+		bool operator<(const FCellEntry& other) const
+		{
+			return distance < other.distance;
+		}
+	};
+
+	template<typename PointData>
+	struct FPointEntry
+	{
+		double distance;
+		FVector2D latLon;
+		const PointData* data;
+
+		// Max-heap, the worst of the current candidates is on top
+		bool operator<(const FPointEntry& other) const
+		{
+			return distance > other.distance;
+		}
+	};
+
+public:
+	/// <summary>
+	/// Best-first k-nearest-neighbour search. Cells are visited in order of their minimum distance and the
+	/// search stops once no cell can beat the worst of the count candidates kept. Results are sorted by distance.
+	/// </summary>
+	template<typename NodeHandle, typename PointData>
+	static void FindNearest(NodeHandle root, const FVector2D& latLon, int32 count, double maxAngle, TArray<TPair<FVector2D, PointData>>& OutResult)
+	{
+		if (count <= 0)
+		{
+			return;
+		}
+
+		TArray<FCellEntry<NodeHandle>> cells;
+		TArray<FPointEntry<PointData>> candidates;
+		candidates.Reserve(count + 1);
+
+		cells.HeapPush({ FGreatCircle::MinAngularDistance(latLon, Deref(root).GetLatLonBoundingBox()), root });
+		while (cells.Num() > 0)
+		{
+			FCellEntry<NodeHandle> cell = cells.HeapTop();
+			cells.HeapPopDiscard(false);
+
+			double bound = candidates.Num() == count ? candidates.HeapTop().distance : maxAngle;
+			if (cell.distance > bound)
+			{
+				break;
+			}
+
+			const auto& node = Deref(cell.node);
+			for (int32 index = 0; index < node.GetPointNum(); index++)
+			{
+				FVector2D pointLatLon = node.GetPointLatLon(index);
+				double distance = FGreatCircle::AngularDistance(latLon, pointLatLon);
+				if (distance > maxAngle)
+				{
+					continue;
+				}
+				if (candidates.Num() < count)
+				{
+					candidates.HeapPush({ distance, pointLatLon, &node.GetPointData(index) });
+				}
+				else if (distance < candidates.HeapTop().distance)
+				{
+					candidates.HeapPopDiscard(false);
+					candidates.HeapPush({ distance, pointLatLon, &node.GetPointData(index) });
+				}
+			}
+
+			for (const auto& subtree : node.GetSubtrees())
+			{
+				double distance = FGreatCircle::MinAngularDistance(latLon, Deref(subtree).GetLatLonBoundingBox());
+				double subtreeBound = candidates.Num() == count ? candidates.HeapTop().distance : maxAngle;
+				if (distance <= subtreeBound)
+				{
+					cells.HeapPush({ distance, subtree });
+				}
+			}
+		}
+
+		candidates.Sort([](const FPointEntry<PointData>& a, const FPointEntry<PointData>& b)
+			{
+				return a.distance < b.distance;
+			});
+		OutResult.Reserve(OutResult.Num() + candidates.Num());
+		for (const auto& candidate : candidates)
+		{
+			OutResult.Emplace(candidate.latLon, *candidate.data);
+		}
+	}
+
+	/// <summary>
+	/// Every point within the angle of latLon. Cells entirely farther away are skipped as a whole.
+	/// </summary>
+	template<typename NodeHandle, typename PointData>
+	static void QueryRadius(NodeHandle node, const FVector2D& latLon, double angle, TArray<TPair<FVector2D, PointData>>& OutResult)
+	{
+		if (FGreatCircle::MinAngularDistance(latLon, Deref(node).GetLatLonBoundingBox()) > angle)
+		{
+			return;
+		}
+
+		const auto& nodeRef = Deref(node);
+		for (int32 index = 0; index < nodeRef.GetPointNum(); index++)
+		{
+			FVector2D pointLatLon = nodeRef.GetPointLatLon(index);
+			if (FGreatCircle::AngularDistance(latLon, pointLatLon) <= angle)
+			{
+				OutResult.Emplace(pointLatLon, nodeRef.GetPointData(index));
+			}
+		}
+
+		for (const auto& subtree : nodeRef.GetSubtrees())
+		{
+			QueryRadius(subtree, latLon, angle, OutResult);
+		}
+	}
+};
@@ -0,0 +1,100 @@
+#pragma once
+
+#include "CoreMinimal.h"
+
+/// <summary>
+/// Cap on the rendered unit sphere, a center direction and an angular radius in radians. Directions follow
+/// AEarth::ConvertSphericalCoordinatesDeg, X of a lat/lon pair is the polar angle and Y the azimuth, both in degrees.
+/// </summary>
+struct FSphericalCap
+{
+	FVector direction = FVector::ZAxisVector;
+	double angle = PI;
+
+	FSphericalCap()
+	{
+
+	}
+
+	FSphericalCap(const FVector& direction, double angle)
+		: direction(direction)
+		, angle(angle)
+	{
+
+	}
+
+	static FVector LatLonToDirection(const FVector2D& latLon)
+	{
+		double sinTheta, cosTheta, sinPhi, cosPhi;
+		FMath::SinCos(&sinTheta, &cosTheta, FMath::DegreesToRadians(latLon.X));
+		FMath::SinCos(&sinPhi, &cosPhi, FMath::DegreesToRadians(latLon.Y));
+		return FVector(sinTheta * cosPhi, sinTheta * sinPhi, cosTheta);
+	}
+
+	static double AngleBetween(const FVector& directionA, const FVector& directionB)
+	{
+		return FMath::Acos(FMath::Clamp(FVector::DotProduct(directionA, directionB), -1.0, 1.0));
+	}
+
+	/// <summary>
+	/// Smallest cap around the center of a lat/lon box (X lat, Y lon) that holds the whole box. A box whose polar angle
+	/// crosses a pole of the rendered sphere is split there, each part's farthest point from its own center is one
+	/// of its corners. Boxes spanning more than 90 degrees on an axis get a cap covering the whole sphere.
+	/// </summary>
+	static FSphericalCap FromLatLonBox(const FBox2D& box)
+	{
+		FVector center = LatLonToDirection(box.GetCenter());
+		if (box.Max.X - box.Min.X > 90.0 || box.Max.Y - box.Min.Y > 180.0)
+		{
+			return FSphericalCap(center, PI);
+		}
+
+		double splits[3] = { box.Min.X, box.Max.X, box.Max.X };
+		int32 partNum = 1;
+		double pole = FMath::CeilToDouble(box.Min.X / 180.0) * 180.0;
+		if (pole > box.Min.X && pole < box.Max.X)
+		{
+			splits[1] = pole;
+			partNum = 2;
+		}
+
+		double result = 0.0;
+		for (int32 part = 0; part < partNum; part++)
+		{
+			FBox2D partBox(FVector2D(splits[part], box.Min.Y), FVector2D(splits[part + 1], box.Max.Y));
+			FVector partCenter = LatLonToDirection(partBox.GetCenter());
+			const FVector2D corners[4] = { partBox.Min, partBox.Max, FVector2D(partBox.Min.X, partBox.Max.Y), FVector2D(partBox.Max.X, partBox.Min.Y) };
+
+			double partAngle = 0.0;
+			for (const FVector2D& corner : corners)
+			{
+				partAngle = FMath::Max(partAngle, AngleBetween(partCenter, LatLonToDirection(corner)));
+			}
+			result = FMath::Max(result, AngleBetween(center, partCenter) + partAngle);
+		}
+		return FSphericalCap(center, FMath::Min(result, PI));
+	}
+
+	double AngleTo(const FVector& otherDirection) const
+	{
+		return AngleBetween(direction, otherDirection);
+	}
+
+	bool Intersects(const FSphericalCap& other) const
+	{
+		return AngleTo(other.direction) <= angle + other.angle;
+	}
+
+	bool Contains(const FSphericalCap& other) const
+	{
+		return AngleTo(other.direction) + other.angle <= angle;
+	}
+
+	/// <summary>
+	/// Length of the chord between the center and the rim on a sphere of the given radius.
+	/// </summary>
+	double GetChordLength(double radius) const
+	{
+		return 2.0 * radius * FMath::Sin(FMath::Min(angle, PI) * 0.5);
+	}
+};
@@ -37,6 +37,8 @@ public class OsmVisualisationPluginEditor : ModuleRules
                 "Engine",
                 "Slate",
                 "SlateCore",
+                "PropertyEditor",
+                "OsmVisualisationPlugin",
             }
 			);
 		
@@ -0,0 +1,82 @@
+#include "OsmTagListCustomization.h"
+#include "OsmTagList.h"
+#include "DetailWidgetRow.h"
+#include "IDetailChildrenBuilder.h"
+#include "PropertyHandle.h"
+#include "Widgets/Text/STextBlock.h"
+
+#define LOCTEXT_NAMESPACE "FOsmTagListCustomization"
+
+TSharedRef<IPropertyTypeCustomization> FOsmTagListCustomization::MakeInstance()
+{
+	return MakeShareable(new FOsmTagListCustomization());
+}
+
+const FOsmTagList* FOsmTagListCustomization::GetTagList(const TSharedRef<IPropertyHandle>& propertyHandle)
+{
+	TArray<const void*> rawData;
+	propertyHandle->AccessRawData(rawData);
+	if (rawData.IsEmpty() || !rawData[0])
+	{
+		return nullptr;
+	}
+
+	const FOsmTagList* tags = static_cast<const FOsmTagList*>(rawData[0]);
+	for (const void* other : rawData)
+	{
+		if (!other || !(*static_cast<const FOsmTagList*>(other) == *tags))
+		{
+			return nullptr;
+		}
+	}
+	return tags;
+}
+
+void FOsmTagListCustomization::CustomizeHeader(TSharedRef<IPropertyHandle> propertyHandle, FDetailWidgetRow& headerRow, IPropertyTypeCustomizationUtils& customizationUtils)
+{
+	const FOsmTagList* tags = GetTagList(propertyHandle);
+	FText summary = tags ? FText::Format(LOCTEXT("TagNum", "{0} tags"), tags->Num()) : LOCTEXT("MultipleValues", "Multiple Values");
+
+	headerRow
+		.NameContent()
+		[
+			propertyHandle->CreatePropertyNameWidget()
+		]
+		.ValueContent()
+		[
+			SNew(STextBlock)
+			.Text(summary)
+			.Font(customizationUtils.GetRegularFont())
+		];
+}
+
+void FOsmTagListCustomization::CustomizeChildren(TSharedRef<IPropertyHandle> propertyHandle, IDetailChildrenBuilder& childBuilder, IPropertyTypeCustomizationUtils& customizationUtils)
+{
+	const FOsmTagList* tags = GetTagList(propertyHandle);
+	if (!tags)
+	{
+		return;
+	}
+
+	FOsmTagDictionary& dictionary = FOsmTagDictionary::Get();
+	for (const FOsmTag& tag : *tags)
+	{
+		FText key = FText::FromString(dictionary.GetString(tag.key));
+		FText value = FText::FromString(dictionary.GetString(tag.value));
+		childBuilder.AddCustomRow(key)
+			.NameContent()
+			[
+				SNew(STextBlock)
+				.Text(key)
+				.Font(customizationUtils.GetRegularFont())
+			]
+			.ValueContent()
+			[
+				SNew(STextBlock)
+				.Text(value)
+				.Font(customizationUtils.GetRegularFont())
+			];
+	}
+}
+
+#undef LOCTEXT_NAMESPACE
@@ -1,18 +1,26 @@
 // Copyright Epic Games, Inc. All Rights Reserved.
 
 #include "OsmVisualisationPluginEditor.h"
+#include "OsmTagListCustomization.h"
+#include "PropertyEditorModule.h"
 
 #define LOCTEXT_NAMESPACE "FOsmVisualisationPluginModule"
 
 void FOsmVisualisationPluginEditorModule::StartupModule()
 {
 	// This code will execute after your module is loaded into memory; the exact timing is specified in the .uplugin file per-module
+	FPropertyEditorModule& propertyEditor = FModuleManager::LoadModuleChecked<FPropertyEditorModule>("PropertyEditor");
+	propertyEditor.RegisterCustomPropertyTypeLayout("OsmTagList", FOnGetPropertyTypeCustomizationInstance::CreateStatic(&FOsmTagListCustomization::MakeInstance));
 }
 
 void FOsmVisualisationPluginEditorModule::ShutdownModule()
 {
 	// This function may be called during shutdown to clean up your module.  For modules that support dynamic reloading,
 	// we call this function before unloading the module.
+	if (FPropertyEditorModule* propertyEditor = FModuleManager::GetModulePtr<FPropertyEditorModule>("PropertyEditor"))
+	{
+		propertyEditor->UnregisterCustomPropertyTypeLayout("OsmTagList");
+	}
 }
 
 #undef LOCTEXT_NAMESPACE
@@ -0,0 +1,23 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "IPropertyTypeCustomization.h"
+
+struct FOsmTagList;
+
+/// <summary>
+/// Shows FOsmTagList properties in the details panel as read-only key/value rows. The tags are pooled
+/// id pairs without reflected fields, so the default layout would show nothing.
+/// </summary>
+class FOsmTagListCustomization : public IPropertyTypeCustomization
+{
+public:
+	static TSharedRef<IPropertyTypeCustomization> MakeInstance();
+
+	virtual void CustomizeHeader(TSharedRef<IPropertyHandle> propertyHandle, FDetailWidgetRow& headerRow, IPropertyTypeCustomizationUtils& customizationUtils) override;
+	virtual void CustomizeChildren(TSharedRef<IPropertyHandle> propertyHandle, IDetailChildrenBuilder& childBuilder, IPropertyTypeCustomizationUtils& customizationUtils) override;
+
+private:
+	// Null when several objects with different tags are selected
+	static const FOsmTagList* GetTagList(const TSharedRef<IPropertyHandle>& propertyHandle);
+};
@@ -2,6 +2,8 @@
 
 
 #include "OrbitingPawn.h"
+#include "Earth.h"
+#include "Kismet/GameplayStatics.h"
 
 // Sets default values
 AOrbitingPawn::AOrbitingPawn()
@@ -18,6 +20,8 @@ void AOrbitingPawn::BeginPlay()
 	
 	springArm = GetComponentByClass<USpringArmComponent>();
 	ensure(springArm);
+
+	earth = Cast<AEarth>(UGameplayStatics::GetActorOfClass(GetWorld(), AEarth::StaticClass()));
 }
 
 void AOrbitingPawn::OnMouseX(float value)
@@ -65,6 +69,11 @@ void AOrbitingPawn::Tick(float DeltaTime)
 {
 	Super::Tick(DeltaTime);
 
+	if (springArm && earth)
+	{
+		FVector cameraLocation = springArm->GetSocketLocation(USpringArmComponent::SocketName);
+		earth->SetViewDistance(FVector::Distance(cameraLocation, earth->GetActorLocation()));
+	}
 }
 
 // Called to bind functionality to input
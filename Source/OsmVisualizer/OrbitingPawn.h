@@ -7,6 +7,8 @@
 #include "GameFramework/SpringArmComponent.h"
 #include "OrbitingPawn.generated.h"
 
+class AEarth;
+
 UCLASS()
 class OSMVISUALIZER_API AOrbitingPawn : public APawn
 {
@@ -22,6 +24,10 @@ private:
 	UPROPERTY(EditDefaultsOnly)
 	double mouseZoomSensitivity = 1000.0;
 
+	// Told the camera distance every frame for its building level of detail
+	UPROPERTY(Transient)
+	AEarth* earth;
+
 public:
 	// Sets default values for this pawn's properties
 	AOrbitingPawn();